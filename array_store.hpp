@@ -7,6 +7,7 @@
 #include <boost/array.hpp>
 #include <boost/property_map/property_map.hpp>
 #include <morton.hpp>
+#include <hilbert.hpp>
 
 
 
@@ -210,11 +211,71 @@ namespace raster_stats {
 
 
 
+	/*! Base-two logarithm of a power of two, at compile time.
+	 */
+	template<size_t B>
+	struct static_log2 {
+		static_assert(B>1 && (B&(B-1))==0, "Block size must be a power of two.");
+		static constexpr size_t value=static_log2<(B>>1)>::value+1;
+	};
+
+	template<>
+	struct static_log2<1> {
+		static constexpr size_t value=0;
+	};
+
+
+
+	/*! The same layout as transform_ij_blocked, but the block size
+	 *  is a power of two known at compile time, so the division and
+	 *  modulo become shifts and masks.
+	 */
+	template<size_t B>
+	struct transform_ij_blocked_static {
+		typedef boost::array<size_t,2> key_type;
+		typedef size_t value_type;
+		static constexpr size_t shift_=static_log2<B>::value;
+		size_t w_;
+
+		transform_ij_blocked_static(size_t w, size_t block=B) : w_(w) {}
+
+		value_type operator()(const key_type& k) const {
+			size_t n=k[0]*w_+k[1];
+			size_t nd=n&(B*B-1);
+			return (n-nd) + (nd>>shift_) + ((nd&(B-1))<<shift_);
+		}
+	};
+
+
+
+	/*! The same layout as transform_ij_full_blocked, with a
+	 *  compile-time power-of-two block size.
+	 */
+	template<size_t B>
+	struct transform_ij_full_blocked_static {
+		typedef boost::array<size_t,2> key_type;
+		typedef size_t value_type;
+		static constexpr size_t shift_=static_log2<B>::value;
+		size_t w_;  //! Width of j.
+		size_t wb_; //! Width in blocks.
+
+		transform_ij_full_blocked_static(size_t w, size_t block=B)
+			: w_(w), wb_((w_+B-1)>>shift_) {}
+
+		value_type operator()(const key_type& k) const {
+			return (((k[0]>>shift_)*wb_+(k[1]>>shift_))<<(2*shift_)) +
+				((k[0]&(B-1))<<shift_) + (k[1]&(B-1));
+		}
+	};
+
+
+
 	struct transform_morton_ij {
 	    typedef boost::array<size_t,2> key_type;
         typedef size_t value_type;
 
         transform_morton_ij() {}
+        transform_morton_ij(size_t w, size_t block=0) {}
 
         value_type operator()(const key_type& k) const {
             return morton_calculations::combine_xy<typename key_type::value_type,value_type>(k);
@@ -223,6 +284,110 @@ namespace raster_stats {
 
 
 
+	/*! Hilbert-curve order. The order is the number of bits in each
+	 *  coordinate, so the square side is 2^order_ and storage must cover
+	 *  the whole square. Use storage_size() to find how much that is.
+	 */
+	struct transform_hilbert_ij {
+	    typedef boost::array<size_t,2> key_type;
+        typedef size_t value_type;
+        unsigned order_;
+
+        transform_hilbert_ij(size_t w, size_t block=0)
+            : order_(hilbert_calculations::order(w)) {}
+
+        value_type operator()(const key_type& k) const {
+            return hilbert_calculations::combine_xy<typename key_type::value_type,
+                                                    value_type>(k,order_);
+        }
+	};
+
+
+
+	/*! How many elements a transform_map needs to hold an array
+	 *  of the given extent. The row-major transform is dense.
+	 *  The space-filling curves need the enclosing power-of-two
+	 *  square.
+	 */
+	template<class TR>
+	size_t storage_size(const TR& tr, const boost::array<size_t,2>& extent)
+	{
+		return extent[0]*extent[1];
+	}
+
+
+	/*! Blocked layouts scatter the last, partial, block past the end
+	 *  of a dense array, so round up to whole blocks.
+	 */
+	inline size_t blocked_storage_size(const boost::array<size_t,2>& extent,
+	                                   size_t b)
+	{
+		return ((extent[0]*extent[1]+b*b-1)/(b*b))*b*b;
+	}
+
+
+	inline size_t full_blocked_storage_size(const boost::array<size_t,2>& extent,
+	                                        size_t b)
+	{
+		return ((extent[0]+b-1)/b)*((extent[1]+b-1)/b)*b*b;
+	}
+
+
+	inline size_t storage_size(const transform_ij_blocked& tr,
+	                           const boost::array<size_t,2>& extent)
+	{
+		return blocked_storage_size(extent,tr.b_);
+	}
+
+
+	inline size_t storage_size(const transform_ij_full_blocked& tr,
+	                           const boost::array<size_t,2>& extent)
+	{
+		return full_blocked_storage_size(extent,tr.b_);
+	}
+
+
+	template<size_t B>
+	size_t storage_size(const transform_ij_blocked_static<B>& tr,
+	                    const boost::array<size_t,2>& extent)
+	{
+		return blocked_storage_size(extent,B);
+	}
+
+
+	template<size_t B>
+	size_t storage_size(const transform_ij_full_blocked_static<B>& tr,
+	                    const boost::array<size_t,2>& extent)
+	{
+		return full_blocked_storage_size(extent,B);
+	}
+
+
+	inline size_t curve_storage_size(const boost::array<size_t,2>& extent)
+	{
+		size_t side=1;
+		while (side<extent[0] || side<extent[1]) {
+			side<<=1;
+		}
+		return side*side;
+	}
+
+
+	inline size_t storage_size(const transform_morton_ij& tr,
+	                           const boost::array<size_t,2>& extent)
+	{
+		return curve_storage_size(extent);
+	}
+
+
+	inline size_t storage_size(const transform_hilbert_ij& tr,
+	                           const boost::array<size_t,2>& extent)
+	{
+		return curve_storage_size(extent);
+	}
+
+
+
     struct transform_morton {
         typedef size_t key_type;
         typedef size_t value_type;
@@ -233,6 +398,59 @@ namespace raster_stats {
             return k;
         }
     };
+
+
+
+	//! Row-major order for a three-dimensional array, k fastest.
+	struct transform_ijk {
+	    typedef boost::array<size_t,3> key_type;
+        typedef size_t value_type;
+        size_t w1_;
+        size_t w2_;
+
+        transform_ijk(const boost::array<size_t,3>& extent)
+            : w1_(extent[1]), w2_(extent[2]) {}
+
+        value_type operator()(const key_type& k) const {
+            return (k[0]*w1_+k[1])*w2_+k[2];
+        }
+	};
+
+
+
+	/*! Morton order in three dimensions, the run-time counterpart
+	 *  of morton_xyz. Storage must cover the power-of-two cube.
+	 */
+	struct transform_morton_ijk {
+	    typedef boost::array<size_t,3> key_type;
+        typedef size_t value_type;
+
+        transform_morton_ijk() {}
+        transform_morton_ijk(const boost::array<size_t,3>& extent) {}
+
+        value_type operator()(const key_type& k) const {
+            return morton_calculations::combine<3,size_t,value_type>(k);
+        }
+	};
+
+
+
+	template<class TR>
+	size_t storage_size(const TR& tr, const boost::array<size_t,3>& extent)
+	{
+		return extent[0]*extent[1]*extent[2];
+	}
+
+
+	inline size_t storage_size(const transform_morton_ijk& tr,
+	                           const boost::array<size_t,3>& extent)
+	{
+		size_t side=1;
+		while (side<extent[0] || side<extent[1] || side<extent[2]) {
+			side<<=1;
+		}
+		return side*side*side;
+	}
 }
 
 
@@ -0,0 +1,108 @@
+/*! class_lut.hpp
+ *  Treats groups of land-use classes as one, such as forest codes
+ *  41, 42 and 43, without rewriting the raster first. A lookup table
+ *  maps each class to its group, and the engines compare groups.
+ */
+#ifndef _CLASS_LUT_HPP_
+#define _CLASS_LUT_HPP_ 1
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+
+namespace raster_stats {
+
+    /*! A table from every value of T to its group. T is at most
+     *  16 bits wide, so the table has 256 or 65536 entries.
+     *  It starts as the identity, so each class is its own group.
+     */
+    template<class T=unsigned char>
+    class class_lut {
+        static_assert(std::numeric_limits<T>::is_integer &&
+                      !std::numeric_limits<T>::is_signed && sizeof(T)<=2,
+                      "class_lut needs an unsigned type of 8 or 16 bits.");
+        std::vector<T> group_;
+    public:
+        typedef T value_type;
+
+        class_lut() : group_(size_t(std::numeric_limits<T>::max())+1) {
+            for (size_t c=0; c<group_.size(); c++) {
+                group_[c]=T(c);
+            }
+        }
+
+        void assign(T cls, T group) { group_[cls]=group; }
+
+        /*! Joins the groups of every class in [first,last) into the
+         *  group of *first, so classes that earlier merges put with
+         *  them come along.
+         */
+        template<class ITER>
+        void merge(ITER first, ITER last) {
+            if (first==last) {
+                return;
+            }
+            const T group=group_[*first];
+            std::vector<bool> joined(group_.size(),false);
+            for (; first!=last; ++first) {
+                joined[group_[*first]]=true;
+            }
+            for (size_t c=0; c<group_.size(); c++) {
+                if (joined[group_[c]]) {
+                    group_[c]=group;
+                }
+            }
+        }
+
+        T operator()(T cls) const { return group_[cls]; }
+
+        //! Writes the group of each of n classes. Unrolled, because
+        //! the engines call it once per row.
+        void remap(const T* in, size_t n, T* out) const {
+            const T* table=&group_[0];
+            size_t i=0;
+            for (; i+4<=n; i+=4) {
+                out[i]=table[in[i]];
+                out[i+1]=table[in[i+1]];
+                out[i+2]=table[in[i+2]];
+                out[i+3]=table[in[i+3]];
+            }
+            for (; i<n; i++) {
+                out[i]=table[in[i]];
+            }
+        }
+    };
+
+
+
+    /*! The same compare policy as AreEqual, but two vertices match
+     *  when their classes are in the same group. It plugs into
+     *  union_find_st and disjoint_set_cluster in place of AreEqual.
+     */
+    template<class Vertex,class Property,class LUT=class_lut<> >
+    struct SameGroup
+    {
+        const Property& p_;
+        const LUT& lut_;
+        SameGroup(const Property& p, const LUT& lut) : p_(p), lut_(lut) {}
+        SameGroup(const SameGroup& b) : p_(b.p_), lut_(b.lut_) {}
+        bool operator()(const Vertex& a, const Vertex& b) const {
+            return lut_(get(p_,a))==lut_(get(p_,b));
+        }
+        template<class V>
+        bool operator()(const V& a, const V& b) const {
+            return lut_(get(p_,widen(a)))==lut_(get(p_,widen(b)));
+        }
+    private:
+        template<class V>
+        static Vertex widen(const V& v) {
+            Vertex k;
+            std::copy(v.begin(),v.end(),k.begin());
+            return k;
+        }
+    };
+}
+
+#endif // _CLASS_LUT_HPP_
@@ -3,17 +3,23 @@
  */
 
 #include <set>
+#include <cstring>
 #include <map>
 #include <algorithm>
 #include <iostream>
 #include <vector>
+#include <stdexcept>
+#include <type_traits>
 #include <iterator>
 #include <memory>
+#include <memory_resource>
 #include <boost/functional.hpp>
 #include <boost/pending/disjoint_sets.hpp>
 
 #include "raster.hpp"
 #include "cluster.hpp"
+#include "raster_view.hpp"
+#include "vertex_index.hpp"
 
 
 using namespace std;
@@ -83,15 +89,17 @@ public:
      *  This version uses std::pair(i,j) for each point in the raster.
      *  It assumes the input is a multiarray.
      */
-cluster_loc_t find_clusters_pair(const landscape_t& raster)
+template<class RASTER>
+cluster_loc_t find_clusters_pair_impl(const RASTER& raster,
+		std::pmr::memory_resource* scratch)
 {
 	typedef pair<size_t,size_t> loc_t;
-	typedef map<loc_t,size_t>   rank_t;
-	typedef map<loc_t,loc_t>    parent_t;
+	typedef pmr::map<loc_t,size_t>   rank_t;
+	typedef pmr::map<loc_t,loc_t>    parent_t;
 
-	rank_t rank_map;
+	rank_t rank_map(scratch);
 	boost::associative_property_map<rank_t>   rank_pmap(rank_map);
-	parent_t parent_map;
+	parent_t parent_map(scratch);
 	boost::associative_property_map<parent_t> parent_pmap(parent_map);
 
 	boost::disjoint_sets<boost::associative_property_map<rank_t>,boost::associative_property_map<parent_t> >
@@ -140,44 +148,46 @@ cluster_loc_t find_clusters_pair(const landscape_t& raster)
 
 
 
-    /*! Find clusters, using size_t to identify each location.
+    /*! Find clusters, using an INDEX to identify each location.
      *  
      */
-cluster_t find_clusters(const landscape_t& raster)
+template<class INDEX, class RASTER>
+cluster_t find_clusters_impl(const RASTER& raster,
+		std::pmr::memory_resource* scratch)
 {
     //! Maps from element to count of elements in set.
-	typedef map<size_t,size_t>   rank_t;
+	typedef pmr::map<INDEX,INDEX>   rank_t;
     //! Maps from element to parent of element.
-	typedef map<size_t,size_t>   parent_t;
+	typedef pmr::map<INDEX,INDEX>   parent_t;
 
-	rank_t rank_map;
+	rank_t rank_map(scratch);
 	boost::associative_property_map<rank_t>   rank_pmap(rank_map);
-	parent_t parent_map;
+	parent_t parent_map(scratch);
 	boost::associative_property_map<parent_t> parent_pmap(parent_map);
 
 	boost::disjoint_sets<boost::associative_property_map<rank_t>,
                          boost::associative_property_map<parent_t> >
 	 	dset(rank_pmap,parent_pmap);
 
-	size_t icnt=raster.size1();
-	size_t jcnt=raster.size2();
+	INDEX icnt=raster.size1();
+	INDEX jcnt=raster.size2();
 
 	// Every node gets to be its own set.
-	for (size_t make_set=0; make_set<icnt*jcnt; make_set++) {
+	for (INDEX make_set=0; make_set<icnt*jcnt; make_set++) {
 		dset.make_set(make_set);
 	}
 
 	// Then we connect neighbors with same values.
-	for (size_t i=0; i<icnt-1; i++) {
-		for (size_t j=0; j<jcnt; j++) {
+	for (INDEX i=0; i<icnt-1; i++) {
+		for (INDEX j=0; j<jcnt; j++) {
 			if (raster(i,j)==raster(i+1,j)) {
 				dset.union_set(i*jcnt+j,(i+1)*jcnt+j);
 			}
 		}
 	}
 
-	for (size_t i=0; i<icnt; i++) {
-		for (size_t j=0; j<jcnt-1; j++) {
+	for (INDEX i=0; i<icnt; i++) {
+		for (INDEX j=0; j<jcnt-1; j++) {
 			if (raster(i,j)==raster(i,j+1)) {
 				dset.union_set(i*jcnt+j,i*jcnt+j+1);
 			}
@@ -189,12 +199,12 @@ cluster_t find_clusters(const landscape_t& raster)
 	// The temporary map will associate a parent with the list of its children.
 	cluster_t clusters; // a list of lists
 
-	typedef map<size_t,cluster_t::iterator> ptl_t;
-	ptl_t parent_to_list; // The map from parent to list of children.
+	typedef pmr::map<INDEX,cluster_t::iterator> ptl_t;
+	ptl_t parent_to_list(scratch); // The map from parent to list of children.
 
-	for (size_t pull=0; pull<icnt*jcnt; pull++) {
-		size_t parent = dset.find_set(pull);
-		ptl_t::iterator plist = parent_to_list.find(parent);
+	for (INDEX pull=0; pull<icnt*jcnt; pull++) {
+		INDEX parent = dset.find_set(pull);
+		typename ptl_t::iterator plist = parent_to_list.find(parent);
 		if (plist==parent_to_list.end()) {
 			cluster_t::iterator nlist = clusters.insert(clusters.end(),list<size_t>());
 			parent_to_list[parent]=nlist;
@@ -215,27 +225,29 @@ cluster_t find_clusters(const landscape_t& raster)
 
 
 
-/*! Find clusters, using size_t to identify each location.
+/*! Find clusters, using an INDEX to identify each location.
  *  Uses two passes in total.
  */
-cluster_t find_clusters_twopass(const landscape_t& raster)
+template<class INDEX, class RASTER>
+cluster_t find_clusters_twopass_impl(const RASTER& raster,
+		std::pmr::memory_resource* scratch)
 {
-	typedef map<size_t,size_t>   rank_t; //! Maps from element to count of elements in set.
-	typedef map<size_t,size_t>   parent_t; //! Maps from element to parent of element.
+	typedef pmr::map<INDEX,INDEX>   rank_t; //! Maps from element to count of elements in set.
+	typedef pmr::map<INDEX,INDEX>   parent_t; //! Maps from element to parent of element.
 
-	rank_t rank_map;
+	rank_t rank_map(scratch);
 	boost::associative_property_map<rank_t>   rank_pmap(rank_map);
-	parent_t parent_map;
+	parent_t parent_map(scratch);
 	boost::associative_property_map<parent_t> parent_pmap(parent_map);
 
 	boost::disjoint_sets<boost::associative_property_map<rank_t>,boost::associative_property_map<parent_t> >
 	 	dset(rank_pmap,parent_pmap);
 
-	const size_t icnt=raster.size1();
-	const size_t jcnt=raster.size2();
+	const INDEX icnt=raster.size1();
+	const INDEX jcnt=raster.size2();
 
-	for (size_t i=0; i<icnt; i++) {
-		for (size_t j=0; j<jcnt; j++) {
+	for (INDEX i=0; i<icnt; i++) {
+		for (INDEX j=0; j<jcnt; j++) {
 			if (i==0 || j==0) {
 				dset.make_set(i*jcnt+j);
 			}
@@ -261,12 +273,12 @@ cluster_t find_clusters_twopass(const landscape_t& raster)
 	// The temporary map will associate a parent with the list of its children.
 	cluster_t clusters; // a list of lists
 
-	typedef map<size_t,cluster_t::iterator> ptl_t;
-	ptl_t parent_to_list; // The map from parent to list of children.
+	typedef pmr::map<INDEX,cluster_t::iterator> ptl_t;
+	ptl_t parent_to_list(scratch); // The map from parent to list of children.
 
-	for (size_t pull=0; pull<icnt*jcnt; pull++) {
-		size_t parent = dset.find_set(pull);
-		ptl_t::iterator plist = parent_to_list.find(parent);
+	for (INDEX pull=0; pull<icnt*jcnt; pull++) {
+		INDEX parent = dset.find_set(pull);
+		typename ptl_t::iterator plist = parent_to_list.find(parent);
 		if (plist==parent_to_list.end()) {
 			cluster_t::iterator nlist = clusters.insert(clusters.end(),list<size_t>());
 			parent_to_list[parent]=nlist;
@@ -284,24 +296,26 @@ cluster_t find_clusters_twopass(const landscape_t& raster)
 
 /*! The same as find_clusters_twopass, but returning a pointer.
  */
-std::shared_ptr<cluster_t> find_clusters_pointer(const landscape_t& raster)
+template<class INDEX, class RASTER>
+std::shared_ptr<cluster_t> find_clusters_pointer_impl(const RASTER& raster,
+		std::pmr::memory_resource* scratch)
 {
-	typedef std::map<size_t,size_t>   rank_t; //! Maps from element to count of elements in set.
-	typedef std::map<size_t,size_t>   parent_t; //! Maps from element to parent of element.
+	typedef std::pmr::map<INDEX,INDEX>   rank_t; //! Maps from element to count of elements in set.
+	typedef std::pmr::map<INDEX,INDEX>   parent_t; //! Maps from element to parent of element.
 
-	rank_t rank_map;
+	rank_t rank_map(scratch);
 	boost::associative_property_map<rank_t>   rank_pmap(rank_map);
-	parent_t parent_map;
+	parent_t parent_map(scratch);
 	boost::associative_property_map<parent_t> parent_pmap(parent_map);
 
 	boost::disjoint_sets<boost::associative_property_map<rank_t>,boost::associative_property_map<parent_t> >
 	 	dset(rank_pmap,parent_pmap);
 
-	const size_t icnt=raster.size1();
-	const size_t jcnt=raster.size2();
+	const INDEX icnt=raster.size1();
+	const INDEX jcnt=raster.size2();
 
-	for (size_t i=0; i<icnt; i++) {
-		for (size_t j=0; j<jcnt; j++) {
+	for (INDEX i=0; i<icnt; i++) {
+		for (INDEX j=0; j<jcnt; j++) {
 			if (i==0 || j==0) {
 				dset.make_set(i*jcnt+j);
 			}
@@ -322,7 +336,7 @@ std::shared_ptr<cluster_t> find_clusters_pointer(const landscape_t& raster)
 		}
 	}
 
-	return gather_clusters(parent_pmap,dset, icnt, jcnt);
+	return gather_clusters(parent_pmap,dset, icnt, jcnt, scratch);
 }
 
 
@@ -348,29 +362,31 @@ find_representative_with_full_compression(ParentPA parent, Vertex v)
 }
 
 
-/*! Find clusters, using size_t to identify each location.
+/*! Find clusters, using an INDEX to identify each location.
  *  Uses two passes in total. Compare with twopass version. This
  *  version loops through the found clusters not by (i,j) but
  *  by going straight through the associative map.
  */
-cluster_t find_clusters_remap(const landscape_t& raster)
+template<class INDEX, class RASTER>
+cluster_t find_clusters_remap_impl(const RASTER& raster,
+		std::pmr::memory_resource* scratch)
 {
-	typedef map<size_t,size_t>   rank_t; //! Maps from element to count of elements in set.
-	typedef map<size_t,size_t>   parent_t; //! Maps from element to parent of element.
+	typedef pmr::map<INDEX,INDEX>   rank_t; //! Maps from element to count of elements in set.
+	typedef pmr::map<INDEX,INDEX>   parent_t; //! Maps from element to parent of element.
 
-	rank_t rank_map;
+	rank_t rank_map(scratch);
 	boost::associative_property_map<rank_t>   rank_pmap(rank_map);
-	parent_t parent_map;
+	parent_t parent_map(scratch);
 	boost::associative_property_map<parent_t> parent_pmap(parent_map);
 
 	boost::disjoint_sets<boost::associative_property_map<rank_t>,boost::associative_property_map<parent_t> >
 	 	dset(rank_pmap,parent_pmap);
 
-	const size_t icnt=raster.size1();
-	const size_t jcnt=raster.size2();
+	const INDEX icnt=raster.size1();
+	const INDEX jcnt=raster.size2();
 
-	for (size_t i=0; i<icnt; i++) {
-		for (size_t j=0; j<jcnt; j++) {
+	for (INDEX i=0; i<icnt; i++) {
+		for (INDEX j=0; j<jcnt; j++) {
 			if (i==0 || j==0) {
 				dset.make_set(i*jcnt+j);
 			}
@@ -396,15 +412,15 @@ cluster_t find_clusters_remap(const landscape_t& raster)
 	// The temporary map will associate a parent with the list of its children.
 	cluster_t clusters; // a list of lists
 
-	typedef map<size_t,cluster_t::iterator> ptl_t;
-	ptl_t parent_to_list; // The map from parent to list of children.
+	typedef pmr::map<INDEX,cluster_t::iterator> ptl_t;
+	ptl_t parent_to_list(scratch); // The map from parent to list of children.
 
 	for (auto read=parent_map.begin(); read!=parent_map.end(); read++) {
-		size_t parent = read->second;
+		INDEX parent = read->second;
 		if (parent!=read->first) {
 			parent = find_representative_with_full_compression(parent_pmap,read->first);
 		}
-		ptl_t::iterator plist = parent_to_list.find(parent);
+		typename ptl_t::iterator plist = parent_to_list.find(parent);
 		if (plist==parent_to_list.end()) {
 			cluster_t::iterator nlist = clusters.insert(clusters.end(),list<size_t>());
 			parent_to_list[parent]=nlist;
@@ -418,6 +434,678 @@ cluster_t find_clusters_remap(const landscape_t& raster)
 }
 
 
+/*! Find clusters on a torus, where row 0 neighbors the last row and
+ *  column 0 neighbors the last column. Each element keeps its
+ *  displacement to its parent as if the raster were tiled without
+ *  end. Joining two elements that are already in one set, with
+ *  displacements that disagree, means the cluster wraps around.
+ *  That is recorded for the set, so wrapping probability needs no
+ *  second pass.
+ */
+template<class INDEX, class RASTER>
+wrapped_clusters find_clusters_periodic_impl(const RASTER& raster,
+		std::pmr::memory_resource* scratch)
+{
+	typedef typename std::make_signed<INDEX>::type step_t;
+	typedef boost::array<step_t,2> offset_t;
+
+	const INDEX icnt=raster.size1();
+	const INDEX jcnt=raster.size2();
+	const INDEX pixel_cnt=icnt*jcnt;
+
+	pmr::vector<INDEX>         parent(pixel_cnt,0,scratch);
+	pmr::vector<unsigned char> rank(pixel_cnt,0,scratch);
+	pmr::vector<offset_t>      offset(pixel_cnt,offset_t(),scratch);
+	//! Bit 1 for wrapping in i, bit 2 for wrapping in j. Kept at roots.
+	pmr::vector<unsigned char> wraps(pixel_cnt,0,scratch);
+	for (INDEX make_set=0; make_set<pixel_cnt; make_set++) {
+		parent[make_set]=make_set;
+	}
+
+	// Returns the root and sets to_root to its displacement from x.
+	auto find=[&](INDEX x, offset_t& to_root) -> INDEX {
+		INDEX root=x;
+		to_root[0]=to_root[1]=0;
+		while (parent[root]!=root) {
+			to_root[0]+=offset[root][0];
+			to_root[1]+=offset[root][1];
+			root=parent[root];
+		}
+		offset_t remaining=to_root;
+		while (parent[x]!=x) {
+			INDEX next=parent[x];
+			offset_t step=offset[x];
+			parent[x]=root;
+			offset[x]=remaining;
+			remaining[0]-=step[0];
+			remaining[1]-=step[1];
+			x=next;
+		}
+		return root;
+	};
+
+	// b sits at a+(di,dj) on the unrolled plane.
+	auto join=[&](INDEX a, INDEX b, step_t di, step_t dj) {
+		offset_t a_root, b_root;
+		INDEX ra=find(a,a_root);
+		INDEX rb=find(b,b_root);
+		// The displacement from rb to ra.
+		step_t si=a_root[0]-di-b_root[0];
+		step_t sj=a_root[1]-dj-b_root[1];
+		if (ra==rb) {
+			if (si!=0) wraps[ra]|=1;
+			if (sj!=0) wraps[ra]|=2;
+		} else if (rank[ra]<rank[rb]) {
+			parent[ra]=rb;
+			offset[ra][0]=-si;
+			offset[ra][1]=-sj;
+			wraps[rb]|=wraps[ra];
+		} else {
+			parent[rb]=ra;
+			offset[rb][0]=si;
+			offset[rb][1]=sj;
+			wraps[ra]|=wraps[rb];
+			if (rank[ra]==rank[rb]) {
+				rank[ra]++;
+			}
+		}
+	};
+
+	for (INDEX i=0; i<icnt; i++) {
+		const INDEX down=(i+1==icnt) ? 0 : i+1;
+		for (INDEX j=0; j<jcnt; j++) {
+			const INDEX right=(j+1==jcnt) ? 0 : j+1;
+			if (raster(i,j)==raster(i,right)) {
+				join(i*jcnt+j,i*jcnt+right,0,1);
+			}
+			if (raster(i,j)==raster(down,j)) {
+				join(i*jcnt+j,down*jcnt+j,1,0);
+			}
+		}
+	}
+
+	wrapped_clusters result;
+	typedef pmr::map<INDEX,cluster_t::iterator> ptl_t;
+	ptl_t parent_to_list(scratch); // The map from parent to list of children.
+
+	for (INDEX pull=0; pull<pixel_cnt; pull++) {
+		offset_t to_root;
+		INDEX root=find(pull,to_root);
+		typename ptl_t::iterator plist = parent_to_list.find(root);
+		if (plist==parent_to_list.end()) {
+			cluster_t::iterator nlist = result.clusters.insert(
+				result.clusters.end(),list<size_t>());
+			parent_to_list[root]=nlist;
+			nlist->push_back(pull);
+			boost::array<bool,2> wrapped={{ (wraps[root]&1)!=0,
+			                                (wraps[root]&2)!=0 }};
+			result.wraps.push_back(wrapped);
+		} else {
+			plist->second->push_back(pull);
+		}
+	}
+	return result;
+}
+
+
+
+/*! Find clusters, leaving out every pixel equal to nodata.
+ *  Nodata pixels never enter the disjoint set, so water or the
+ *  area outside a survey costs nothing but the scan that skips it.
+ *  Each row is walked as runs: skip_value jumps over nodata and
+ *  memchr finds where the run of data ends.
+ */
+template<class INDEX, class RASTER>
+cluster_t find_clusters_nodata_impl(const RASTER& raster,
+		landscape_t::value_type nodata, std::pmr::memory_resource* scratch)
+{
+	typedef pmr::map<INDEX,INDEX>   rank_t;
+	typedef pmr::map<INDEX,INDEX>   parent_t;
+
+	rank_t rank_map(scratch);
+	boost::associative_property_map<rank_t>   rank_pmap(rank_map);
+	parent_t parent_map(scratch);
+	boost::associative_property_map<parent_t> parent_pmap(parent_map);
+
+	boost::disjoint_sets<boost::associative_property_map<rank_t>,
+                         boost::associative_property_map<parent_t> >
+	 	dset(rank_pmap,parent_pmap);
+
+	const landscape_view_t view=make_view(raster);
+	const INDEX icnt=view.size1();
+	const INDEX jcnt=view.size2();
+
+	for (INDEX i=0; i<icnt; i++) {
+		const unsigned char* row=view.row(i);
+		const unsigned char* above=(i>0) ? view.row(i-1) : 0;
+		const unsigned char* end=row+jcnt;
+		const unsigned char* run=skip_value(row,end,nodata);
+		while (run!=end) {
+			const unsigned char* run_end=static_cast<const unsigned char*>(
+				memchr(run,nodata,end-run));
+			if (run_end==0) {
+				run_end=end;
+			}
+			for (const unsigned char* pixel=run; pixel!=run_end; pixel++) {
+				const INDEX j=pixel-row;
+				dset.make_set(i*jcnt+j);
+				// Equal to a data pixel means the neighbor is data too.
+				if (pixel!=run && *pixel==pixel[-1]) {
+					dset.union_set(i*jcnt+j-1,i*jcnt+j);
+				}
+				if (above && *pixel==above[j]) {
+					dset.union_set((i-1)*jcnt+j,i*jcnt+j);
+				}
+			}
+			run=skip_value(run_end,end,nodata);
+		}
+	}
+
+	// Only data pixels have entries, so gather from the parent map.
+	cluster_t clusters;
+	typedef pmr::map<INDEX,cluster_t::iterator> ptl_t;
+	ptl_t parent_to_list(scratch);
+
+	for (typename parent_t::const_iterator pull=parent_map.begin();
+			pull!=parent_map.end(); pull++) {
+		INDEX parent = dset.find_set(pull->first);
+		typename ptl_t::iterator plist = parent_to_list.find(parent);
+		if (plist==parent_to_list.end()) {
+			cluster_t::iterator nlist = clusters.insert(clusters.end(),list<size_t>());
+			parent_to_list[parent]=nlist;
+			nlist->push_back(pull->first);
+		} else {
+			plist->second->push_back(pull->first);
+		}
+	}
+	return clusters;
+}
+
+
+
+/*! Find clusters of pixels whose classes fall in the same group.
+ *  Each row is remapped through the table into a buffer as it is
+ *  reached, and compared with the remapped row above it, so the
+ *  raster itself is never copied or rewritten.
+ */
+template<class INDEX, class RASTER>
+cluster_t find_clusters_grouped_impl(const RASTER& raster,
+		const class_lut<arr_type>& groups, std::pmr::memory_resource* scratch)
+{
+	typedef pmr::map<INDEX,INDEX>   rank_t;
+	typedef pmr::map<INDEX,INDEX>   parent_t;
+
+	rank_t rank_map(scratch);
+	boost::associative_property_map<rank_t>   rank_pmap(rank_map);
+	parent_t parent_map(scratch);
+	boost::associative_property_map<parent_t> parent_pmap(parent_map);
+
+	boost::disjoint_sets<boost::associative_property_map<rank_t>,
+                         boost::associative_property_map<parent_t> >
+	 	dset(rank_pmap,parent_pmap);
+
+	const landscape_view_t view=make_view(raster);
+	const INDEX icnt=view.size1();
+	const INDEX jcnt=view.size2();
+
+	pmr::vector<arr_type> above(jcnt,0,scratch);
+	pmr::vector<arr_type> row(jcnt,0,scratch);
+	for (INDEX i=0; i<icnt; i++) {
+		groups.remap(view.row(i),jcnt,row.data());
+		for (INDEX j=0; j<jcnt; j++) {
+			dset.make_set(i*jcnt+j);
+			if (j>0 && row[j]==row[j-1]) {
+				dset.union_set(i*jcnt+j-1,i*jcnt+j);
+			}
+			if (i>0 && row[j]==above[j]) {
+				dset.union_set((i-1)*jcnt+j,i*jcnt+j);
+			}
+		}
+		row.swap(above);
+	}
+
+	cluster_t clusters;
+	typedef pmr::map<INDEX,cluster_t::iterator> ptl_t;
+	ptl_t parent_to_list(scratch);
+
+	for (INDEX pull=0; pull<icnt*jcnt; pull++) {
+		INDEX parent = dset.find_set(pull);
+		typename ptl_t::iterator plist = parent_to_list.find(parent);
+		if (plist==parent_to_list.end()) {
+			cluster_t::iterator nlist = clusters.insert(clusters.end(),list<size_t>());
+			parent_to_list[parent]=nlist;
+			nlist->push_back(pull);
+		} else {
+			plist->second->push_back(pull);
+		}
+	}
+	return clusters;
+}
+
+
+
+/*! Find clusters from union masks. For each row i, masks(i,across,down)
+ *  sets across[j] when pixel j joins pixel j+1, and down[j] when pixel
+ *  (i-1,j) joins (i,j). The unions follow the masks, so how pixels are
+ *  compared is all in the masks.
+ */
+template<class INDEX, class MASKS>
+cluster_t find_clusters_masked_impl(INDEX icnt, INDEX jcnt, MASKS masks,
+		std::pmr::memory_resource* scratch)
+{
+	typedef pmr::map<INDEX,INDEX>   rank_t;
+	typedef pmr::map<INDEX,INDEX>   parent_t;
+
+	rank_t rank_map(scratch);
+	boost::associative_property_map<rank_t>   rank_pmap(rank_map);
+	parent_t parent_map(scratch);
+	boost::associative_property_map<parent_t> parent_pmap(parent_map);
+
+	boost::disjoint_sets<boost::associative_property_map<rank_t>,
+                         boost::associative_property_map<parent_t> >
+	 	dset(rank_pmap,parent_pmap);
+
+	pmr::vector<unsigned char> across(jcnt,0,scratch);
+	pmr::vector<unsigned char> down(jcnt,0,scratch);
+	for (INDEX i=0; i<icnt; i++) {
+		masks(i,across.data(),down.data());
+		for (INDEX j=0; j<jcnt; j++) {
+			dset.make_set(i*jcnt+j);
+			if (j>0 && across[j-1]) {
+				dset.union_set(i*jcnt+j-1,i*jcnt+j);
+			}
+			if (i>0 && down[j]) {
+				dset.union_set((i-1)*jcnt+j,i*jcnt+j);
+			}
+		}
+	}
+
+	cluster_t clusters;
+	typedef pmr::map<INDEX,cluster_t::iterator> ptl_t;
+	ptl_t parent_to_list(scratch);
+
+	for (INDEX pull=0; pull<icnt*jcnt; pull++) {
+		INDEX parent = dset.find_set(pull);
+		typename ptl_t::iterator plist = parent_to_list.find(parent);
+		if (plist==parent_to_list.end()) {
+			cluster_t::iterator nlist = clusters.insert(clusters.end(),list<size_t>());
+			parent_to_list[parent]=nlist;
+			nlist->push_back(pull);
+		} else {
+			plist->second->push_back(pull);
+		}
+	}
+	return clusters;
+}
+
+
+
+/*! Find clusters where the kernel says neighbors are close enough,
+ *  for any pixel type T. For each row the kernel fills one mask
+ *  against the row above and one against the row shifted by a pixel.
+ */
+template<class INDEX, class T, class KERNEL>
+cluster_t find_clusters_similar_impl(const raster_view<T>& view,
+		const KERNEL& kernel, std::pmr::memory_resource* scratch)
+{
+	const INDEX jcnt=view.size2();
+	return find_clusters_masked_impl<INDEX>(INDEX(view.size1()),jcnt,
+		[&](INDEX i, unsigned char* across, unsigned char* down) {
+			const T* row=view.row(i);
+			if (jcnt>1) {
+				kernel(row,row+1,jcnt-1,across);
+			}
+			if (i>0) {
+				kernel(view.row(i-1),row,jcnt,down);
+			}
+		},scratch);
+}
+
+
+
+/*! Sets mask[k]=0 where a[k]!=b[k], leaving the rest. The loop is
+ *  plain compares, which the compiler vectorises.
+ */
+template<class T>
+inline void and_equal(const T* a, const T* b,
+		size_t n, unsigned char* mask)
+{
+	for (size_t k=0; k<n; k++) {
+		mask[k]&=(a[k]==b[k]);
+	}
+}
+
+
+
+/*! Pixels are equal when every band matches. The masks start from the
+ *  first band and are narrowed band by band. Once a mask is all zero
+ *  the remaining bands are not read for it.
+ */
+template<class INDEX, class T>
+cluster_t find_clusters_bands_impl(const std::vector<raster_view<T> >& bands,
+		std::pmr::memory_resource* scratch)
+{
+	const INDEX jcnt=bands[0].size2();
+	return find_clusters_masked_impl<INDEX>(INDEX(bands[0].size1()),jcnt,
+		[&](INDEX i, unsigned char* across, unsigned char* down) {
+			const INDEX across_cnt=(jcnt>0) ? jcnt-1 : 0;
+			std::fill(across,across+across_cnt,1);
+			std::fill(down,down+jcnt,(i>0) ? 1 : 0);
+			bool across_open=across_cnt>0, down_open=i>0;
+			for (size_t b=0; b<bands.size() && (across_open || down_open); b++) {
+				const T* row=bands[b].row(i);
+				if (across_open) {
+					and_equal(row,row+1,across_cnt,across);
+					across_open=skip_value(across,across+across_cnt,0)!=across+across_cnt;
+				}
+				if (down_open) {
+					and_equal(bands[b].row(i-1),row,jcnt,down);
+					down_open=skip_value(down,down+jcnt,0)!=down+jcnt;
+				}
+			}
+		},scratch);
+}
+
+
+
+/* Each engine is written once, above, for any raster that answers
+ * size1(), size2() and (i,j). These give it each raster type.
+ * Rasters under four billion pixels are numbered with uint32_t, which
+ * halves the disjoint-set maps. The pair engine keys on (i,j) instead.
+ * The disjoint-set maps and the parent-to-list map come from scratch,
+ * so a scratch_arena frees them all at once. The clusters returned
+ * use the ordinary heap because the caller keeps them.
+ */
+cluster_loc_t find_clusters_pair(const landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return find_clusters_pair_impl(raster,scratch);
+}
+
+cluster_loc_t find_clusters_pair(const landscape_view_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return find_clusters_pair_impl(raster,scratch);
+}
+
+cluster_t find_clusters(const landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+cluster_t find_clusters(const landscape_view_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+cluster_t find_clusters_twopass(const landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_twopass_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+cluster_t find_clusters_twopass(const landscape_view_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_twopass_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+cluster_t find_clusters(const class16_landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+cluster_t find_clusters(const class16_view_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+cluster_t find_clusters_twopass(const class16_landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_twopass_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+cluster_t find_clusters_twopass(const class16_view_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_twopass_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+std::shared_ptr<cluster_t> find_clusters_pointer(const landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_pointer_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+std::shared_ptr<cluster_t> find_clusters_pointer(const landscape_view_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_pointer_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+cluster_t find_clusters_remap(const landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_remap_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+cluster_t find_clusters_remap(const landscape_view_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_remap_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+
+wrapped_clusters find_clusters_periodic(const landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_periodic_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+wrapped_clusters find_clusters_periodic(const landscape_view_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_periodic_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+
+cluster_t find_clusters(const replicated_landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+cluster_t find_clusters_twopass(const replicated_landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_twopass_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+std::shared_ptr<cluster_t> find_clusters_pointer(const replicated_landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_pointer_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+cluster_t find_clusters_remap(const replicated_landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_remap_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+wrapped_clusters find_clusters_periodic(const replicated_landscape_t& raster,
+		std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_periodic_impl<decltype(index)>(raster,scratch);
+	});
+}
+
+
+cluster_t find_clusters_nodata(const landscape_t& raster,
+		landscape_t::value_type nodata, std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_nodata_impl<decltype(index)>(raster,nodata,scratch);
+	});
+}
+
+cluster_t find_clusters_nodata(const landscape_view_t& raster,
+		landscape_t::value_type nodata, std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_nodata_impl<decltype(index)>(raster,nodata,scratch);
+	});
+}
+
+
+cluster_t find_clusters_grouped(const landscape_t& raster,
+		const class_lut<arr_type>& groups, std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_grouped_impl<decltype(index)>(raster,groups,scratch);
+	});
+}
+
+cluster_t find_clusters_grouped(const landscape_view_t& raster,
+		const class_lut<arr_type>& groups, std::pmr::memory_resource* scratch)
+{
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_grouped_impl<decltype(index)>(raster,groups,scratch);
+	});
+}
+
+
+cluster_t find_clusters_tolerance(const float_view_t& raster,
+		float tolerance, std::pmr::memory_resource* scratch)
+{
+	const tolerance_kernel<float> kernel(tolerance);
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_similar_impl<decltype(index)>(raster,kernel,scratch);
+	});
+}
+
+cluster_t find_clusters_tolerance(const float_landscape_t& raster,
+		float tolerance, std::pmr::memory_resource* scratch)
+{
+	return find_clusters_tolerance(make_view(raster),tolerance,scratch);
+}
+
+cluster_t find_clusters_binned(const float_view_t& raster,
+		const std::vector<float>& edges, std::pmr::memory_resource* scratch)
+{
+	const bin_kernel<float> kernel(edges);
+	return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+		return find_clusters_similar_impl<decltype(index)>(raster,kernel,scratch);
+	});
+}
+
+cluster_t find_clusters_binned(const float_landscape_t& raster,
+		const std::vector<float>& edges, std::pmr::memory_resource* scratch)
+{
+	return find_clusters_binned(make_view(raster),edges,scratch);
+}
+
+
+/*! Checks the bands line up, then clusters them with the index
+ *  that fits.
+ */
+template<class T>
+cluster_t find_clusters_bands_checked(const std::vector<raster_view<T> >& bands,
+		std::pmr::memory_resource* scratch)
+{
+	if (bands.empty()) {
+		throw std::runtime_error("Need at least one band to cluster.");
+	}
+	for (size_t b=1; b<bands.size(); b++) {
+		if (bands[b].size1()!=bands[0].size1() ||
+				bands[b].size2()!=bands[0].size2()) {
+			throw std::runtime_error("Bands must all be the same size.");
+		}
+	}
+	return dispatch_index(bands[0].size1(),bands[0].size2(),[&](auto index) {
+		return find_clusters_bands_impl<decltype(index)>(bands,scratch);
+	});
+}
+
+template<class T>
+cluster_t find_clusters_bands_matrix(
+		const std::vector<boost::numeric::ublas::matrix<T> >& bands,
+		std::pmr::memory_resource* scratch)
+{
+	std::vector<raster_view<T> > views;
+	for (size_t b=0; b<bands.size(); b++) {
+		views.push_back(make_view(bands[b]));
+	}
+	return find_clusters_bands_checked(views,scratch);
+}
+
+cluster_t find_clusters_bands(const std::vector<landscape_view_t>& bands,
+		std::pmr::memory_resource* scratch)
+{
+	return find_clusters_bands_checked(bands,scratch);
+}
+
+cluster_t find_clusters_bands(const std::vector<landscape_t>& bands,
+		std::pmr::memory_resource* scratch)
+{
+	return find_clusters_bands_matrix(bands,scratch);
+}
+
+cluster_t find_clusters_bands(const std::vector<class16_view_t>& bands,
+		std::pmr::memory_resource* scratch)
+{
+	return find_clusters_bands_checked(bands,scratch);
+}
+
+cluster_t find_clusters_bands(const std::vector<class16_landscape_t>& bands,
+		std::pmr::memory_resource* scratch)
+{
+	return find_clusters_bands_matrix(bands,scratch);
+}
+
+
 /*
 find_clusters()
 {
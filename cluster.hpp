@@ -5,18 +5,121 @@
 #include <list>
 #include <set>
 #include <memory>
+#include <memory_resource>
+#include <vector>
+#include <boost/array.hpp>
 #include "raster.hpp"
+#include "raster_view.hpp"
+#include "replicated_view.hpp"
 #include "gather_clusters.hpp"
+#include "class_lut.hpp"
+#include "tolerance.hpp"
 
 namespace raster_stats {
 
 typedef unsigned char arr_type;
+
+//! Clusters on a torus, and whether each one wraps around in i and in j.
+struct wrapped_clusters {
+    cluster_t clusters;
+    //! One entry per cluster, in the same order.
+    std::vector<boost::array<bool,2> > wraps;
+};
+
 std::set<arr_type> unique_values_direct(const landscape_t& raster);
-cluster_t find_clusters(const landscape_t& raster);
-cluster_t find_clusters_twopass(const landscape_t& raster);
-std::shared_ptr<cluster_t> find_clusters_pointer(const landscape_t& raster);
-cluster_loc_t find_clusters_pair(const landscape_t& raster);
-cluster_t find_clusters_remap(const landscape_t& raster);
+
+// Each engine takes a memory resource for its scratch maps,
+// such as scratch_arena::resource().
+cluster_t find_clusters(const landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_twopass(const landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+std::shared_ptr<cluster_t> find_clusters_pointer(const landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_loc_t find_clusters_pair(const landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_remap(const landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+// Periodic boundaries: the first and last rows and columns are neighbors.
+wrapped_clusters find_clusters_periodic(const landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+// Pixels equal to nodata belong to no cluster, as read by tiff_nodata.
+cluster_t find_clusters_nodata(const landscape_t& raster,
+    landscape_t::value_type nodata,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+// Neighbors join when their classes are in the same group of the table.
+cluster_t find_clusters_grouped(const landscape_t& raster,
+    const class_lut<arr_type>& groups,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+
+// The same engines, reading pixels in place through a view.
+cluster_t find_clusters(const landscape_view_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_twopass(const landscape_view_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+std::shared_ptr<cluster_t> find_clusters_pointer(const landscape_view_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_loc_t find_clusters_pair(const landscape_view_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_remap(const landscape_view_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+wrapped_clusters find_clusters_periodic(const landscape_view_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_nodata(const landscape_view_t& raster,
+    landscape_t::value_type nodata,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_grouped(const landscape_view_t& raster,
+    const class_lut<arr_type>& groups,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+
+// The engines that read pixel by pixel, on a small raster repeated,
+// as from make_replicated, so nothing the full size is allocated.
+cluster_t find_clusters(const replicated_landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_twopass(const replicated_landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+std::shared_ptr<cluster_t> find_clusters_pointer(const replicated_landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_remap(const replicated_landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+wrapped_clusters find_clusters_periodic(const replicated_landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+
+// Class maps of 16-bit pixels, such as from read_tiff_bands<uint16_t>.
+cluster_t find_clusters(const class16_landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters(const class16_view_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_twopass(const class16_landscape_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_twopass(const class16_view_t& raster,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+
+// Continuous rasters. Neighbors join when their values differ by less
+// than tolerance, or fall between the same two bin edges.
+cluster_t find_clusters_tolerance(const float_landscape_t& raster,
+    float tolerance,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_tolerance(const float_view_t& raster,
+    float tolerance,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_binned(const float_landscape_t& raster,
+    const std::vector<float>& edges,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_binned(const float_view_t& raster,
+    const std::vector<float>& edges,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+
+// Aligned bands, such as land use, soil and slope class. Neighbors join
+// when every band matches, with no combined key raster built.
+cluster_t find_clusters_bands(const std::vector<landscape_t>& bands,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_bands(const std::vector<landscape_view_t>& bands,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_bands(const std::vector<class16_landscape_t>& bands,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
+cluster_t find_clusters_bands(const std::vector<class16_view_t>& bands,
+    std::pmr::memory_resource* scratch=std::pmr::get_default_resource());
 
 
 
@@ -0,0 +1,207 @@
+/*! cluster_cache.cpp
+ *  Writes and maps cluster results keyed by raster hash.
+ */
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+#include "cluster_cache.hpp"
+#include "cluster.hpp"
+#include "gather_clusters.hpp"
+#include "raster_hash.hpp"
+
+using namespace std;
+
+namespace raster_stats {
+
+
+namespace {
+    const char cache_magic[8] = { 'R','S','C','L','U','S','T','1' };
+}
+
+
+
+cached_clusters::cached_clusters(const std::string& filename)
+    : map_(std::make_shared<mapped_raster>(filename.c_str())), header_(0)
+{
+    const size_t file_size = map_->size();
+    if (file_size < sizeof(cluster_cache_header) ||
+            0 != std::memcmp(map_->data(), cache_magic, sizeof(cache_magic))) {
+        throw std::runtime_error("Not a cluster cache: "+filename);
+    }
+    header_ = reinterpret_cast<const cluster_cache_header*>(map_->data());
+    const cluster_cache_header& h = *header_;
+    // Each array must lie inside the file.
+    bool fits =
+        h.labels_offset >= sizeof(cluster_cache_header) &&
+        map_->contains(h.labels_offset, h.size1*h.size2, 4) &&
+        map_->contains(h.sizes_offset, h.cluster_cnt, 8) &&
+        map_->contains(h.offsets_offset, h.cluster_cnt+1, 8) &&
+        map_->contains(h.members_offset, 0, 8);
+    if (fits) {
+        fits = map_->contains(h.members_offset, offsets()[h.cluster_cnt], 8);
+    }
+    if (!fits) {
+        throw std::runtime_error("Cluster cache is truncated: "+filename);
+    }
+}
+
+
+
+raster_view<uint32_t> cached_clusters::labels() const
+{
+    return raster_view<uint32_t>(
+        reinterpret_cast<const uint32_t*>(map_->data()+header_->labels_offset),
+        header_->size1, header_->size2, header_->size2);
+}
+
+
+
+const uint64_t* cached_clusters::sizes() const
+{
+    return reinterpret_cast<const uint64_t*>(map_->data()+header_->sizes_offset);
+}
+
+
+
+const uint64_t* cached_clusters::offsets() const
+{
+    return reinterpret_cast<const uint64_t*>(map_->data()+header_->offsets_offset);
+}
+
+
+
+const uint64_t* cached_clusters::members() const
+{
+    return reinterpret_cast<const uint64_t*>(map_->data()+header_->members_offset);
+}
+
+
+
+cluster_t cached_clusters::clusters() const
+{
+    cluster_t result;
+    const uint64_t* offset = offsets();
+    const uint64_t* member = members();
+    for (size_t k=0; k<cluster_cnt(); k++) {
+        result.emplace_back(member+offset[k], member+offset[k+1]);
+    }
+    return result;
+}
+
+
+
+void write_cluster_cache(const std::string& filename, uint64_t raster_hash,
+                         size_t size1, size_t size2,
+                         const std::string& engine, const cluster_t& clusters,
+                         size_t connectivity)
+{
+    cluster_cache_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.raster_hash = raster_hash;
+    header.size1 = size1;
+    header.size2 = size2;
+    header.connectivity = connectivity;
+    std::strncpy(header.engine, engine.c_str(), sizeof(header.engine)-1);
+    header.cluster_cnt = clusters.size();
+
+    std::vector<uint64_t> sizes, offsets(1, 0), members;
+    sizes.reserve(clusters.size());
+    offsets.reserve(clusters.size()+1);
+    for (const auto& cluster : clusters) {
+        sizes.push_back(cluster.size());
+        members.insert(members.end(), cluster.begin(), cluster.end());
+        offsets.push_back(members.size());
+    }
+    header.labels_offset = sizeof(header);
+    header.sizes_offset = align8(header.labels_offset+4*size1*size2);
+    header.offsets_offset = header.sizes_offset+8*sizes.size();
+    header.members_offset = header.offsets_offset+8*offsets.size();
+
+    label_landscape_t labels = cluster_labels(clusters, size1, size2);
+
+    mapped_file_writer out(filename, "cluster cache");
+    out.write_padded(&header, 1);
+    out.write_padded(labels.data().begin(), labels.data().size());
+    out.write_padded(sizes.data(), sizes.size());
+    out.write_padded(offsets.data(), offsets.size());
+    out.write_padded(members.data(), members.size());
+    out.commit();
+}
+
+
+
+std::string cluster_cache_name(const std::string& directory,
+                               uint64_t raster_hash, const std::string& engine)
+{
+    // The name becomes part of a path, so it may not leave directory.
+    const bool plain = !engine.empty() &&
+        engine.find("..") == std::string::npos &&
+        std::all_of(engine.begin(), engine.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) ||
+                c=='_' || c=='-' || c=='.';
+        });
+    if (!plain) {
+        throw std::runtime_error("Engine names are letters, digits, _, - and .: "+
+                                 engine);
+    }
+    std::stringstream name;
+    name << directory << "/" << std::hex << std::setw(16) << std::setfill('0')
+         << raster_hash << "_" << engine << ".clc";
+    return name.str();
+}
+
+
+
+std::shared_ptr<cached_clusters> find_clusters_cached(
+    const landscape_view_t& raster, const std::string& directory,
+    const std::string& engine_name, const cluster_engine_t& engine,
+    size_t connectivity)
+{
+    const uint64_t hash = raster_hash(raster);
+    const std::string filename = cluster_cache_name(directory, hash, engine_name);
+    if (::access(filename.c_str(), R_OK) == 0) {
+        try {
+            auto cached = std::make_shared<cached_clusters>(filename);
+            const cluster_cache_header& h = cached->header();
+            const std::string cached_engine(h.engine,
+                                            ::strnlen(h.engine, sizeof(h.engine)));
+            if (h.raster_hash == hash && h.size1 == raster.size1() &&
+                    h.size2 == raster.size2() &&
+                    h.connectivity == connectivity &&
+                    cached_engine == engine_name.substr(0, sizeof(h.engine)-1)) {
+                return cached;
+            }
+        } catch (std::runtime_error&) {
+            // A damaged file is written again.
+        }
+    }
+    write_cluster_cache(filename, hash, raster.size1(), raster.size2(),
+                        engine_name, engine(raster), connectivity);
+    return std::make_shared<cached_clusters>(filename);
+}
+
+
+
+std::shared_ptr<cached_clusters> find_clusters_cached(
+    const landscape_view_t& raster, const std::string& directory)
+{
+    return find_clusters_cached(raster, directory, "find_clusters",
+        [](const landscape_view_t& r) { return find_clusters(r); });
+}
+
+
+
+std::shared_ptr<cached_clusters> find_clusters_cached(
+    const landscape_t& raster, const std::string& directory)
+{
+    return find_clusters_cached(make_view(raster), directory);
+}
+
+
+}
@@ -0,0 +1,105 @@
+/*! cluster_cache.hpp
+ *  Clustering results saved to disk under the hash of the raster they
+ *  came from, so a parameter sweep that sees the same tile again maps
+ *  the answer instead of recomputing it. The file is laid out to be
+ *  used in place: a fixed header, then 8-byte-aligned arrays.
+ *
+ *    header
+ *    labels   uint32[size1*size2]  cluster number per pixel, from 1
+ *    sizes    uint64[cluster_cnt]  pixels in each cluster
+ *    offsets  uint64[cluster_cnt+1] cluster k is members[offsets[k]]
+ *                                   up to members[offsets[k+1]]
+ *    members  uint64[offsets[cluster_cnt]] pixel indices, i*size2+j
+ */
+#ifndef _CLUSTER_CACHE_HPP_
+#define _CLUSTER_CACHE_HPP_ 1
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <functional>
+#include "raster.hpp"
+#include "raster_view.hpp"
+#include "io_mmap.hpp"
+
+namespace raster_stats {
+
+    //! The start of a cache file. Offsets are in bytes from the start.
+    struct cluster_cache_header {
+        char     magic[8];
+        uint64_t raster_hash;
+        uint64_t size1;
+        uint64_t size2;
+        //! Neighbors per pixel that the engine joins, such as 4.
+        uint64_t connectivity;
+        //! Name of the engine, NUL-padded.
+        char     engine[32];
+        uint64_t cluster_cnt;
+        uint64_t labels_offset;
+        uint64_t sizes_offset;
+        uint64_t offsets_offset;
+        uint64_t members_offset;
+    };
+
+
+
+    /*! A cache file, mapped read-only. The arrays point into the
+     *  mapping, so they are good as long as this object lives.
+     */
+    class cached_clusters {
+        std::shared_ptr<mapped_raster> map_;
+        const cluster_cache_header*    header_;
+    public:
+        //! Maps a cache file and checks its magic and array bounds.
+        explicit cached_clusters(const std::string& filename);
+
+        const cluster_cache_header& header() const { return *header_; }
+        size_t cluster_cnt() const { return header_->cluster_cnt; }
+        raster_view<uint32_t> labels() const;
+        const uint64_t* sizes() const;
+        const uint64_t* offsets() const;
+        const uint64_t* members() const;
+        //! Copies the clusters out as lists, as the engines return them.
+        cluster_t clusters() const;
+    };
+
+
+
+    /*! Writes clusters of a size1 by size2 raster with the given hash
+     *  to filename, through a mapped_file_writer.
+     */
+    void write_cluster_cache(const std::string& filename, uint64_t raster_hash,
+                             size_t size1, size_t size2,
+                             const std::string& engine, const cluster_t& clusters,
+                             size_t connectivity=4);
+
+    /*! The file in directory for a raster's hash and an engine. Throws
+     *  if engine is anything but letters, digits, _, - and ., or if it
+     *  holds "..", so the file cannot be outside directory.
+     */
+    std::string cluster_cache_name(const std::string& directory,
+                                   uint64_t raster_hash,
+                                   const std::string& engine);
+
+    typedef std::function<cluster_t(const landscape_view_t&)> cluster_engine_t;
+
+    /*! Maps the cached clusters of raster for engine_name from directory,
+     *  or runs engine and caches its clusters first. The header must
+     *  match the raster's hash, dimensions, engine and connectivity,
+     *  or the file is written again. engine_name is what tells results
+     *  apart, so give each engine and setting of its parameters a name
+     *  of its own.
+     */
+    std::shared_ptr<cached_clusters> find_clusters_cached(
+        const landscape_view_t& raster, const std::string& directory,
+        const std::string& engine_name, const cluster_engine_t& engine,
+        size_t connectivity=4);
+
+    //! The same, with find_clusters as the engine.
+    std::shared_ptr<cached_clusters> find_clusters_cached(
+        const landscape_view_t& raster, const std::string& directory);
+    std::shared_ptr<cached_clusters> find_clusters_cached(
+        const landscape_t& raster, const std::string& directory);
+}
+
+#endif // _CLUSTER_CACHE_HPP_
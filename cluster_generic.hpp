@@ -16,6 +16,7 @@
 #include "tbb/blocked_range2d.h"
 
 #include "gather_clusters.hpp"
+#include "raster_view.hpp"
 
 
 namespace raster_stats
@@ -456,10 +457,41 @@ namespace raster_stats
             seen_.push_back(neighbor);
         }
 
+        /*! If every vertex of the region compares equal to the first,
+         *  the region becomes one set under the first vertex, with no
+         *  union inside it. Returns false, having changed nothing, if not.
+         */
+        bool add_uniform(const Region& region) {
+            auto vertex=region.begin();
+            auto vertex_end=region.end();
+            if (vertex==vertex_end) {
+                return false;
+            }
+            const auto root=*vertex;
+            for (auto check=vertex; check!=vertex_end; ++check) {
+                if (!compare_(root,*check)) {
+                    return false;
+                }
+            }
+            dset_.make_set(root);
+            if (++vertex!=vertex_end) {
+                rank_map_[root]=1;
+            }
+            for (; vertex!=vertex_end; ++vertex) {
+                parent_map_[*vertex]=root;
+                rank_map_[*vertex]=0;
+            }
+            return true;
+        }
+
 		/*! This acts on a subregion of the domain.
 		 */
 		void operator()(const Region& region) {
             std::cout << "disjoint_set_cluster::operator(): enter" << std::endl;
+            if (add_uniform(region)) {
+                join_edges(region);
+                return;
+            }
             auto vertex=region.begin();
             auto vertex_end=region.end();
 
@@ -489,22 +521,16 @@ namespace raster_stats
 	template<class Landscape>
 	class cluster_raster {
 		size_t result;
-	public:
-		cluster_raster() {}
-		void operator()(const Landscape& raster) {
-            boost::array<size_t,4> bounds =
-                {{0,raster.size1(),0,raster.size2()}};
+
+        //! Clusters pixels 0 to size1*size2, read through land_use.
+        template<class PropertyMap>
+        size_t count_clusters(const PropertyMap& land_use,
+                              size_t size1, size_t size2) {
+            boost::array<size_t,4> bounds = {{0,size1,0,size2}};
             array_basis gridlines(bounds,32);
 
-            // Create a property map out of the ublas Matrix in
-            // order to separate the basis from values defined on it.
             typedef typename Landscape::value_type value_type;
-            boost::identity_property_map direct;
-            boost::iterator_property_map<const value_type*,
-                    boost::identity_property_map,value_type,const value_type&>
-                land_use(&raster.data()[0],direct);
-            
-            typedef AreEqual<value_type,decltype(land_use)> AreEqual_t;
+            typedef AreEqual<value_type,PropertyMap> AreEqual_t;
             AreEqual_t comparison(land_use);
 			disjoint_set_cluster<array_basis,AreEqual_t>
                 dsc(comparison);
@@ -513,10 +539,28 @@ namespace raster_stats
 			tbb::parallel_reduce(gridlines,dsc);
 
             auto clusters = gather_clusters(dsc.parent_pmap_,
-                                                 dsc.dset_,raster.size1(),
-                                                 raster.size2());
-
-			result = clusters->size();
+                                                 dsc.dset_,size1,size2);
+            return clusters->size();
+        }
+	public:
+		cluster_raster() {}
+		void operator()(const Landscape& raster) {
+            // Create a property map out of the ublas Matrix, or the view,
+            // in order to separate the basis from values defined on it.
+            // Rows that follow one another are read straight through a
+            // pointer. Only a view with gaps between rows pays for
+            // turning each index back into (i,j).
+            typedef typename Landscape::value_type value_type;
+            const raster_view<value_type> view=make_view(raster);
+            if (view.contiguous() && view.size1()>0 && view.size2()>0) {
+                boost::identity_property_map direct;
+                boost::iterator_property_map<const value_type*,
+                        boost::identity_property_map,value_type,const value_type&>
+                    land_use(view.row(0),direct);
+                result = count_clusters(land_use,view.size1(),view.size2());
+            } else {
+                result = count_clusters(view,view.size1(),view.size2());
+            }
 		}
 		friend size_t count<Landscape>(cluster_raster<Landscape>&);
 	};
@@ -9,15 +9,24 @@
 #include <vector>
 #include <iterator>
 #include <memory>
+#include <stdexcept>
 #include <boost/unordered_map.hpp>
 #include <boost/array.hpp>
 #include <boost/functional.hpp>
 #include <boost/pending/disjoint_sets.hpp>
 #include "tbb/parallel_reduce.h"
 #include "tbb/blocked_range2d.h"
+#include "tbb/blocked_range3d.h"
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
 
 #include "raster.hpp"
 #include "cluster.hpp"
+#include "cluster_tbb.hpp"
+#include "vertex_index.hpp"
+#include "raster_view.hpp"
+#include "replicated_view.hpp"
+#include "gridnd.hpp"
 
 using namespace tbb;
 using namespace std;
@@ -37,19 +46,23 @@ namespace raster_stats {
 /*! Connects elements from a grid into sets.
  *  An object of this class is passed to parallel_for
  *  so that it can work on a smaller region.
+ *  RASTER is landscape_t or a view that reads the same way and has
+ *  a uniform_region overload.
+ *  INDEX numbers the pixels, uint32_t or size_t.
  */
+template<class RASTER, class INDEX>
 struct ConnectSets
 {
     //! Maps from element to count of elements in set.
-    typedef boost::unordered_map<size_t,size_t>   rank_t;
+    typedef boost::unordered_map<INDEX,INDEX>   rank_t;
     //! Maps from element to parent of element.
-    typedef boost::unordered_map<size_t,size_t>   parent_t;
+    typedef boost::unordered_map<INDEX,INDEX>   parent_t;
     typedef boost::associative_property_map<rank_t> rank_pmap_t;
     typedef boost::associative_property_map<parent_t> parent_pmap_t;
 
     typedef boost::disjoint_sets<rank_pmap_t,parent_pmap_t> dset_t;
 
-    const landscape_t& m_raster;
+    const RASTER& m_raster;
     std::shared_ptr<rank_t> m_rank_map;
     std::shared_ptr<parent_t> m_parent_map;
     std::shared_ptr<rank_pmap_t> m_rank_pmap;
@@ -57,14 +70,14 @@ struct ConnectSets
     std::shared_ptr<dset_t> m_dset;
     boost::array<size_t,4> m_range;
 
-    size_t m_row_cnt;
+    INDEX m_row_cnt;
     
     typedef boost::array<size_t,2> coord_t;
     typedef map<coord_t,size_t> edge_t;
     edge_t m_rows;
     edge_t m_cols;
 
-    ConnectSets(const landscape_t& raster) : m_raster(raster) {
+    ConnectSets(const RASTER& raster) : m_raster(raster) {
         this->create_dset();
     }
 
@@ -93,10 +106,10 @@ struct ConnectSets
         m_rank_map->insert(b.m_rank_map->begin(), b.m_rank_map->end());
         m_parent_map->insert(b.m_parent_map->begin(), b.m_parent_map->end());
         for_each(b.m_rows.begin(), b.m_rows.end(),
-                 [&](const edge_t::value_type& val) {
+                 [&](const typename edge_t::value_type& val) {
                      this->add_row(val); } );
         for_each(b.m_rows.begin(), b.m_rows.end(),
-                 [&](const edge_t::value_type& val) {
+                 [&](const typename edge_t::value_type& val) {
                      this->add_col(val); } );
     }
 
@@ -115,19 +128,19 @@ struct ConnectSets
 
         // Both top and bottom rows start at the cols.begin()
         // but one is situated at rows.begin(), the other at rows.end().
-        auto bottom = edge_t::value_type(lower_left,cols.end());
-        auto top = edge_t::value_type(upper_left,cols.end());
+        auto bottom = typename edge_t::value_type(lower_left,cols.end());
+        auto top = typename edge_t::value_type(upper_left,cols.end());
         this->add_row(bottom);
         this->add_row(top);
 
-        auto left = edge_t::value_type(lower_left,rows.end());
-        auto right = edge_t::value_type(lower_right,rows.end());
+        auto left = typename edge_t::value_type(lower_left,rows.end());
+        auto right = typename edge_t::value_type(lower_right,rows.end());
         this->add_col(left);
         this->add_col(right);
     }
 
 
-    void add_row(const edge_t::value_type& row_entry) {
+    void add_row(const typename edge_t::value_type& row_entry) {
         const auto& row = row_entry.first;
         size_t end = row_entry.second;
 
@@ -148,7 +161,7 @@ struct ConnectSets
 
 
 
-    void add_col(const edge_t::value_type& col_entry) {
+    void add_col(const typename edge_t::value_type& col_entry) {
         const auto& col = col_entry.first;
         size_t end = col_entry.second;
 
@@ -169,23 +182,29 @@ struct ConnectSets
 
 
 
-    void operator() (const blocked_range2d<landscape_t::size_type>& r ) {
+    void operator() (const blocked_range2d<size_t>& r ) {
         //cout << "ConnectSets::operator() " << m_range << " to ";
         boost::array<size_t,4> range_init = {{ r.rows().begin(),r.rows().end(),
                 r.cols().begin(), r.cols().end() }};
         m_range=range_init;
         //cout << m_range << endl;
-        const size_t jcnt=m_raster.size2();
+        const INDEX jcnt=m_raster.size2();
 
-        m_dset->make_set(r.rows().begin()*jcnt+r.cols().begin());
+        if (uniform(r)) {
+            add_uniform(r);
+            this->add_edges(r.rows(),r.cols());
+            return;
+        }
+
+        m_dset->make_set(INDEX(r.rows().begin()*jcnt+r.cols().begin()));
 
         for (size_t fr_idx=r.rows().begin()+1; fr_idx<r.rows().end();
                                                         fr_idx++) {
-            m_dset->make_set(fr_idx*jcnt+r.cols().begin());
+            m_dset->make_set(INDEX(fr_idx*jcnt+r.cols().begin()));
             union_if_equal(fr_idx,r.cols().begin(),fr_idx-1,r.cols().begin());
         }
         for (size_t fc_idx=r.cols().begin()+1; fc_idx<r.cols().end();fc_idx++) {
-            m_dset->make_set(r.rows().begin()*jcnt+fc_idx);
+            m_dset->make_set(INDEX(r.rows().begin()*jcnt+fc_idx));
             union_if_equal(r.rows().begin(),fc_idx,r.rows().begin(),fc_idx-1);
         }
 
@@ -196,7 +215,7 @@ struct ConnectSets
         // should be unioned with them.
         for (size_t i=r.rows().begin()+1; i<r.rows().end(); i++) {
             for (size_t j=r.cols().begin()+1; j<r.cols().end(); j++) {
-                m_dset->make_set(i*jcnt+j);
+                m_dset->make_set(INDEX(i*jcnt+j));
                 
                 // Only need to add this gridpoint to one set.
                 // Check the row first to get most locality.
@@ -208,10 +227,33 @@ struct ConnectSets
         this->add_edges(r.rows(),r.cols());
     }
 
+    //! True if every pixel in the tile has the same value.
+    bool uniform(const blocked_range2d<size_t>& r) const {
+        return uniform_region(m_raster,r.rows().begin(),r.rows().end(),
+                              r.cols().begin(),r.cols().end());
+    }
+
+    /*! A uniform tile is one set. Every pixel's parent is the corner,
+     *  so the unions at its edges reach the root in one step, and no
+     *  union is done inside it.
+     */
+    void add_uniform(const blocked_range2d<size_t>& r) {
+        const INDEX jcnt=m_raster.size2();
+        const INDEX root=INDEX(r.rows().begin()*jcnt+r.cols().begin());
+        for (size_t i=r.rows().begin(); i<r.rows().end(); i++) {
+            for (size_t j=r.cols().begin(); j<r.cols().end(); j++) {
+                const INDEX pixel=INDEX(i*jcnt+j);
+                (*m_parent_map)[pixel]=root;
+                (*m_rank_map)[pixel]=0;
+            }
+        }
+        (*m_rank_map)[root]=(r.rows().size()*r.cols().size()>1) ? 1 : 0;
+    }
+
     bool union_if_equal(size_t ai, size_t aj,size_t bi, size_t bj) {
         bool added=false;
         if (m_raster(ai,aj)==m_raster(bi,bj)) {
-            m_dset->union_set(ai*m_row_cnt+aj,bi*m_row_cnt+bj);
+            m_dset->union_set(INDEX(ai*m_row_cnt+aj),INDEX(bi*m_row_cnt+bj));
             added=true;
         }
         return added;
@@ -224,12 +266,13 @@ struct ConnectSets
 
 /*! TBB version 0 of clustering algorithm.
  */
-std::shared_ptr<cluster_t> clusters_tbb0(const landscape_t& raster)
+template<class INDEX, class RASTER>
+std::shared_ptr<cluster_t> clusters_tbb0_impl(const RASTER& raster)
 {
     // This needs to be a reduce, so we can combine dsets at each
     // reduce step.
-    auto cs=ConnectSets(raster);
-    parallel_reduce( blocked_range2d<landscape_t::size_type>(
+    auto cs=ConnectSets<RASTER,INDEX>(raster);
+    parallel_reduce( blocked_range2d<size_t>(
                            0,raster.size1(),32,
                            0,raster.size2(),32),
                   cs
@@ -241,4 +284,382 @@ std::shared_ptr<cluster_t> clusters_tbb0(const landscape_t& raster)
 
 
 
+/*! A disjoint set over 0..n-1 kept in one flat array, for engines
+ *  that cut their vertices into blocks. Linking the larger root under
+ *  the smaller keeps each root in the block of its lowest vertex, so
+ *  blocks labeled in parallel never write outside themselves.
+ */
+template<class INDEX>
+struct flat_disjoint_set
+{
+    std::vector<INDEX> m_parent;
+
+    explicit flat_disjoint_set(size_t n) : m_parent(n) {}
+
+    void make_set(INDEX x) { m_parent[x]=x; }
+
+    //! Find with path halving.
+    INDEX find(INDEX x) {
+        while (m_parent[x]!=x) {
+            m_parent[x]=m_parent[m_parent[x]];
+            x=m_parent[x];
+        }
+        return x;
+    }
+
+    //! Links the larger root under the smaller.
+    void join(INDEX a, INDEX b) {
+        a=find(a);
+        b=find(b);
+        if (a<b) {
+            m_parent[b]=a;
+        } else if (b<a) {
+            m_parent[a]=b;
+        }
+    }
+
+    //! Clusters in order of their lowest vertex, as the serial engines give.
+    std::shared_ptr<cluster_t> gather() {
+        auto clusters=std::make_shared<cluster_t>();
+        typedef std::map<INDEX,cluster_t::iterator> ptl_t;
+        ptl_t parent_to_list; // The map from parent to list of children.
+        const INDEX vertex_cnt=m_parent.size();
+        for (INDEX pull=0; pull<vertex_cnt; pull++) {
+            INDEX parent=find(pull);
+            typename ptl_t::iterator plist = parent_to_list.find(parent);
+            if (plist==parent_to_list.end()) {
+                cluster_t::iterator nlist = clusters->insert(clusters->end(),
+                                                             std::list<size_t>());
+                parent_to_list[parent]=nlist;
+                nlist->push_back(pull);
+            } else {
+                plist->second->push_back(pull);
+            }
+        }
+        return clusters;
+    }
+};
+
+
+
+/*! Voxel labeling for a volume_t. Voxels are numbered
+ *  (i*size1+j)*size2+k. The volume is cut into cubes of side grain,
+ *  and each cube is labeled by itself, in parallel, with the causal
+ *  half of the stencil. The parent of a voxel is always in its own
+ *  cube during that pass, so the cubes share the parent array without
+ *  locks. A serial pass then joins voxels across the faces between
+ *  cubes, visiting only voxels on a face.
+ */
+template<class INDEX, class STENCIL>
+struct ConnectVoxels
+{
+    static constexpr STENCIL table_{};
+    typedef boost::array<size_t,3> coord_t;
+
+    const volume_t&    m_volume;
+    coord_t            m_extent;
+    boost::array<std::ptrdiff_t,3> m_strides;
+    size_t             m_grain;
+    flat_disjoint_set<INDEX> m_dset;
+
+    ConnectVoxels(const volume_t& volume, size_t grain)
+        : m_volume(volume), m_grain(grain),
+          m_dset(volume.shape()[0]*volume.shape()[1]*volume.shape()[2])
+    {
+        for (size_t d=0; d<3; d++) {
+            m_extent[d]=volume.shape()[d];
+            m_strides[d]=volume.strides()[d];
+        }
+    }
+
+    INDEX index(const coord_t& c) const {
+        return INDEX((c[0]*m_extent[1]+c[1])*m_extent[2]+c[2]);
+    }
+
+    unsigned char value(const coord_t& c) const {
+        return *(m_volume.origin()+c[0]*m_strides[0]+c[1]*m_strides[1]+
+                 c[2]*m_strides[2]);
+    }
+
+    bool neighbor(const coord_t& c, int entry, coord_t& n) const {
+        for (size_t d=0; d<3; d++) {
+            n[d]=c[d]+table_.offsets[entry][d];
+            if (n[d]>=m_extent[d]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool same_cube(const coord_t& a, const coord_t& b) const {
+        for (size_t d=0; d<3; d++) {
+            if (a[d]/m_grain!=b[d]/m_grain) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //! Labels the cubes in a range of cube indices.
+    void label_cubes(const blocked_range3d<size_t>& cubes) {
+        for (size_t ci=cubes.pages().begin(); ci!=cubes.pages().end(); ci++) {
+            for (size_t cj=cubes.rows().begin(); cj!=cubes.rows().end(); cj++) {
+                for (size_t ck=cubes.cols().begin(); ck!=cubes.cols().end(); ck++) {
+                    coord_t lower={{ci*m_grain,cj*m_grain,ck*m_grain}};
+                    label_cube(lower);
+                }
+            }
+        }
+    }
+
+    void label_cube(const coord_t& lower) {
+        coord_t upper;
+        for (size_t d=0; d<3; d++) {
+            upper[d]=std::min(lower[d]+m_grain,m_extent[d]);
+        }
+        coord_t c, n;
+        for (c[0]=lower[0]; c[0]<upper[0]; c[0]++) {
+            for (c[1]=lower[1]; c[1]<upper[1]; c[1]++) {
+                for (c[2]=lower[2]; c[2]<upper[2]; c[2]++) {
+                    INDEX here=index(c);
+                    m_dset.make_set(here);
+                    for (int entry=0; entry<STENCIL::causal; entry++) {
+                        if (neighbor(c,entry,n) && same_cube(c,n) &&
+                                value(c)==value(n)) {
+                            m_dset.join(here,index(n));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    //! Joins across faces of cubes, for one voxel.
+    void join_faces(const coord_t& c) {
+        coord_t n;
+        for (int entry=0; entry<STENCIL::causal; entry++) {
+            if (neighbor(c,entry,n) && !same_cube(c,n) &&
+                    value(c)==value(n)) {
+                m_dset.join(index(c),index(n));
+            }
+        }
+    }
+
+    void join_all_faces() {
+        auto on_face=[this](size_t x) {
+            size_t r=x%m_grain;
+            return r==0 || r==m_grain-1;
+        };
+        coord_t c;
+        for (c[0]=0; c[0]<m_extent[0]; c[0]++) {
+            for (c[1]=0; c[1]<m_extent[1]; c[1]++) {
+                if (on_face(c[0]) || on_face(c[1])) {
+                    for (c[2]=0; c[2]<m_extent[2]; c[2]++) {
+                        join_faces(c);
+                    }
+                } else {
+                    // Only the first and last k of each cube.
+                    for (size_t start=0; start<m_extent[2]; start+=m_grain) {
+                        c[2]=start;
+                        join_faces(c);
+                        c[2]=std::min(start+m_grain,m_extent[2])-1;
+                        if (c[2]!=start) {
+                            join_faces(c);
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+
+
+template<class INDEX, class STENCIL>
+std::shared_ptr<cluster_t> clusters_tbb3d_impl(const volume_t& volume,
+                                               size_t grain)
+{
+    ConnectVoxels<INDEX,STENCIL> voxels(volume,grain);
+    const auto& extent=voxels.m_extent;
+    parallel_for(blocked_range3d<size_t>(
+                     0,(extent[0]+grain-1)/grain,1,
+                     0,(extent[1]+grain-1)/grain,1,
+                     0,(extent[2]+grain-1)/grain,1),
+                 [&voxels](const blocked_range3d<size_t>& cubes) {
+                     voxels.label_cubes(cubes);
+                 });
+    voxels.join_all_faces();
+    return voxels.m_dset.gather();
+}
+
+
+
+template<class STENCIL>
+std::shared_ptr<cluster_t> clusters_tbb3d_stencil(const volume_t& volume,
+                                                  size_t grain)
+{
+    const size_t* shape=volume.shape();
+    return dispatch_index(shape[0]*shape[1],shape[2],[&](auto index) {
+        return clusters_tbb3d_impl<decltype(index),STENCIL>(volume,grain);
+    });
+}
+
+
+
+std::shared_ptr<cluster_t> clusters_tbb3d(const volume_t& volume,
+                                          int connectivity, size_t grain)
+{
+    if (grain==0) {
+        throw std::runtime_error("The grain of clusters_tbb3d must be positive.");
+    }
+    switch (connectivity) {
+    case 6:
+        return clusters_tbb3d_stencil<stencil_six>(volume,grain);
+    case 18:
+        return clusters_tbb3d_stencil<stencil_eighteen>(volume,grain);
+    case 26:
+        return clusters_tbb3d_stencil<stencil_twentysix>(volume,grain);
+    }
+    throw std::runtime_error("Voxel connectivity must be 6, 18 or 26.");
+}
+
+
+
+/*! Labels a csr_graph with the vertices cut into blocks of grain.
+ *  Each block joins the edges that stay inside it, in parallel, and
+ *  keeps the edges that leave it. Those are joined afterwards, serially,
+ *  which is cheap when vertices are numbered so that neighbors are near,
+ *  as they are for parcels sorted along a space-filling curve.
+ */
+template<class INDEX>
+struct ConnectGraph
+{
+    typedef std::pair<INDEX,INDEX> edge_t;
+
+    const csr_graph&         m_graph;
+    size_t                   m_grain;
+    flat_disjoint_set<INDEX> m_dset;
+    //! Edges that cross out of each block, indexed by block.
+    std::vector<std::vector<edge_t> > m_seams;
+
+    ConnectGraph(const csr_graph& graph, size_t grain)
+        : m_graph(graph), m_grain(grain), m_dset(graph.vertex_cnt),
+          m_seams((graph.vertex_cnt+grain-1)/grain) {}
+
+    void label_blocks(const blocked_range<size_t>& blocks) {
+        for (size_t block=blocks.begin(); block!=blocks.end(); block++) {
+            label_block(block);
+        }
+    }
+
+    void label_block(size_t block) {
+        const size_t lower=block*m_grain;
+        const size_t upper=std::min(lower+m_grain,m_graph.vertex_cnt);
+        for (size_t v=lower; v<upper; v++) {
+            m_dset.make_set(INDEX(v));
+        }
+        std::vector<edge_t>& seam=m_seams[block];
+        for (size_t v=lower; v<upper; v++) {
+            const unsigned char value=m_graph.values[v];
+            for (size_t e=m_graph.offsets[v]; e<m_graph.offsets[v+1]; e++) {
+                const size_t u=m_graph.neighbors[e];
+                if (u>=m_graph.vertex_cnt) {
+                    throw std::runtime_error("CSR neighbor is not a vertex.");
+                }
+                if (m_graph.values[u]!=value) {
+                    continue;
+                }
+                if (u>=lower && u<upper) {
+                    m_dset.join(INDEX(v),INDEX(u));
+                } else {
+                    seam.push_back(edge_t(INDEX(v),INDEX(u)));
+                }
+            }
+        }
+    }
+
+    void join_seams() {
+        for (size_t block=0; block<m_seams.size(); block++) {
+            for (const edge_t& edge : m_seams[block]) {
+                m_dset.join(edge.first,edge.second);
+            }
+        }
+    }
+};
+
+
+
+template<class INDEX>
+std::shared_ptr<cluster_t> clusters_tbb_graph_impl(const csr_graph& graph,
+                                                   size_t grain)
+{
+    ConnectGraph<INDEX> connect(graph,grain);
+    parallel_for(blocked_range<size_t>(0,connect.m_seams.size(),1),
+                 [&connect](const blocked_range<size_t>& blocks) {
+                     connect.label_blocks(blocks);
+                 });
+    connect.join_seams();
+    return connect.m_dset.gather();
+}
+
+
+
+std::shared_ptr<cluster_t> clusters_tbb_graph(const csr_graph& graph,
+                                              size_t grain)
+{
+    if (grain==0) {
+        throw std::runtime_error("The grain of clusters_tbb_graph must be positive.");
+    }
+    return dispatch_index(graph.vertex_cnt,1,[&](auto index) {
+        return clusters_tbb_graph_impl<decltype(index)>(graph,grain);
+    });
+}
+
+
+
+std::shared_ptr<cluster_t> clusters_tbb0(const landscape_t& raster)
+{
+    return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+        return clusters_tbb0_impl<decltype(index)>(raster);
+    });
+}
+
+
+
+std::shared_ptr<cluster_t> clusters_tbb0(const landscape_view_t& raster)
+{
+    return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+        return clusters_tbb0_impl<decltype(index)>(raster);
+    });
+}
+
+
+
+std::shared_ptr<cluster_t> clusters_tbb0(const replicated_landscape_t& raster)
+{
+    return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+        return clusters_tbb0_impl<decltype(index)>(raster);
+    });
+}
+
+
+
+std::shared_ptr<cluster_t> clusters_tbb0(const class16_landscape_t& raster)
+{
+    return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+        return clusters_tbb0_impl<decltype(index)>(raster);
+    });
+}
+
+
+
+std::shared_ptr<cluster_t> clusters_tbb0(const class16_view_t& raster)
+{
+    return dispatch_index(raster.size1(),raster.size2(),[&](auto index) {
+        return clusters_tbb0_impl<decltype(index)>(raster);
+    });
+}
+
+
+
 } // namespace
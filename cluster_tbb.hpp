@@ -2,11 +2,65 @@
 #define _CLUSTER_TBB_H_ 1
 
 #include <memory>
+#include <vector>
+#include <stdexcept>
 #include "raster.hpp"
+#include "raster_view.hpp"
+#include "replicated_view.hpp"
 
 namespace raster_stats {
 
+  /*! A graph in compressed sparse row form, with a class for each
+   *  vertex, such as parcels and the parcels that touch them. The
+   *  neighbors of v are neighbors[offsets[v]] to neighbors[offsets[v+1]].
+   *  It points at arrays held elsewhere, like raster_view.
+   */
+  struct csr_graph {
+      size_t vertex_cnt;
+      const size_t* offsets;
+      const size_t* neighbors;
+      const unsigned char* values;
+
+      csr_graph(size_t vertex_cnt, const size_t* offsets,
+                const size_t* neighbors, const unsigned char* values)
+          : vertex_cnt(vertex_cnt), offsets(offsets), neighbors(neighbors),
+            values(values) {}
+
+      csr_graph(const std::vector<size_t>& offsets,
+                const std::vector<size_t>& neighbors,
+                const std::vector<unsigned char>& values)
+          : vertex_cnt(values.size()), offsets(offsets.data()),
+            neighbors(neighbors.data()), values(values.data()) {
+          if (offsets.size()!=values.size()+1 ||
+                  offsets.back()!=neighbors.size()) {
+              throw std::runtime_error("CSR offsets do not match the "
+                                       "vertices and neighbors.");
+          }
+      }
+  };
+
   std::shared_ptr<cluster_t> clusters_tbb0(const landscape_t& raster);
+  std::shared_ptr<cluster_t> clusters_tbb0(const landscape_view_t& raster);
+  //! A small raster repeated, read in place, for scaling runs.
+  std::shared_ptr<cluster_t> clusters_tbb0(const replicated_landscape_t& raster);
+  //! 16-bit class maps, such as from read_tiff_bands<uint16_t>.
+  std::shared_ptr<cluster_t> clusters_tbb0(const class16_landscape_t& raster);
+  std::shared_ptr<cluster_t> clusters_tbb0(const class16_view_t& raster);
+
+  /*! Labels a stack of rasters as voxels, with 6, 18 or 26-connectivity.
+   *  Cubes of side grain are labeled in parallel, then joined at faces.
+   *  Voxel (l,i,j) is numbered (l*shape[1]+i)*shape[2]+j.
+   */
+  std::shared_ptr<cluster_t> clusters_tbb3d(const volume_t& volume,
+                                            int connectivity=6,
+                                            size_t grain=32);
+
+  /*! Clusters neighbors in a graph that have the same value. Blocks of
+   *  grain vertices are labeled in parallel, then edges between blocks
+   *  are joined. Clusters come out as the raster engines give them.
+   */
+  std::shared_ptr<cluster_t> clusters_tbb_graph(const csr_graph& graph,
+                                                size_t grain=65536);
 
 }
 
@@ -1,4 +1,6 @@
 #include <map>
+#include <vector>
+#include <algorithm>
 #include <boost/test/included/unit_test.hpp>
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
@@ -12,6 +14,7 @@
 #include "io_geotiff.hpp"
 #include "tiffvers.h"
 #include "cluster_tbb.hpp"
+#include "cluster.hpp"
 
 
 using namespace std;
@@ -32,6 +35,32 @@ void test_clusters_generic()
 }
 
 
+void test_clusters_generic_view()
+{
+    // A contiguous view reads through a pointer, a window through (i,j).
+    const int thread_cnt = 1;
+    tbb::task_scheduler_init init(thread_cnt);
+    auto raster = multi_value({{40,40}},{{0,4}});
+    landscape_t inner(20,20);
+    for (size_t i=0; i<20; i++) {
+        for (size_t j=0; j<20; j++) {
+            inner(i,j)=(*raster)(i+10,j+10);
+        }
+    }
+    landscape_view_t window(&(*raster)(10,10),20,20,raster->size2());
+    cluster_raster<landscape_view_t> by_view;
+    by_view(make_view(*raster));
+    cluster_raster<landscape_view_t> by_window;
+    by_window(window);
+    cluster_raster<landscape_t> by_copy;
+    by_copy(inner);
+    cluster_raster<landscape_t> by_matrix;
+    by_matrix(*raster);
+    BOOST_CHECK_EQUAL(count(by_view),count(by_matrix));
+    BOOST_CHECK_EQUAL(count(by_window),count(by_copy));
+}
+
+
 void test_clusters_basis()
 {
 	// This array is (0,10) in the i and (20,40) in the j.
@@ -238,12 +267,253 @@ void known_many_tbb0()
 
 
 
+void known_many_view_tbb0()
+{
+    const int thread_cnt = 6;
+    tbb::task_scheduler_init init(thread_cnt);
+    auto raster = multi_value({{100,100}},{{0,25}});
+    landscape_view_t view(*raster);
+    auto clusters = clusters_tbb0(view);
+    BOOST_CHECK_EQUAL(clusters->size(),25);
+}
+
+
+
+void known_uniform_tbb0()
+{
+    const int thread_cnt = 6;
+    tbb::task_scheduler_init init(thread_cnt);
+    // Water over most tiles, with a river and specks that break some.
+    landscape_t raster(200,150);
+    for (size_t i=0; i<raster.size1(); i++) {
+        for (size_t j=0; j<raster.size2(); j++) {
+            raster(i,j)=3;
+            if (j>=i/2+20 && j<i/2+24) raster(i,j)=1;
+            if ((i*31+j*17)%997==0) raster(i,j)=2;
+        }
+    }
+    cluster_t expected=find_clusters(raster);
+    BOOST_CHECK(*clusters_tbb0(raster)==expected);
+    BOOST_CHECK(*clusters_tbb0(landscape_view_t(raster))==expected);
+
+    landscape_t flat(100,70,5);
+    BOOST_CHECK_EQUAL(clusters_tbb0(flat)->size(),1);
+}
+
+
+
+void known_uniform_generic()
+{
+    const int thread_cnt = 4;
+    tbb::task_scheduler_init init(thread_cnt);
+    // One value, so cluster_raster makes every block one set at once.
+    landscape_t flat(100,70,5);
+    cluster_raster<landscape_t> by_matrix;
+    by_matrix(flat);
+    BOOST_CHECK_EQUAL(count(by_matrix),1);
+
+    // A block of one value becomes one set under its first pixel. A
+    // block with another value in it is left for the pixel sweep.
+    landscape_t raster(10,20,4);
+    raster(7,15)=2;
+    const landscape_view_t view=make_view(raster);
+    typedef AreEqual<unsigned char,landscape_view_t> AreEqual_t;
+    AreEqual_t comparison(view);
+    disjoint_set_cluster<array_basis,AreEqual_t> dsc(comparison);
+    boost::array<size_t,4> bounds={{0,10,0,20}};
+    array_basis left(bounds,1);
+    array_basis right(left,tbb::split());
+    BOOST_CHECK(!dsc.add_uniform(right));
+    BOOST_CHECK(dsc.parent_map_.empty());
+    BOOST_REQUIRE(dsc.add_uniform(left));
+    BOOST_CHECK_EQUAL(dsc.parent_map_.size(),100);
+    BOOST_CHECK_EQUAL(dsc.rank_map_[0],1);
+    for (size_t i=0; i<10; i++) {
+        for (size_t j=0; j<10; j++) {
+            BOOST_CHECK_EQUAL(dsc.dset_.find_set(i*20+j),0);
+        }
+    }
+}
+
+
+
+void known_replicated_tbb0()
+{
+    const int thread_cnt = 6;
+    tbb::task_scheduler_init init(thread_cnt);
+    // A source that is mostly one value, so some tiles are uniform
+    // and some cross the seams between copies.
+    landscape_t source(45,38);
+    for (size_t i=0; i<source.size1(); i++) {
+        for (size_t j=0; j<source.size2(); j++) {
+            source(i,j)=(i>30 && j<10) ? 1 : 0;
+        }
+    }
+    boost::array<size_t,2> ns={{170,130}};
+    auto whole=resize_replicate(std::make_shared<landscape_t>(source),ns);
+    replicated_landscape_t replicated=make_replicated(source,ns);
+    BOOST_CHECK(*clusters_tbb0(replicated)==*clusters_tbb0(*whole));
+}
+
+
+
+void known_class16_tbb0()
+{
+    const int thread_cnt = 6;
+    tbb::task_scheduler_init init(thread_cnt);
+    // 16-bit classes that share a low byte, in uniform and mixed tiles.
+    class16_landscape_t raster(100,70);
+    landscape_t narrow(100,70);
+    for (size_t i=0; i<raster.size1(); i++) {
+        for (size_t j=0; j<raster.size2(); j++) {
+            const size_t k=(i<40) ? 0 : (i/7+j/9)%3;
+            raster(i,j)=(k==0) ? 44 : ((k==1) ? 300 : 556);
+            narrow(i,j)=k;
+        }
+    }
+    cluster_t expected=*clusters_tbb0(narrow);
+    BOOST_CHECK(*clusters_tbb0(raster)==expected);
+    BOOST_CHECK(*clusters_tbb0(make_view(raster))==expected);
+}
+
+
+
+/*! Labels a volume by breadth-first search, for checking the engine.
+ *  Returns one label per voxel, numbered as clusters_tbb3d numbers them.
+ */
+std::vector<int> flood_volume(const volume_t& volume, int max_nonzero)
+{
+    const size_t* n=volume.shape();
+    std::vector<int> label(n[0]*n[1]*n[2],-1);
+    int next_label=0;
+    for (size_t seed=0; seed<label.size(); seed++) {
+        if (label[seed]>=0) continue;
+        std::vector<size_t> stack(1,seed);
+        label[seed]=next_label;
+        while (!stack.empty()) {
+            size_t at=stack.back();
+            stack.pop_back();
+            long c[3]={long(at/(n[1]*n[2])),long((at/n[2])%n[1]),long(at%n[2])};
+            for (int di=-1; di<=1; di++) {
+                for (int dj=-1; dj<=1; dj++) {
+                    for (int dk=-1; dk<=1; dk++) {
+                        int nonzero=(di!=0)+(dj!=0)+(dk!=0);
+                        long m[3]={c[0]+di,c[1]+dj,c[2]+dk};
+                        if (nonzero==0 || nonzero>max_nonzero ||
+                            m[0]<0 || m[1]<0 || m[2]<0 || m[0]>=long(n[0]) ||
+                            m[1]>=long(n[1]) || m[2]>=long(n[2])) {
+                            continue;
+                        }
+                        size_t to=(m[0]*n[1]+m[1])*n[2]+m[2];
+                        if (label[to]<0 &&
+                            volume[m[0]][m[1]][m[2]]==volume[c[0]][c[1]][c[2]]) {
+                            label[to]=next_label;
+                            stack.push_back(to);
+                        }
+                    }
+                }
+            }
+        }
+        next_label++;
+    }
+    return label;
+}
+
+
+
+void known_volume_tbb3d()
+{
+    const int thread_cnt = 6;
+    tbb::task_scheduler_init init(thread_cnt);
+    volume_t volume(boost::extents[9][14][11]);
+    for (size_t l=0; l<9; l++) {
+        for (size_t i=0; i<14; i++) {
+            for (size_t j=0; j<11; j++) {
+                volume[l][i][j]=((l*7+i*3+j*5)%11)<5;
+            }
+        }
+    }
+    const int connectivity[3]={6,18,26};
+    for (int which=0; which<3; which++) {
+        std::vector<int> expected=flood_volume(volume,which+1);
+        size_t expected_cnt=*std::max_element(expected.begin(),expected.end())+1;
+        // A grain that does not divide the extents leaves partial cubes.
+        for (size_t grain=2; grain<8; grain+=3) {
+            auto clusters=clusters_tbb3d(volume,connectivity[which],grain);
+            BOOST_CHECK_EQUAL(clusters->size(),expected_cnt);
+            // Each cluster lies within one flooded region, so with
+            // equal counts the partitions are the same.
+            for (auto cluster=clusters->begin(); cluster!=clusters->end();
+                 cluster++) {
+                for (auto voxel=cluster->begin(); voxel!=cluster->end();
+                     voxel++) {
+                    BOOST_CHECK_EQUAL(expected[*voxel],
+                                      expected[cluster->front()]);
+                }
+            }
+        }
+    }
+    BOOST_CHECK_THROW(clusters_tbb3d(volume,4),std::runtime_error);
+}
+
+
+
+void known_graph_tbb()
+{
+    const int thread_cnt = 6;
+    tbb::task_scheduler_init init(thread_cnt);
+    // The 4-neighbor graph of a raster must cluster like the raster.
+    landscape_t raster(23,17);
+    for (size_t i=0; i<raster.size1(); i++) {
+        for (size_t j=0; j<raster.size2(); j++) {
+            raster(i,j)=((i/2)*5+(j/3)*3)%4;
+        }
+    }
+    const size_t icnt=raster.size1(), jcnt=raster.size2();
+    std::vector<size_t> offsets(1,0), neighbors;
+    std::vector<unsigned char> values;
+    for (size_t i=0; i<icnt; i++) {
+        for (size_t j=0; j<jcnt; j++) {
+            if (i>0) neighbors.push_back((i-1)*jcnt+j);
+            if (j>0) neighbors.push_back(i*jcnt+j-1);
+            if (j+1<jcnt) neighbors.push_back(i*jcnt+j+1);
+            if (i+1<icnt) neighbors.push_back((i+1)*jcnt+j);
+            offsets.push_back(neighbors.size());
+            values.push_back(raster(i,j));
+        }
+    }
+    cluster_t expected=find_clusters(raster);
+    for (size_t grain=1; grain<500; grain*=7) {
+        auto clusters=clusters_tbb_graph(csr_graph(offsets,neighbors,values),grain);
+        BOOST_CHECK(*clusters==expected);
+    }
+
+    // Edges listed in one direction only, between parcels 0-1-4 and 2-3.
+    std::vector<size_t> one_offsets={0,0,1,1,2,3};
+    std::vector<size_t> one_neighbors={0,2,1};
+    std::vector<unsigned char> one_values={7,7,9,9,7};
+    auto parcels=clusters_tbb_graph(csr_graph(one_offsets,one_neighbors,one_values),2);
+    BOOST_REQUIRE_EQUAL(parcels->size(),2);
+    std::list<size_t> first={0,1,4};
+    BOOST_CHECK(parcels->front()==first);
+
+    std::vector<size_t> bad_neighbors={0,2,9};
+    BOOST_CHECK_THROW(clusters_tbb_graph(
+        csr_graph(one_offsets,bad_neighbors,one_values)),std::runtime_error);
+    one_offsets.pop_back();
+    BOOST_CHECK_THROW(csr_graph(one_offsets,one_neighbors,one_values),
+                      std::runtime_error);
+}
+
+
+
 bool init_function( )
 {
   BOOST_TEST_MESSAGE("Using Boost version " << BOOST_VERSION);
 
   auto& master = framework::master_test_suite();
   master.add( BOOST_TEST_CASE( test_clusters_generic ) );
+  master.add( BOOST_TEST_CASE( test_clusters_generic_view ) );
   master.add( BOOST_TEST_CASE( test_clusters_basis ) );
   master.add( BOOST_TEST_CASE( test_clusters_adjacent ) );
   master.add( BOOST_TEST_CASE( test_edge_adjacent ) );
@@ -253,6 +523,13 @@ bool init_function( )
   master.add( BOOST_TEST_CASE( test_clusters_tbb0 ) );
   master.add( BOOST_TEST_CASE( known_single_tbb0 ) );
   master.add( BOOST_TEST_CASE( known_many_tbb0 ) );
+  master.add( BOOST_TEST_CASE( known_many_view_tbb0 ) );
+  master.add( BOOST_TEST_CASE( known_uniform_tbb0 ) );
+  master.add( BOOST_TEST_CASE( known_uniform_generic ) );
+  master.add( BOOST_TEST_CASE( known_replicated_tbb0 ) );
+  master.add( BOOST_TEST_CASE( known_class16_tbb0 ) );
+  master.add( BOOST_TEST_CASE( known_volume_tbb3d ) );
+  master.add( BOOST_TEST_CASE( known_graph_tbb ) );
   return true;
 }
 
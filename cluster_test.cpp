@@ -1,8 +1,12 @@
 #include <memory>
 #include <map>
+#include <set>
+#include <limits>
+#include <cstdio>
 #include <boost/test/included/unit_test.hpp>
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/numeric/ublas/matrix_proxy.hpp>
 #include "raster.hpp"
 #include "io_geotiff.hpp"
 #include "cluster.hpp"
@@ -13,6 +17,17 @@
 #include "array_init.hpp"
 #include "gather_clusters.hpp"
 #include "morton.hpp"
+#include "hilbert.hpp"
+#include "scratch_arena.hpp"
+#include "vertex_index.hpp"
+#include "gridnd.hpp"
+#include "class_lut.hpp"
+#include "replicated_view.hpp"
+#include "io_hdf_raster.hpp"
+#include "test_directory.hpp"
+#include "cluster_cache.hpp"
+#include "raster_hash.hpp"
+#include "raster_pyramid.hpp"
 
 
 using namespace std;
@@ -99,6 +114,41 @@ void test_full_blocked()
 
 
 
+template<class STATIC,class DYNAMIC>
+void compare_static_block(size_t w, size_t b)
+{
+    STATIC fixed(w);
+    DYNAMIC variable(w,b);
+    for (size_t i=0; i<w; i++) {
+        for (size_t j=0; j<w; j++) {
+            typename STATIC::key_type coord;
+            coord[0]=i;
+            coord[1]=j;
+            BOOST_CHECK_EQUAL(fixed(coord),variable(coord));
+        }
+    }
+}
+
+
+
+void test_static_blocked()
+{
+    BOOST_CHECK_EQUAL(static_log2<1>::value,0);
+    BOOST_CHECK_EQUAL(static_log2<32>::value,5);
+
+    write_read_transform<transform_ij_blocked_static<32>>(
+                      transform_ij_blocked_static<32>(512));
+    write_read_transform<transform_ij_full_blocked_static<32>>(
+                      transform_ij_full_blocked_static<32>(512));
+
+    compare_static_block<transform_ij_blocked_static<8>,
+                         transform_ij_blocked>(96,8);
+    compare_static_block<transform_ij_full_blocked_static<16>,
+                         transform_ij_full_blocked>(100,16);
+}
+
+
+
 void test_morton()
 {
     transform_morton_ij tij;
@@ -107,6 +157,39 @@ void test_morton()
 
 
 
+void test_hilbert()
+{
+    transform_hilbert_ij tij(512);
+    write_read_transform<transform_hilbert_ij>(tij);
+}
+
+
+
+void test_hilbert_adjacent()
+{
+    // Every step along the curve moves to a nearest neighbor,
+    // and decoding undoes encoding.
+    const unsigned order=hilbert_calculations::order(256);
+    BOOST_CHECK_EQUAL(order,8);
+    boost::array<size_t,2> prev=
+        hilbert_calculations::detangle<size_t,size_t>(size_t(0),order);
+    for (size_t d=1; d<256*256; d++) {
+        auto xy=hilbert_calculations::detangle<size_t,size_t>(d,order);
+        size_t back=hilbert_calculations::combine_xy<size_t,size_t>(xy,order);
+        BOOST_CHECK_EQUAL(back,d);
+        size_t step=(xy[0]>prev[0] ? xy[0]-prev[0] : prev[0]-xy[0]) +
+            (xy[1]>prev[1] ? xy[1]-prev[1] : prev[1]-xy[1]);
+        BOOST_CHECK_EQUAL(step,1);
+        prev=xy;
+    }
+
+    boost::array<size_t,2> extent={{100,100}};
+    BOOST_CHECK_EQUAL(storage_size(transform_hilbert_ij(100),extent),128*128);
+    BOOST_CHECK_EQUAL(storage_size(transform_ij(100),extent),100*100);
+}
+
+
+
 void test_bits()
 {
     size_t a = alternating_bits<1,1>::value;
@@ -477,6 +560,1131 @@ void known_many_remap()
 
 
 
+void known_many_view()
+{
+    // The engines read the same answer through a view, including one
+    // whose rows run backwards.
+    auto raster = multi_value({{100,100}},{{0,25}});
+    landscape_view_t view(*raster);
+    BOOST_CHECK_EQUAL(find_clusters(view).size(),25);
+    BOOST_CHECK_EQUAL(find_clusters_twopass(view).size(),25);
+    BOOST_CHECK_EQUAL(find_clusters_pointer(view)->size(),25);
+    BOOST_CHECK_EQUAL(find_clusters_pair(view).size(),25);
+
+    landscape_view_t flipped(&raster->data()[0]+99*100,100,100,-100);
+    BOOST_CHECK_EQUAL(flipped(0,0),(*raster)(99,0));
+    BOOST_CHECK_EQUAL(find_clusters_remap(flipped).size(),25);
+}
+
+
+
+template<class STENCIL,int FIRST,int LAST>
+size_t count_stencil_edges(size_t rows, size_t cols, size_t& vertex_cnt)
+{
+    typedef array_basis<size_t> basis_t;
+    basis_t::bounds_type bounds;
+    bounds[0][0]=0;
+    bounds[0][1]=rows;
+    bounds[1][0]=0;
+    bounds[1][1]=cols;
+    basis_t basis(bounds,32);
+
+    size_t edge_cnt=0;
+    vertex_cnt=0;
+    basis_t::vertex_type last={{0,0}};
+    stencil_sweep<STENCIL,FIRST,LAST>(basis,
+        [&](const basis_t::vertex_type& v) {
+            // The sweep is row-major.
+            if (vertex_cnt>0) {
+                BOOST_CHECK(v[0]*cols+v[1]==last[0]*cols+last[1]+1);
+            }
+            last=v;
+            vertex_cnt++;
+        },
+        [&](const basis_t::vertex_type& v, const basis_t::vertex_type& n) {
+            BOOST_CHECK(n[0]<rows && n[1]<cols);
+            edge_cnt++;
+        });
+    return edge_cnt;
+}
+
+
+
+void test_stencil()
+{
+    size_t vertex_cnt;
+    // A 3x3 grid has 12 four-connected edges and 8 more diagonals.
+    BOOST_CHECK_EQUAL((count_stencil_edges<stencil_four,0,4>(3,3,vertex_cnt)),24);
+    BOOST_CHECK_EQUAL(vertex_cnt,9);
+    BOOST_CHECK_EQUAL((count_stencil_edges<stencil_four,0,2>(3,3,vertex_cnt)),12);
+    BOOST_CHECK_EQUAL((count_stencil_edges<stencil_eight,0,8>(3,3,vertex_cnt)),40);
+    BOOST_CHECK_EQUAL((count_stencil_edges<stencil_eight,0,4>(3,3,vertex_cnt)),20);
+    // Wider grids take the interior loop. Narrow ones do not.
+    BOOST_CHECK_EQUAL((count_stencil_edges<stencil_four,0,2>(7,9,vertex_cnt)),
+                      7*8+6*9);
+    BOOST_CHECK_EQUAL(vertex_cnt,63);
+    BOOST_CHECK_EQUAL((count_stencil_edges<stencil_eight,0,4>(7,9,vertex_cnt)),
+                      7*8+6*9+2*6*8);
+    BOOST_CHECK_EQUAL((count_stencil_edges<stencil_four,0,4>(5,1,vertex_cnt)),8);
+    BOOST_CHECK_EQUAL((count_stencil_edges<stencil_four,0,4>(1,2,vertex_cnt)),2);
+}
+
+
+
+void test_generic_stencil()
+{
+    typedef unsigned char value_type;
+    boost::array<size_t,2> extent;
+    extent[0]=100;
+    extent[1]=100;
+
+    typedef array_basis<size_t> basis_t;
+    basis_t::bounds_type bounds;
+    bounds[0][0]=0;
+    bounds[0][1]=extent[0];
+    bounds[1][0]=0;
+    bounds[1][1]=extent[1];
+    basis_t basis(bounds,32);
+    transform_ij tij(extent[0]);
+    typedef transform_map<transform_ij,value_type> map_t;
+    map_t data(tij,extent[0]*extent[1]);
+
+    boost::array<value_type,2> limits;
+    limits[0]=0;
+    limits[1]=100;
+    checkerboard_array(data,extent,limits);
+
+    typedef AreEqual<map_t::key_type,map_t> comparison_t;
+    comparison_t comparison(data);
+
+    typedef construct_disjoint_set<basis_t::vertex_type,
+                                   bound_map,
+                                   bound_map> disj_t;
+    union_find_st<disj_t> ufind;
+    ufind(basis,comparison,stencil_four());
+
+    auto clusters = gather_clusters(ufind.rank_pmap_,ufind.dset_,
+                                    extent);
+    BOOST_CHECK_EQUAL(clusters->size(),limits[1]-limits[0]);
+}
+
+
+
+void test_vertex_index()
+{
+    BOOST_CHECK(index_fits<uint32_t>(65536,65535));
+    BOOST_CHECK(!index_fits<uint32_t>(65536,65536));
+    BOOST_CHECK(index_fits<size_t>(65536,65536));
+    BOOST_CHECK_THROW(check_index<uint32_t>(100000,100000),std::runtime_error);
+    size_t small=dispatch_index(100,100,[](auto index) { return sizeof(index); });
+    BOOST_CHECK_EQUAL(small,sizeof(uint32_t));
+    size_t large=dispatch_index(100000,100000,[](auto index) { return sizeof(index); });
+    BOOST_CHECK_EQUAL(large,sizeof(size_t));
+
+    // The generic engine with 32-bit vertices finds the same clusters.
+    typedef unsigned char value_type;
+    boost::array<size_t,2> extent;
+    extent[0]=100;
+    extent[1]=100;
+
+    typedef array_basis<uint32_t> basis_t;
+    basis_t::bounds_type bounds;
+    bounds[0][0]=0;
+    bounds[0][1]=extent[0];
+    bounds[1][0]=0;
+    bounds[1][1]=extent[1];
+    basis_t basis(bounds,32);
+    transform_ij tij(extent[0]);
+    typedef transform_map<transform_ij,value_type> map_t;
+    map_t data(tij,extent[0]*extent[1]);
+
+    boost::array<value_type,2> limits;
+    limits[0]=0;
+    limits[1]=100;
+    checkerboard_array(data,extent,limits);
+
+    typedef AreEqual<map_t::key_type,map_t> comparison_t;
+    comparison_t comparison(data);
+
+    typedef construct_disjoint_set<basis_t::vertex_type,
+                                   bound_map,
+                                   bound_map> disj_t;
+    union_find_st<disj_t> ufind;
+    ufind(basis,comparison,
+          make_vertex_iterator<basis_t>,
+          make_four_adjacent<basis_t>);
+
+    auto clusters = gather_clusters(ufind.rank_pmap_,ufind.dset_,
+                                    extent);
+    BOOST_CHECK_EQUAL(clusters->size(),limits[1]-limits[0]);
+}
+
+
+
+void known_many_arena()
+{
+    auto raster = multi_value({{100,100}},{{0,25}});
+    scratch_arena arena(1024);
+    size_t first_capacity=0;
+    for (size_t run=0; run<3; run++) {
+        cluster_t clusters = find_clusters_twopass(*raster,arena.resource());
+        BOOST_CHECK_EQUAL(clusters.size(),25);
+        auto pointed = find_clusters_pointer(make_view(*raster),arena.resource());
+        BOOST_CHECK_EQUAL(pointed->size(),25);
+        arena.release();
+        // The first run grows the arena. After that, it is big enough.
+        if (run==0) {
+            first_capacity=arena.capacity();
+            BOOST_CHECK_GT(first_capacity,1024);
+        } else {
+            BOOST_CHECK_EQUAL(arena.capacity(),first_capacity);
+        }
+    }
+
+    // Results can live in an arena, too, if the caller keeps it.
+    scratch_arena results;
+    cluster_pmr_t kept(results.resource());
+    std::pmr::map<size_t,size_t> rank_map(arena.resource());
+    std::pmr::map<size_t,size_t> parent_map(arena.resource());
+    typedef boost::associative_property_map<std::pmr::map<size_t,size_t>> pmap_t;
+    pmap_t rank_pmap(rank_map);
+    pmap_t parent_pmap(parent_map);
+    boost::disjoint_sets<pmap_t,pmap_t> dset(rank_pmap,parent_pmap);
+    for (size_t i=0; i<4; i++) {
+        dset.make_set(i);
+    }
+    dset.union_set(0,1);
+    dset.union_set(2,3);
+    gather_clusters_into(kept,dset,2,2,arena.resource());
+    BOOST_CHECK_EQUAL(kept.size(),2);
+    BOOST_CHECK(kept.front().get_allocator().resource()==results.resource());
+}
+
+
+
+void test_generic_single_pmr()
+{
+    typedef unsigned char value_type;
+    boost::array<size_t,2> extent;
+    extent[0]=100;
+    extent[1]=100;
+
+    typedef array_basis<size_t> basis_t;
+    basis_t::bounds_type bounds;
+    bounds[0][0]=0;
+    bounds[0][1]=extent[0];
+    bounds[1][0]=0;
+    bounds[1][1]=extent[1];
+    basis_t basis(bounds,32);
+    transform_ij tij(extent[0]);
+    typedef transform_map<transform_ij,value_type> map_t;
+    map_t data(tij,extent[0]*extent[1]);
+
+    boost::array<value_type,2> limits;
+    limits[0]=0;
+    limits[1]=100;
+    checkerboard_array(data,extent,limits);
+
+    typedef AreEqual<map_t::key_type,map_t> comparison_t;
+    comparison_t comparison(data);
+
+    typedef construct_disjoint_set<basis_t::vertex_type,
+                                   pmr_map,
+                                   pmr_map> disj_t;
+    scratch_arena arena;
+    {
+        union_find_st<disj_t> ufind(arena.resource());
+        ufind(basis,comparison,
+              make_vertex_iterator<basis_t>,
+              make_four_adjacent<basis_t>);
+
+        auto clusters = gather_clusters(ufind.rank_pmap_,ufind.dset_,
+                                        extent,arena.resource());
+        BOOST_CHECK_EQUAL(clusters->size(),limits[1]-limits[0]);
+    }
+    arena.release();
+}
+
+
+
+void test_periodic_wraps()
+{
+    landscape_t raster(4,5);
+    for (size_t i=0; i<4; i++) {
+        for (size_t j=0; j<5; j++) {
+            raster(i,j)=0;
+        }
+    }
+    // Everything is one cluster that wraps both ways.
+    wrapped_clusters same=find_clusters_periodic(raster);
+    BOOST_CHECK_EQUAL(same.clusters.size(),1);
+    BOOST_CHECK(same.wraps[0][0] && same.wraps[0][1]);
+
+    // A vertical line wraps in i. The zeros around it join across the
+    // left and right edges, so they wrap in i but not in j.
+    for (size_t i=0; i<4; i++) {
+        raster(i,2)=1;
+    }
+    wrapped_clusters line=find_clusters_periodic(raster);
+    BOOST_CHECK_EQUAL(line.clusters.size(),2);
+    for (size_t c=0; c<line.wraps.size(); c++) {
+        BOOST_CHECK(line.wraps[c][0]);
+        BOOST_CHECK(!line.wraps[c][1]);
+    }
+    BOOST_CHECK_EQUAL(find_clusters_twopass(raster).size(),3);
+
+    // Two pixels joined only across the edge touch both sides
+    // but do not wrap.
+    for (size_t i=0; i<4; i++) {
+        for (size_t j=0; j<5; j++) {
+            raster(i,j)=(i+j)%2+2;
+        }
+    }
+    raster(1,0)=7;
+    raster(1,4)=7;
+    wrapped_clusters pair=find_clusters_periodic(make_view(raster));
+    size_t found=0;
+    auto wrap=pair.wraps.begin();
+    for (auto cluster=pair.clusters.begin(); cluster!=pair.clusters.end();
+         cluster++, wrap++) {
+        if (raster(cluster->front()/5,cluster->front()%5)==7) {
+            BOOST_CHECK_EQUAL(cluster->size(),2);
+            BOOST_CHECK(!(*wrap)[0] && !(*wrap)[1]);
+            found++;
+        }
+    }
+    BOOST_CHECK_EQUAL(found,1);
+}
+
+
+
+void test_periodic_basis()
+{
+    typedef unsigned char value_type;
+    boost::array<size_t,2> extent;
+    extent[0]=4;
+    extent[1]=4;
+
+    typedef array_basis<size_t> basis_t;
+    basis_t::bounds_type bounds;
+    bounds[0][0]=0;
+    bounds[0][1]=extent[0];
+    bounds[1][0]=0;
+    bounds[1][1]=extent[1];
+    transform_ij tij(extent[0]);
+    typedef transform_map<transform_ij,value_type> map_t;
+    map_t data(tij,extent[0]*extent[1]);
+    // One value per row, with the first and last rows the same.
+    const value_type row_value[4]={1,2,3,1};
+    for (size_t i=0; i<extent[0]; i++) {
+        for (size_t j=0; j<extent[1]; j++) {
+            map_t::key_type k={{i,j}};
+            data[k]=row_value[i];
+        }
+    }
+    typedef AreEqual<map_t::key_type,map_t> comparison_t;
+    comparison_t comparison(data);
+    typedef construct_disjoint_set<basis_t::vertex_type,
+                                   bound_map,
+                                   bound_map> disj_t;
+
+    for (int periodic=0; periodic<2; periodic++) {
+        basis_t basis(bounds,32,periodic!=0);
+        size_t expected=periodic ? 3 : 4;
+
+        union_find_st<disj_t> by_adjacency;
+        by_adjacency(basis,comparison,
+                     make_vertex_iterator<basis_t>,
+                     make_four_adjacent<basis_t>);
+        auto adjacency_clusters=gather_clusters(by_adjacency.rank_pmap_,
+                                                by_adjacency.dset_,extent);
+        BOOST_CHECK_EQUAL(adjacency_clusters->size(),expected);
+
+        union_find_st<disj_t> by_stencil;
+        by_stencil(basis,comparison,stencil_four());
+        auto stencil_clusters=gather_clusters(by_stencil.rank_pmap_,
+                                              by_stencil.dset_,extent);
+        BOOST_CHECK_EQUAL(stencil_clusters->size(),expected);
+    }
+}
+
+
+
+void test_periodic_split()
+{
+    // A periodic basis split for TBB wraps only at edges of the whole.
+    typedef array_basis<size_t> basis_t;
+    typedef basis_t::vertex_type vertex_t;
+    typedef std::pair<vertex_t,vertex_t> pair_t;
+    const size_t side=6;
+    basis_t::bounds_type bounds;
+    bounds[0][0]=0;
+    bounds[0][1]=side;
+    bounds[1][0]=0;
+    bounds[1][1]=side;
+    basis_t whole(bounds,2,true);
+    basis_t first(whole);
+    basis_t second(first,tbb::split());
+
+    auto adjacent=[](const basis_t& basis) {
+        std::set<pair_t> pairs;
+        for (size_t i=basis.bounds_[0][0]; i<basis.bounds_[0][1]; i++) {
+            for (size_t j=basis.bounds_[1][0]; j<basis.bounds_[1][1]; j++) {
+                vertex_t v={{i,j}};
+                auto range=make_four_adjacent(basis,v);
+                for (auto n=range[0]; n!=range[1]; ++n) {
+                    pairs.insert(pair_t(v,*n));
+                }
+            }
+        }
+        return pairs;
+    };
+    auto seams=[](const basis_t& basis) {
+        std::set<pair_t> pairs;
+        stencil_seams<stencil_four>(basis,
+            [&pairs](const vertex_t& v, const vertex_t& n) {
+                pairs.insert(pair_t(v,n));
+            });
+        return pairs;
+    };
+    auto inside=[](const basis_t& basis, const vertex_t& v) {
+        return v[0]>=basis.bounds_[0][0] && v[0]<basis.bounds_[0][1] &&
+            v[1]>=basis.bounds_[1][0] && v[1]<basis.bounds_[1][1];
+    };
+
+    std::set<pair_t> whole_pairs=adjacent(whole);
+    std::set<pair_t> block_pairs=adjacent(first);
+    std::set<pair_t> second_pairs=adjacent(second);
+    block_pairs.insert(second_pairs.begin(),second_pairs.end());
+    BOOST_CHECK_EQUAL(whole_pairs.size(),4*side*side);
+    for (const pair_t& p : whole_pairs) {
+        // Only plain steps between the blocks are left to the join.
+        const size_t di=(p.first[0]>p.second[0]) ? p.first[0]-p.second[0] :
+                                                   p.second[0]-p.first[0];
+        const size_t dj=(p.first[1]>p.second[1]) ? p.first[1]-p.second[1] :
+                                                   p.second[1]-p.first[1];
+        const bool across=inside(first,p.first)!=inside(first,p.second);
+        const bool plain=(di+dj==1);
+        BOOST_CHECK_EQUAL(block_pairs.count(p),!(across && plain));
+    }
+    for (const pair_t& p : block_pairs) {
+        BOOST_CHECK(whole_pairs.count(p));
+    }
+
+    std::set<pair_t> whole_seams=seams(whole);
+    std::set<pair_t> block_seams=seams(first);
+    std::set<pair_t> second_seams=seams(second);
+    block_seams.insert(second_seams.begin(),second_seams.end());
+    BOOST_CHECK_EQUAL(whole_seams.size(),4*side);
+    BOOST_CHECK(block_seams==whole_seams);
+}
+
+
+
+void test_morton3d()
+{
+    size_t a=morton_xyz<1,0,0>::value;
+    BOOST_CHECK_EQUAL(a,1);
+    a=morton_xyz<0,1,0>::value;
+    BOOST_CHECK_EQUAL(a,2);
+    a=morton_xyz<0,0,1>::value;
+    BOOST_CHECK_EQUAL(a,4);
+    a=morton_xyz<0b11,0b10,0b01>::value;
+    BOOST_CHECK_EQUAL(a,0b011101);
+
+    boost::array<size_t,3> extent={{5,6,7}};
+    transform_morton_ijk tr(extent);
+    std::vector<bool> seen(storage_size(tr,extent),false);
+    for (size_t i=0; i<extent[0]; i++) {
+        for (size_t j=0; j<extent[1]; j++) {
+            for (size_t k=0; k<extent[2]; k++) {
+                boost::array<size_t,3> key={{i,j,k}};
+                size_t z=tr(key);
+                BOOST_REQUIRE(z<seen.size());
+                BOOST_CHECK(!seen[z]);
+                seen[z]=true;
+                auto back=morton_calculations::detangle<3,size_t,size_t>(z);
+                BOOST_CHECK(back==key);
+            }
+        }
+    }
+    boost::array<size_t,3> key={{3,2,1}};
+    a=morton_xyz<3,2,1>::value;
+    BOOST_CHECK_EQUAL(tr(key),a);
+}
+
+
+
+//! Serial labeling of a checkerboard volume with the N-dimensional basis.
+template<class STENCIL>
+size_t count_volume_clusters(const boost::array<size_t,3>& extent)
+{
+    typedef nd_basis<size_t,3> basis_t;
+    basis_t::bounds_type bounds;
+    for (size_t d=0; d<3; d++) {
+        bounds[d][0]=0;
+        bounds[d][1]=extent[d];
+    }
+    basis_t basis(bounds);
+
+    transform_ijk tr(extent);
+    typedef transform_map<transform_ijk,unsigned char> map_t;
+    map_t data(tr,storage_size(tr,extent));
+    for (auto v=basis.begin(); v!=basis.end(); ++v) {
+        data[*v]=((*v)[0]+(*v)[1]+(*v)[2])%2;
+    }
+
+    typedef AreEqual<map_t::key_type,map_t> comparison_t;
+    comparison_t comparison(data);
+    typedef construct_disjoint_set<basis_t::vertex_type,
+                                   bound_map,
+                                   bound_map> disj_t;
+    union_find_st<disj_t> ufind;
+    ufind(basis,comparison,
+          make_nd_vertex_iterator<basis_t>,
+          make_nd_adjacent<basis_t,STENCIL>);
+
+    std::set<basis_t::vertex_type> roots;
+    for (auto v=basis.begin(); v!=basis.end(); ++v) {
+        roots.insert(ufind.dset_.find_set(*v));
+    }
+    return roots.size();
+}
+
+
+
+void test_nd_basis()
+{
+    BOOST_CHECK_EQUAL(stencil_six::size,6);
+    BOOST_CHECK_EQUAL(stencil_eighteen::size,18);
+    BOOST_CHECK_EQUAL(stencil_twentysix::size,26);
+    BOOST_CHECK_EQUAL((nd_stencil<2,1>::size),4);
+
+    boost::array<size_t,3> extent={{4,5,3}};
+    // Faces of a checkerboard never match, but edges do.
+    BOOST_CHECK_EQUAL(count_volume_clusters<stencil_six>(extent),60);
+    BOOST_CHECK_EQUAL(count_volume_clusters<stencil_eighteen>(extent),2);
+    BOOST_CHECK_EQUAL(count_volume_clusters<stencil_twentysix>(extent),2);
+}
+
+
+
+void test_nodata()
+{
+    // A river of nodata splits the 1s, and the 0s along
+    // the bottom row are data even though 0 is a common nodata.
+    landscape_t raster(4,20);
+    for (size_t i=0; i<raster.size1(); i++) {
+        for (size_t j=0; j<raster.size2(); j++) {
+            raster(i,j)=(j>=8 && j<17) ? 255 : 1;
+        }
+    }
+    raster(3,0)=0;
+    raster(3,1)=0;
+
+    cluster_t clusters=find_clusters_nodata(raster,255);
+    BOOST_CHECK_EQUAL(clusters.size(),3);
+    size_t pixel_cnt=0;
+    for (auto c=clusters.begin(); c!=clusters.end(); c++) {
+        for (auto p=c->begin(); p!=c->end(); p++) {
+            BOOST_CHECK(raster.data()[*p]!=255);
+            pixel_cnt++;
+        }
+    }
+    BOOST_CHECK_EQUAL(pixel_cnt,4*11);
+
+    // With no nodata pixels, it agrees with the other engines.
+    cluster_t all=find_clusters_nodata(raster,7);
+    cluster_t expected=find_clusters(raster);
+    BOOST_CHECK_EQUAL(all.size(),expected.size());
+
+    // A bottom-up view with a negative stride.
+    landscape_view_t flipped(&raster.data()[3*20],4,20,-20);
+    cluster_t from_view=find_clusters_nodata(flipped,255);
+    BOOST_CHECK_EQUAL(from_view.size(),3);
+
+    landscape_t empty(3,3,255);
+    BOOST_CHECK(find_clusters_nodata(empty,255).empty());
+
+    const unsigned char run[19]={5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,6,5};
+    BOOST_CHECK_EQUAL(skip_value(run,run+19,5)-run,17);
+    BOOST_CHECK_EQUAL(skip_value(run,run+17,5)-run,17);
+    BOOST_CHECK_EQUAL(skip_value(run,run+19,6)-run,0);
+}
+
+
+
+void test_class_groups()
+{
+    // Stripes of three forest codes, beside water.
+    landscape_t raster(30,30);
+    for (size_t i=0; i<raster.size1(); i++) {
+        for (size_t j=0; j<raster.size2(); j++) {
+            raster(i,j)=(j<20) ? 41+(j%3) : 11;
+        }
+    }
+    const arr_type forest[3]={41,42,43};
+    class_lut<arr_type> groups;
+    groups.merge(forest,forest+3);
+    BOOST_CHECK_EQUAL(groups(43),41);
+    BOOST_CHECK_EQUAL(groups(11),11);
+
+    // A later merge takes along everything an earlier one joined.
+    class_lut<arr_type> chained;
+    const arr_type first[2]={1,2};
+    const arr_type second[2]={3,1};
+    chained.merge(first,first+2);
+    chained.merge(second,second+2);
+    BOOST_CHECK_EQUAL(chained(1),3);
+    BOOST_CHECK_EQUAL(chained(2),3);
+    BOOST_CHECK_EQUAL(chained(3),3);
+    BOOST_CHECK_EQUAL(chained(4),4);
+
+    BOOST_CHECK_EQUAL(find_clusters(raster).size(),21);
+    cluster_t grouped=find_clusters_grouped(raster,groups);
+    BOOST_CHECK_EQUAL(grouped.size(),2);
+
+    // The same clusters as rewriting the raster first.
+    landscape_t rewritten(raster);
+    for (size_t i=0; i<rewritten.size1(); i++) {
+        for (size_t j=0; j<rewritten.size2(); j++) {
+            rewritten(i,j)=groups(rewritten(i,j));
+        }
+    }
+    BOOST_CHECK(find_clusters(rewritten)==grouped);
+    BOOST_CHECK(find_clusters_grouped(make_view(raster),groups)==grouped);
+
+    // The compare policy in the generic union-find.
+    typedef array_basis<size_t> basis_t;
+    basis_t::bounds_type bounds;
+    bounds[0][0]=0;
+    bounds[0][1]=raster.size1();
+    bounds[1][0]=0;
+    bounds[1][1]=raster.size2();
+    basis_t basis(bounds,8);
+    landscape_view_t view(raster);
+    typedef SameGroup<basis_t::vertex_type,landscape_view_t> comparison_t;
+    comparison_t comparison(view,groups);
+    typedef construct_disjoint_set<basis_t::vertex_type,
+                                   bound_map,
+                                   bound_map> disj_t;
+    union_find_st<disj_t> ufind;
+    ufind(basis,comparison,stencil_four());
+    boost::array<size_t,2> extent={{raster.size1(),raster.size2()}};
+    auto clusters = gather_clusters(ufind.rank_pmap_,ufind.dset_,extent);
+    BOOST_CHECK_EQUAL(clusters->size(),2);
+}
+
+
+
+void test_window()
+{
+    landscape_t raster(40,50);
+    for (size_t i=0; i<raster.size1(); i++) {
+        for (size_t j=0; j<raster.size2(); j++) {
+            raster(i,j)=((i/3)*7+(j/4)*3)%5;
+        }
+    }
+    boost::array<boost::array<size_t,2>,2> bounds={{ {{5,27}}, {{11,44}} }};
+    landscape_t copy(bounds[0][1]-bounds[0][0],bounds[1][1]-bounds[1][0]);
+    for (size_t i=0; i<copy.size1(); i++) {
+        for (size_t j=0; j<copy.size2(); j++) {
+            copy(i,j)=raster(bounds[0][0]+i,bounds[1][0]+j);
+        }
+    }
+
+    landscape_view_t window=make_window(raster,bounds);
+    BOOST_CHECK_EQUAL(window.size1(),copy.size1());
+    BOOST_CHECK_EQUAL(window.size2(),copy.size2());
+    BOOST_CHECK(find_clusters(window)==find_clusters(copy));
+    BOOST_CHECK(find_clusters_twopass(window)==find_clusters_twopass(copy));
+    BOOST_CHECK(find_clusters_remap(window)==find_clusters_remap(copy));
+    BOOST_CHECK(find_clusters_nodata(window,4)==find_clusters_nodata(copy,4));
+    BOOST_CHECK(find_clusters_periodic(window).clusters==
+                find_clusters_periodic(copy).clusters);
+
+    // A window of a window, and labels mapped back to the raster.
+    boost::array<boost::array<size_t,2>,2> inner={{ {{2,4}}, {{3,6}} }};
+    landscape_view_t nested=make_window(window,inner);
+    BOOST_CHECK_EQUAL(nested(1,2),raster(8,16));
+    BOOST_CHECK_EQUAL(window_index(bounds,raster.size2(),copy.size2()+1),
+                      6*raster.size2()+12);
+
+    boost::array<boost::array<size_t,2>,2> outside={{ {{0,41}}, {{0,5}} }};
+    BOOST_CHECK_THROW(make_window(raster,outside),std::runtime_error);
+}
+
+
+
+void test_tolerance()
+{
+    // A gentle slope, then a cliff, with a hole of missing data.
+    float_landscape_t elevation(12,10);
+    for (size_t i=0; i<elevation.size1(); i++) {
+        for (size_t j=0; j<elevation.size2(); j++) {
+            elevation(i,j)=0.1f*j+((j>=6) ? 10.0f : 0.0f);
+        }
+    }
+    BOOST_CHECK_EQUAL(find_clusters_tolerance(elevation,0.15f).size(),2);
+    BOOST_CHECK_EQUAL(find_clusters_tolerance(elevation,0.05f).size(),10);
+    BOOST_CHECK_EQUAL(find_clusters_tolerance(elevation,20.0f).size(),1);
+    BOOST_CHECK(find_clusters_tolerance(make_view(elevation),0.15f)==
+                find_clusters_tolerance(elevation,0.15f));
+
+    // NaN is close to nothing, so it stands alone.
+    elevation(4,2)=std::numeric_limits<float>::quiet_NaN();
+    BOOST_CHECK_EQUAL(find_clusters_tolerance(elevation,0.15f).size(),3);
+
+    std::vector<float> edges={0.25f,5.0f};
+    BOOST_CHECK_EQUAL(find_clusters_binned(elevation,edges).size(),4);
+    std::vector<float> unsorted={5.0f,0.25f};
+    BOOST_CHECK_THROW(find_clusters_binned(elevation,unsorted),std::runtime_error);
+
+    // The same relation as a compare policy for the generic union-find.
+    elevation(4,2)=0.2f;
+    typedef array_basis<size_t> basis_t;
+    basis_t::bounds_type bounds;
+    bounds[0][0]=0;
+    bounds[0][1]=elevation.size1();
+    bounds[1][0]=0;
+    bounds[1][1]=elevation.size2();
+    basis_t basis(bounds,4);
+    float_view_t view(elevation);
+    typedef AreSimilar<basis_t::vertex_type,float_view_t,
+                       tolerance_kernel<float> > comparison_t;
+    comparison_t comparison(view,tolerance_kernel<float>(0.15f));
+    typedef construct_disjoint_set<basis_t::vertex_type,
+                                   bound_map,
+                                   bound_map> disj_t;
+    union_find_st<disj_t> ufind;
+    ufind(basis,comparison,stencil_four());
+    boost::array<size_t,2> extent={{elevation.size1(),elevation.size2()}};
+    auto clusters = gather_clusters(ufind.rank_pmap_,ufind.dset_,extent);
+    BOOST_CHECK_EQUAL(clusters->size(),2);
+}
+
+
+
+void test_bands()
+{
+    std::vector<landscape_t> bands(3,landscape_t(37,41));
+    landscape_t combined(37,41);
+    for (size_t i=0; i<combined.size1(); i++) {
+        for (size_t j=0; j<combined.size2(); j++) {
+            bands[0](i,j)=(i/5+j/7)%3;
+            bands[1](i,j)=(i/9)%2;
+            bands[2](i,j)=(j/3+i/11)%4;
+            combined(i,j)=bands[0](i,j)*8+bands[1](i,j)*4+bands[2](i,j);
+        }
+    }
+    cluster_t expected=find_clusters(combined);
+    BOOST_CHECK(find_clusters_bands(bands)==expected);
+
+    std::vector<landscape_view_t> views;
+    for (size_t b=0; b<bands.size(); b++) {
+        views.push_back(make_view(bands[b]));
+    }
+    BOOST_CHECK(find_clusters_bands(views)==expected);
+
+    // One band is the ordinary engine.
+    std::vector<landscape_t> single(1,bands[2]);
+    BOOST_CHECK(find_clusters_bands(single)==find_clusters(bands[2]));
+
+    bands.push_back(landscape_t(3,3));
+    BOOST_CHECK_THROW(find_clusters_bands(bands),std::runtime_error);
+    BOOST_CHECK_THROW(find_clusters_bands(std::vector<landscape_t>()),
+                      std::runtime_error);
+}
+
+
+
+void test_class16()
+{
+    // Classes 44 and 300 share their low byte, so only a 16-bit engine
+    // keeps them apart.
+    class16_landscape_t raster(29,34);
+    landscape_t narrow(29,34);
+    for (size_t i=0; i<raster.size1(); i++) {
+        for (size_t j=0; j<raster.size2(); j++) {
+            const size_t k=(i/4+j/5)%3;
+            raster(i,j)=(k==0) ? 44 : ((k==1) ? 300 : 1000);
+            narrow(i,j)=k;
+        }
+    }
+    cluster_t expected=find_clusters(narrow);
+    BOOST_CHECK(find_clusters(raster)==expected);
+    BOOST_CHECK(find_clusters(make_view(raster))==expected);
+    BOOST_CHECK(find_clusters_twopass(raster)==find_clusters_twopass(narrow));
+    BOOST_CHECK(find_clusters_twopass(make_view(raster))==
+                find_clusters_twopass(narrow));
+
+    std::vector<class16_landscape_t> bands(2,raster);
+    std::vector<landscape_t> narrow_bands(2,narrow);
+    for (size_t i=0; i<raster.size1(); i++) {
+        bands[1](i,0)=narrow_bands[1](i,0)=7;
+    }
+    BOOST_CHECK(find_clusters_bands(bands)==find_clusters_bands(narrow_bands));
+    std::vector<class16_view_t> views;
+    for (size_t b=0; b<bands.size(); b++) {
+        views.push_back(make_view(bands[b]));
+    }
+    BOOST_CHECK(find_clusters_bands(views)==find_clusters_bands(narrow_bands));
+}
+
+
+
+void test_replicated()
+{
+    landscape_t source(7,5);
+    for (size_t i=0; i<source.size1(); i++) {
+        for (size_t j=0; j<source.size2(); j++) {
+            source(i,j)=(i/2+j/3)%3;
+        }
+    }
+    boost::array<size_t,2> ns={{23,17}};
+    auto whole=resize_replicate(std::make_shared<landscape_t>(source),ns);
+    replicated_landscape_t replicated=make_replicated(source,ns);
+    BOOST_REQUIRE_EQUAL(replicated.size1(),23);
+    BOOST_REQUIRE_EQUAL(replicated.size2(),17);
+
+    std::vector<unsigned char> row(17);
+    for (size_t i=0; i<ns[0]; i++) {
+        replicated.copy_row(i,&row[0]);
+        for (size_t j=0; j<ns[1]; j++) {
+            BOOST_CHECK_EQUAL(replicated(i,j),(*whole)(i,j));
+            BOOST_CHECK_EQUAL(row[j],(*whole)(i,j));
+        }
+    }
+
+    BOOST_CHECK(find_clusters(replicated)==find_clusters(*whole));
+    BOOST_CHECK(find_clusters_twopass(replicated)==find_clusters_twopass(*whole));
+    BOOST_CHECK(*find_clusters_pointer(replicated)==*find_clusters_pointer(*whole));
+    BOOST_CHECK(find_clusters_remap(replicated)==find_clusters_remap(*whole));
+    wrapped_clusters periodic=find_clusters_periodic(replicated);
+    BOOST_CHECK(periodic.clusters==find_clusters_periodic(*whole).clusters);
+
+    BOOST_CHECK(uniform_region(replicated,7,9,5,7));
+    BOOST_CHECK(!uniform_region(replicated,0,7,0,17));
+    BOOST_CHECK_EQUAL(uniform_region(replicated,0,2,3,7),
+                      uniform_region(*whole,0,2,3,7));
+    BOOST_CHECK_THROW(make_replicated(landscape_t(0,0),ns),std::runtime_error);
+}
+
+
+
+void test_hdf_raster()
+{
+    namespace ublas=boost::numeric::ublas;
+    landscape_t raster(45,38);
+    for (size_t i=0; i<raster.size1(); i++) {
+        for (size_t j=0; j<raster.size2(); j++) {
+            raster(i,j)=(i/6+j/5)%3;
+        }
+    }
+    cluster_t clusters=find_clusters(raster);
+    // 16-bit classes, as read_tiff_bands gives them.
+    class16_landscape_t classes(45,38);
+    for (size_t k=0; k<classes.data().size(); k++) {
+        classes.data()[k]=1000+k%7;
+    }
+    test_directory directory;
+    const std::string filename=directory.file("hdf_raster_test.h5");
+    {
+        raster_file out(filename,true);
+        out.create_raster<arr_type>("/landscape",45,38,16);
+        // Write in bands, as a pipeline would, then a band out of order.
+        for (size_t row=0; row<30; row+=10) {
+            landscape_t band=ublas::project(raster,ublas::range(row,row+10),
+                                            ublas::range(0,38));
+            out.write_rows("/landscape",band,row);
+        }
+        landscape_t last=ublas::project(raster,ublas::range(40,45),
+                                        ublas::range(0,38));
+        out.write_rows("/landscape",last,40);
+        BOOST_CHECK_EQUAL(out.rows_written("/landscape"),30);
+        landscape_t gap=ublas::project(raster,ublas::range(30,40),
+                                       ublas::range(0,38));
+        out.write_rows("/landscape",gap,30);
+        // Rows written out of order are not counted until rewritten.
+        BOOST_CHECK_EQUAL(out.rows_written("/landscape"),40);
+        out.write_rows("/landscape",last,40);
+        BOOST_CHECK_EQUAL(out.rows_written("/landscape"),45);
+        BOOST_CHECK_THROW(out.write_rows("/landscape",gap,40),std::runtime_error);
+
+        out.write_raster("/labels",cluster_labels(clusters,45,38));
+        out.write_raster("/classes",classes);
+        out.write_clusters("/clusters",clusters);
+        out.write_clusters("/none",cluster_t());
+    }
+
+    raster_file in(filename,false);
+    auto landscape=in.read_raster<arr_type>("/landscape");
+    BOOST_REQUIRE_EQUAL(landscape->size1(),45);
+    BOOST_REQUIRE_EQUAL(landscape->size2(),38);
+    BOOST_CHECK(std::equal(raster.data().begin(),raster.data().end(),
+                           landscape->data().begin()));
+    auto labels=in.read_raster<uint32_t>("/labels");
+    label_landscape_t expected=cluster_labels(clusters,45,38);
+    BOOST_CHECK(std::equal(expected.data().begin(),expected.data().end(),
+                           labels->data().begin()));
+    auto classes_read=in.read_raster<uint16_t>("/classes");
+    BOOST_CHECK(std::equal(classes.data().begin(),classes.data().end(),
+                           classes_read->data().begin()));
+    BOOST_CHECK(in.read_clusters("/clusters")==clusters);
+    BOOST_CHECK(in.read_clusters("/none").empty());
+
+    size_t rows_seen=0;
+    in.for_each_band<arr_type>("/landscape",7,
+        [&](const landscape_t& band, size_t first_row) {
+            BOOST_CHECK_EQUAL(first_row,rows_seen);
+            for (size_t i=0; i<band.size1(); i++) {
+                for (size_t j=0; j<band.size2(); j++) {
+                    BOOST_CHECK_EQUAL(band(i,j),raster(first_row+i,j));
+                }
+            }
+            rows_seen+=band.size1();
+        });
+    BOOST_CHECK_EQUAL(rows_seen,45);
+    BOOST_CHECK_THROW(in.for_each_band<arr_type>("/landscape",0,
+        [](const landscape_t&, size_t) {}),std::runtime_error);
+}
+
+
+
+void test_raster_hash()
+{
+    // XXH64 reference values, fed whole and in pieces.
+    unsigned char bytes[100];
+    for (size_t k=0; k<100; k++) {
+        bytes[k]=k;
+    }
+    BOOST_CHECK_EQUAL(xxh64().digest(),0xef46db3751d8e999ULL);
+    xxh64 whole;
+    whole.update(bytes,100);
+    BOOST_CHECK_EQUAL(whole.digest(),0x6ac1e58032166597ULL);
+    xxh64 pieces;
+    for (size_t k=0; k<100; k+=7) {
+        pieces.update(bytes+k,std::min<size_t>(7,100-k));
+    }
+    BOOST_CHECK_EQUAL(pieces.digest(),whole.digest());
+
+    landscape_t raster(70,45);
+    for (size_t i=0; i<raster.size1(); i++) {
+        for (size_t j=0; j<raster.size2(); j++) {
+            raster(i,j)=(i*3+j*5)%7;
+        }
+    }
+    raster_tile_hashes before=hash_tiles(raster,16);
+    BOOST_CHECK_EQUAL(before.tiles1,5);
+    BOOST_CHECK_EQUAL(before.tiles2,3);
+    BOOST_CHECK_EQUAL(before.tiles.size(),15);
+    BOOST_CHECK_EQUAL(raster_hash(raster),hash_tiles(raster).raster);
+    BOOST_CHECK(hash_tiles(raster,32).raster!=before.raster);
+
+    // A window hashes the same as a copy of its pixels.
+    boost::array<boost::array<size_t,2>,2> bounds={{ {{5,40}}, {{3,30}} }};
+    landscape_view_t window=make_view(raster).window(bounds);
+    landscape_t copy(35,27);
+    for (size_t i=0; i<copy.size1(); i++) {
+        for (size_t j=0; j<copy.size2(); j++) {
+            copy(i,j)=window(i,j);
+        }
+    }
+    BOOST_CHECK_EQUAL(raster_hash(window),raster_hash(copy));
+
+    // Only the tile with the changed pixel changes.
+    raster(40,20)++;
+    raster_tile_hashes after=hash_tiles(raster,16);
+    BOOST_CHECK(after.raster!=before.raster);
+    for (size_t t=0; t<after.tiles.size(); t++) {
+        BOOST_CHECK_EQUAL(after.tiles[t]!=before.tiles[t], t==2*3+1);
+    }
+    BOOST_CHECK_THROW(hash_tiles(raster,0),std::runtime_error);
+}
+
+
+
+void test_cluster_cache()
+{
+    landscape_t raster(23,31);
+    for (size_t i=0; i<raster.size1(); i++) {
+        for (size_t j=0; j<raster.size2(); j++) {
+            raster(i,j)=(i/4+j/6)%3;
+        }
+    }
+    cluster_t expected=find_clusters(raster);
+    const uint64_t hash=raster_hash(raster);
+    BOOST_CHECK_EQUAL(raster_hash(make_view(raster)),hash);
+    test_directory directory;
+
+    size_t engine_runs=0;
+    cluster_engine_t counting=[&](const landscape_view_t& r) {
+        engine_runs++;
+        return find_clusters(r);
+    };
+    auto first=find_clusters_cached(make_view(raster),directory.path,
+                                    "find_clusters",counting);
+    auto second=find_clusters_cached(make_view(raster),directory.path,
+                                     "find_clusters",counting);
+    BOOST_CHECK_EQUAL(engine_runs,1);
+    BOOST_CHECK(second->clusters()==expected);
+    BOOST_CHECK_EQUAL(second->cluster_cnt(),expected.size());
+    BOOST_CHECK_EQUAL(second->header().size1,23);
+    BOOST_CHECK_EQUAL(second->header().connectivity,4);
+
+    label_landscape_t labels=cluster_labels(expected,23,31);
+    raster_view<uint32_t> cached_labels=second->labels();
+    size_t k=0;
+    for (const auto& cluster : expected) {
+        BOOST_CHECK_EQUAL(second->sizes()[k],cluster.size());
+        k++;
+    }
+    for (size_t i=0; i<raster.size1(); i++) {
+        for (size_t j=0; j<raster.size2(); j++) {
+            BOOST_CHECK_EQUAL(cached_labels(i,j),labels(i,j));
+        }
+    }
+
+    // A different raster is a different file.
+    raster(0,0)=7;
+    auto changed=find_clusters_cached(make_view(raster),directory.path,
+                                      "find_clusters",counting);
+    BOOST_CHECK_EQUAL(engine_runs,2);
+    BOOST_CHECK(changed->header().raster_hash!=hash);
+    BOOST_CHECK(find_clusters_cached(raster,directory.path)->clusters()==
+                find_clusters(raster));
+
+    // The same engine joining other neighbors is run again.
+    auto eight=find_clusters_cached(make_view(raster),directory.path,
+                                    "find_clusters",counting,8);
+    BOOST_CHECK_EQUAL(engine_runs,3);
+    BOOST_CHECK_EQUAL(eight->header().connectivity,8);
+
+    // An engine name cannot make the file land outside the directory.
+    BOOST_CHECK_THROW(cluster_cache_name(directory.path,hash,"../escape"),
+                      std::runtime_error);
+    BOOST_CHECK_THROW(find_clusters_cached(make_view(raster),directory.path,
+                                           "a/b",counting),
+                      std::runtime_error);
+    BOOST_CHECK_EQUAL(engine_runs,3);
+}
+
+
+
+void test_raster_pyramid()
+{
+    landscape_t raster(37,29);
+    for (size_t i=0; i<raster.size1(); i++) {
+        for (size_t j=0; j<raster.size2(); j++) {
+            raster(i,j)=(i*i+3*j+i*j/5)%6;
+        }
+    }
+    std::vector<unsigned char> classes={2,5,9};
+    raster_pyramid pyramid=build_pyramid(raster,classes);
+    // 37x29, 19x15, 10x8, 5x4, 3x2, 2x1, 1x1
+    BOOST_REQUIRE_EQUAL(pyramid.levels(),7);
+    BOOST_CHECK(std::equal(raster.data().begin(),raster.data().end(),
+                           pyramid.mode[0].data().begin()));
+    BOOST_CHECK(pyramid.presence[0].data().empty());
+
+    for (size_t level=1; level<pyramid.levels(); level++) {
+        const landscape_t& below=pyramid.mode[level-1];
+        const landscape_t& mode=pyramid.mode[level];
+        const presence_landscape_t& presence=pyramid.presence[level];
+        BOOST_REQUIRE_EQUAL(mode.size1(),(below.size1()+1)/2);
+        BOOST_REQUIRE_EQUAL(mode.size2(),(below.size2()+1)/2);
+        BOOST_REQUIRE_EQUAL(presence.size1(),mode.size1());
+        const size_t side=size_t(1)<<level;
+        for (size_t i=0; i<mode.size1(); i++) {
+            for (size_t j=0; j<mode.size2(); j++) {
+                // The mode of the pixels in the box below, smallest first.
+                std::map<int,int> counts;
+                for (size_t bi=2*i; bi<std::min(2*i+2,below.size1()); bi++) {
+                    for (size_t bj=2*j; bj<std::min(2*j+2,below.size2()); bj++) {
+                        counts[below(bi,bj)]++;
+                    }
+                }
+                int best=counts.begin()->first;
+                for (const auto& count : counts) {
+                    if (count.second>counts[best]) {
+                        best=count.first;
+                    }
+                }
+                BOOST_CHECK_EQUAL(mode(i,j),best);
+
+                // The classes anywhere in the box of the raster.
+                uint64_t mask=0;
+                for (size_t ri=i*side; ri<std::min((i+1)*side,raster.size1()); ri++) {
+                    for (size_t rj=j*side; rj<std::min((j+1)*side,raster.size2()); rj++) {
+                        for (size_t b=0; b<classes.size(); b++) {
+                            if (raster(ri,rj)==classes[b]) {
+                                mask|=uint64_t(1)<<b;
+                            }
+                        }
+                    }
+                }
+                BOOST_CHECK_EQUAL(presence(i,j),mask);
+            }
+        }
+    }
+    std::vector<size_t> counts=box_counts(pyramid,0);
+    BOOST_CHECK_EQUAL(counts[0],std::count(raster.data().begin(),
+                                           raster.data().end(),2));
+    BOOST_CHECK_EQUAL(counts.back(),1);
+    BOOST_CHECK(box_counts(pyramid,2)==std::vector<size_t>(7,0));
+    BOOST_CHECK_THROW(box_counts(pyramid,3),std::runtime_error);
+    BOOST_CHECK_EQUAL(build_pyramid(raster,classes,3).levels(),3);
+    // Asking for more levels than 37x29 has still stops at one pixel.
+    raster_pyramid deep=build_pyramid(raster,classes,20);
+    BOOST_REQUIRE_EQUAL(deep.levels(),7);
+    BOOST_CHECK_EQUAL(deep.mode.back().size1(),1);
+    BOOST_CHECK_EQUAL(deep.mode.back().size2(),1);
+    landscape_t pixel(1,1,4);
+    BOOST_CHECK_EQUAL(build_pyramid(pixel,classes,5).levels(),1);
+    BOOST_CHECK(build_pyramid(raster).presence[1].data().empty());
+
+    // On a tie of two and two, the smaller wins.
+    landscape_t tie(2,2);
+    tie(0,0)=7; tie(0,1)=4; tie(1,0)=4; tie(1,1)=7;
+    BOOST_CHECK_EQUAL(downsample_mode(make_view(tie))(0,0),4);
+
+    test_directory directory;
+    write_pyramid_file(directory.file("pyramid_test.pyr"),pyramid);
+    mapped_pyramid mapped(directory.file("pyramid_test.pyr"));
+    BOOST_REQUIRE_EQUAL(mapped.levels(),pyramid.levels());
+    BOOST_CHECK(mapped.classes()==classes);
+    BOOST_CHECK_EQUAL(mapped.presence(0).size1(),0);
+    {
+        raster_file out(directory.file("pyramid_test.h5"),true);
+        out.write_pyramid("/pyramid",pyramid);
+    }
+    raster_file in(directory.file("pyramid_test.h5"),false);
+    raster_pyramid read=in.read_pyramid("/pyramid");
+    BOOST_REQUIRE_EQUAL(read.levels(),pyramid.levels());
+    BOOST_CHECK(read.classes==classes);
+    for (size_t level=0; level<pyramid.levels(); level++) {
+        const landscape_t& mode=pyramid.mode[level];
+        const presence_landscape_t& presence=pyramid.presence[level];
+        landscape_view_t mapped_mode=mapped.mode(level);
+        BOOST_REQUIRE_EQUAL(mapped_mode.size1(),mode.size1());
+        BOOST_REQUIRE_EQUAL(mapped_mode.size2(),mode.size2());
+        BOOST_CHECK(std::equal(mode.data().begin(),mode.data().end(),
+                               read.mode[level].data().begin()));
+        BOOST_CHECK(std::equal(presence.data().begin(),presence.data().end(),
+                               read.presence[level].data().begin()));
+        for (size_t i=0; i<mode.size1(); i++) {
+            for (size_t j=0; j<mode.size2(); j++) {
+                BOOST_CHECK_EQUAL(mapped_mode(i,j),mode(i,j));
+                if (level>0) {
+                    BOOST_CHECK_EQUAL(mapped.presence(level)(i,j),presence(i,j));
+                }
+            }
+        }
+    }
+}
+
+
+
 bool init_function( )
 {
   BOOST_TEST_MESSAGE("Loading from 34418039.tif");
@@ -485,12 +1693,32 @@ bool init_function( )
   framework::master_test_suite().add( BOOST_TEST_CASE( test_transform_coverage));
   framework::master_test_suite().add( BOOST_TEST_CASE( test_blocked_coverage ));
   framework::master_test_suite().add( BOOST_TEST_CASE( test_full_blocked ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_static_blocked ) );
   framework::master_test_suite().add( BOOST_TEST_CASE( test_morton ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_hilbert ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_hilbert_adjacent ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_morton3d ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_nd_basis ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_nodata ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_class_groups ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_window ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_tolerance ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_bands ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_class16 ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_replicated ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_hdf_raster ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_raster_hash ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_cluster_cache ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_raster_pyramid ) );
   framework::master_test_suite().add( BOOST_TEST_CASE( test_bits ) );
   framework::master_test_suite().add( BOOST_TEST_CASE( test_bit_shift ) );
   framework::master_test_suite().add( BOOST_TEST_CASE( test_tiny_grid ) );
   framework::master_test_suite().add( BOOST_TEST_CASE( test_grid_basis ) );
   framework::master_test_suite().add( BOOST_TEST_CASE( test_generic_single ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_generic_single_pmr ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_vertex_index ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_stencil ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_generic_stencil ) );
   framework::master_test_suite().add( BOOST_TEST_CASE( test_generic_blocked ) );
   framework::master_test_suite().add( BOOST_TEST_CASE( test_generic_full ) );
   framework::master_test_suite().add( BOOST_TEST_CASE( test_unique_values ) );
@@ -502,6 +1730,11 @@ bool init_function( )
   framework::master_test_suite().add( BOOST_TEST_CASE( known_many_pair ) );
   framework::master_test_suite().add( BOOST_TEST_CASE( known_single_remap ) );
   framework::master_test_suite().add( BOOST_TEST_CASE( known_many_remap ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( known_many_view ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( known_many_arena ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_periodic_wraps ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_periodic_basis ) );
+  framework::master_test_suite().add( BOOST_TEST_CASE( test_periodic_split ) );
   return true;
 }
 
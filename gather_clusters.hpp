@@ -4,35 +4,79 @@
 #include <map>
 #include <list>
 #include <memory>
+#include <memory_resource>
+#include <iterator>
+#include <algorithm>
+#include <boost/array.hpp>
 #include "raster.hpp"
 
 namespace raster_stats {
 
-template<typename parent_map, typename disjoint_set>
-  std::shared_ptr<cluster_t> gather_clusters(parent_map& parent,
-                                        disjoint_set& dset,
-                                        size_t icnt, size_t jcnt)
+/*! Append one list per set to clusters. CLUSTERS is any list of lists
+ *  of size_t, so it may be cluster_t or cluster_pmr_t, whose nodes
+ *  come from a memory resource of the caller's choosing.
+ *  INDEX is the key type of the disjoint set.
+ *  The temporary map comes from scratch.
+ */
+template<typename INDEX=size_t, typename disjoint_set, typename CLUSTERS>
+void gather_clusters_into(CLUSTERS& clusters, disjoint_set& dset,
+                          size_t icnt, size_t jcnt,
+                          std::pmr::memory_resource* scratch)
 {
   // At this point, each element points to a parent.
-  // The return value is a list of lists of elements.
   // The temporary map will associate a parent with the list of its children.
-  std::shared_ptr<cluster_t> clusters(new cluster_t); // a list of lists
-
-  typedef std::map<size_t,cluster_t::iterator> ptl_t;
-  ptl_t parent_to_list; // The map from parent to list of children.
+  typedef std::pmr::map<INDEX,typename CLUSTERS::iterator> ptl_t;
+  ptl_t parent_to_list(scratch); // The map from parent to list of children.
 
-  for (size_t pull=0; pull<icnt*jcnt; pull++) {
-    size_t parent = dset.find_set(pull);
-    ptl_t::iterator plist = parent_to_list.find(parent);
+  const INDEX pixel_cnt=icnt*jcnt;
+  for (INDEX pull=0; pull<pixel_cnt; pull++) {
+    INDEX parent = dset.find_set(pull);
+    typename ptl_t::iterator plist = parent_to_list.find(parent);
     if (plist==parent_to_list.end()) {
-      cluster_t::iterator nlist = clusters->insert(clusters->end(),
-                                                   std::list<size_t>());
-      parent_to_list[parent]=nlist;
+      clusters.emplace_back();
+      typename CLUSTERS::iterator nlist = std::prev(clusters.end());
+      parent_to_list.emplace(parent,nlist);
       nlist->push_back(pull);
     } else {
       plist->second->push_back(pull);
     }
   }
+}
+
+
+
+/*! A raster of cluster numbers from a list of lists of pixel indices.
+ *  The first cluster is 1, so that 0 marks pixels in no cluster,
+ *  such as those left out as nodata.
+ */
+template<typename CLUSTERS>
+label_landscape_t cluster_labels(const CLUSTERS& clusters,
+                                 size_t icnt, size_t jcnt)
+{
+  label_landscape_t labels(icnt,jcnt);
+  std::fill(labels.data().begin(),labels.data().end(),0);
+  uint32_t label=0;
+  for (const auto& cluster : clusters) {
+    label++;
+    for (size_t pixel : cluster) {
+      labels.data()[pixel]=label;
+    }
+  }
+  return labels;
+}
+
+
+
+template<typename parent_map, typename disjoint_set>
+  std::shared_ptr<cluster_t> gather_clusters(parent_map& parent,
+                                        disjoint_set& dset,
+                                        size_t icnt, size_t jcnt,
+        std::pmr::memory_resource* scratch=std::pmr::get_default_resource())
+{
+  // The return value is a list of lists of elements.
+  std::shared_ptr<cluster_t> clusters(new cluster_t); // a list of lists
+  gather_clusters_into<typename parent_map::key_type>(*clusters, dset,
+                                                     icnt, jcnt, scratch);
   return clusters;
 }
 
@@ -42,7 +86,8 @@ template<typename parent_map, typename disjoint_set>
 std::shared_ptr<std::list<std::list<typename parent_map::key_type>>>
 gather_clusters(parent_map& parent,
                 disjoint_set& dset,
-                boost::array<size_t,2> dim)
+                boost::array<size_t,2> dim,
+        std::pmr::memory_resource* scratch=std::pmr::get_default_resource())
 {
     // At this point, each element points to a parent.
     // The return value is a list of lists of elements.
@@ -51,8 +96,8 @@ gather_clusters(parent_map& parent,
     typedef std::list<std::list<loc_t>> clus_t;
     auto clusters = std::make_shared<clus_t>(); // a list of lists
 
-    typedef std::map<loc_t,typename clus_t::iterator> ptl_t;
-    ptl_t parent_to_list; // The map from parent to list of children.
+    typedef std::pmr::map<loc_t,typename clus_t::iterator> ptl_t;
+    ptl_t parent_to_list(scratch); // The map from parent to list of children.
     
     for (size_t i=0; i<dim[0]; i++) {
         for (size_t j=0; j<dim[1]; j++) {
@@ -1,8 +1,12 @@
 #ifndef _GRID2D_H_
 #define _GRID2D_H_
 
+#include <cassert>
+#include <iostream>
 #include <boost/array.hpp>
+#include <boost/iterator/iterator_facade.hpp>
 #include "tbb/blocked_range2d.h"
+#include "vertex_index.hpp"
 
 
 namespace raster_stats {
@@ -23,12 +27,19 @@ namespace raster_stats {
         const vertex_type& center_;
         vertex_type neighbor_;
         int direction_;
+        bool periodic_;
     public:
+        /*! If periodic, a vertex on an edge of the bounds that is also
+         *  an edge of the whole neighbors the vertex on the opposite edge
+         *  of the whole, which may lie outside the bounds. Edges the
+         *  bounds share with other blocks do not wrap.
+         */
         four_adjacent_iterator(const bounds_type& whole,
                                const bounds_type& bounds,
-                               const vertex_type& loc, int direction)
+                               const vertex_type& loc, int direction,
+                               bool periodic=false)
             : whole_(whole),bounds_(bounds), center_(loc),
-              direction_(direction) {
+              direction_(direction), periodic_(periodic) {
             increment();
         }
         friend class boost::iterator_core_access;
@@ -40,24 +51,36 @@ namespace raster_stats {
                     if (center_[1]!=bounds_[1][1]-1) {
                         set_neighbor(center_[0],center_[1]+1);
                         return;
+                    } else if (periodic_ && center_[1]==whole_[1][1]-1) {
+                        set_neighbor(center_[0],whole_[1][0]);
+                        return;
                     }
                     break;
                 case 1:
                     if (center_[0]!=bounds_[0][1]-1) {
                         set_neighbor(center_[0]+1,center_[1]);
                         return;
+                    } else if (periodic_ && center_[0]==whole_[0][1]-1) {
+                        set_neighbor(whole_[0][0],center_[1]);
+                        return;
                     }
                     break;
                 case 2:
                     if (center_[1]!=bounds_[1][0]) {
                         set_neighbor(center_[0],center_[1]-1);
                         return;
+                    } else if (periodic_ && center_[1]==whole_[1][0]) {
+                        set_neighbor(center_[0],whole_[1][1]-1);
+                        return;
                     }
                     break;
                 case 3:
                     if (center_[0]!=bounds_[0][0]) {
                         set_neighbor(center_[0]-1,center_[1]);
                         return;
+                    } else if (periodic_ && center_[0]==whole_[0][0]) {
+                        set_neighbor(whole_[0][1]-1,center_[1]);
+                        return;
                     }
                     break;
                 default:
@@ -86,6 +109,177 @@ namespace raster_stats {
 
 
 
+    /*! Neighbor offsets for 4-connectivity, as (di,dj).
+     *  The first causal entries are the neighbors that a row-major
+     *  sweep has already visited, so a union-find needs only those.
+     */
+    struct stencil_four
+    {
+        static constexpr int size=4;
+        static constexpr int causal=2;
+        static constexpr int offsets[size][2]={
+            {0,-1},{-1,0},
+            {0,1},{1,0}};
+    };
+
+
+
+    //! Neighbor offsets for 8-connectivity, causal half first.
+    struct stencil_eight
+    {
+        static constexpr int size=8;
+        static constexpr int causal=4;
+        static constexpr int offsets[size][2]={
+            {0,-1},{-1,-1},{-1,0},{-1,1},
+            {0,1},{1,1},{1,0},{1,-1}};
+    };
+
+
+
+    /*! Calls neighbor(v,n) for offsets FIRST to LAST of the stencil
+     *  without checking bounds. The loop has a fixed count, so the
+     *  compiler unrolls it.
+     */
+    template<class STENCIL,int FIRST,int LAST,class VT,class NEIGHBOR>
+    inline void stencil_interior(const VT& v, NEIGHBOR& neighbor)
+    {
+        for (int k=FIRST; k<LAST; k++) {
+            VT n;
+            n[0]=v[0]+STENCIL::offsets[k][0];
+            n[1]=v[1]+STENCIL::offsets[k][1];
+            neighbor(v,n);
+        }
+    }
+
+
+
+    /*! The same for a vertex on the edge of bounds, skipping neighbors
+     *  outside it. Unsigned coordinates wrap below zero, which the
+     *  upper-bound test catches.
+     */
+    template<class STENCIL,int FIRST,int LAST,class VT,class BT,class NEIGHBOR>
+    inline void stencil_border(const VT& v, const BT& bounds, NEIGHBOR& neighbor)
+    {
+        for (int k=FIRST; k<LAST; k++) {
+            VT n;
+            n[0]=v[0]+STENCIL::offsets[k][0];
+            n[1]=v[1]+STENCIL::offsets[k][1];
+            if (n[0]>=bounds[0][0] && n[0]<bounds[0][1] &&
+                    n[1]>=bounds[1][0] && n[1]<bounds[1][1]) {
+                neighbor(v,n);
+            }
+        }
+    }
+
+
+
+    /*! Sweeps the bounds of a basis in row-major order. For each vertex,
+     *  it calls vertex(v), then neighbor(v,n) for stencil entries FIRST
+     *  to LAST. Bounds are checked only in the first and last rows and
+     *  columns. Every other vertex takes the check-free loop.
+     */
+    template<class STENCIL,int FIRST=0,int LAST=STENCIL::size,
+             class BASIS,class VERTEX,class NEIGHBOR>
+    void stencil_sweep(const BASIS& basis, VERTEX vertex, NEIGHBOR neighbor)
+    {
+        typedef typename BASIS::vertex_type vertex_type;
+        typedef typename vertex_type::value_type index_type;
+        const typename BASIS::bounds_type& b=basis.bounds_;
+
+        const bool narrow=(b[1][1]-b[1][0]<3);
+        vertex_type v;
+        for (index_type i=b[0][0]; i<b[0][1]; i++) {
+            v[0]=i;
+            v[1]=b[1][0];
+            if (narrow || i==b[0][0] || i+1==b[0][1]) {
+                for (; v[1]<b[1][1]; v[1]++) {
+                    vertex(v);
+                    stencil_border<STENCIL,FIRST,LAST>(v,b,neighbor);
+                }
+                continue;
+            }
+            vertex(v);
+            stencil_border<STENCIL,FIRST,LAST>(v,b,neighbor);
+            for (v[1]++; v[1]+1<b[1][1]; v[1]++) {
+                vertex(v);
+                stencil_interior<STENCIL,FIRST,LAST>(v,neighbor);
+            }
+            vertex(v);
+            stencil_border<STENCIL,FIRST,LAST>(v,b,neighbor);
+        }
+    }
+
+
+
+
+    /*! For a periodic basis, calls neighbor(v,n) for each stencil entry,
+     *  FIRST to LAST, that crosses an edge of the whole and wraps to
+     *  the opposite edge. Only vertices of the bounds on an edge of the
+     *  whole are visited, so a block split from the basis adds just its
+     *  part of the seam, and n may lie in another block. stencil_sweep()
+     *  skips these, so a sweep plus the seams covers the torus.
+     */
+    template<class STENCIL,int FIRST=0,int LAST=STENCIL::size,
+             class BASIS,class NEIGHBOR>
+    void stencil_seams(const BASIS& basis, NEIGHBOR neighbor)
+    {
+        typedef typename BASIS::vertex_type vertex_type;
+        typedef typename vertex_type::value_type index_type;
+        const typename BASIS::bounds_type& b=basis.bounds_;
+        const typename BASIS::bounds_type& w=basis.whole_;
+        const index_type extent[2]={index_type(w[0][1]-w[0][0]),
+                                    index_type(w[1][1]-w[1][0])};
+        if (b[0][0]==b[0][1] || b[1][0]==b[1][1]) {
+            return;
+        }
+
+        auto wrap_border=[&](const vertex_type& v) {
+            for (int k=FIRST; k<LAST; k++) {
+                vertex_type n;
+                bool crossed=false;
+                for (int d=0; d<2; d++) {
+                    index_type at=v[d]-w[d][0];
+                    int step=STENCIL::offsets[k][d];
+                    if (step<0 && at<index_type(-step)) {
+                        n[d]=w[d][0]+(at+extent[d]+step)%extent[d];
+                        crossed=true;
+                    } else if (step>0 && at+step>=extent[d]) {
+                        n[d]=w[d][0]+(at+step)%extent[d];
+                        crossed=true;
+                    } else {
+                        n[d]=v[d]+step;
+                    }
+                }
+                if (crossed) {
+                    neighbor(v,n);
+                }
+            }
+        };
+
+        const bool left=(b[1][0]==w[1][0]);
+        const bool right=(b[1][1]==w[1][1]) && (b[1][1]-1!=b[1][0] || !left);
+        vertex_type v;
+        for (v[0]=b[0][0]; v[0]<b[0][1]; v[0]++) {
+            if (v[0]==w[0][0] || v[0]+1==w[0][1]) {
+                for (v[1]=b[1][0]; v[1]<b[1][1]; v[1]++) {
+                    wrap_border(v);
+                }
+            } else {
+                if (left) {
+                    v[1]=b[1][0];
+                    wrap_border(v);
+                }
+                if (right) {
+                    v[1]=b[1][1]-1;
+                    wrap_border(v);
+                }
+            }
+        }
+    }
+
+
+
+
      /*! This walks from 0 to N.
      *  It is just a simple walk. The key is something with a ++operator.
      *  The full implementation should walk a sub-region of the array,
@@ -247,10 +441,10 @@ namespace raster_stats {
         return {{
                 four_adjacent_iterator<typename BASIS::vertex_type,
                                        typename BASIS::bounds_type>
-                    (basis.whole_,basis.bounds_,loc_,-1),
+                    (basis.whole_,basis.bounds_,loc_,-1,basis.periodic_),
                     four_adjacent_iterator<typename BASIS::vertex_type,
                                            typename BASIS::bounds_type>
-                    (basis.whole_,basis.bounds_,loc_,4)}};
+                    (basis.whole_,basis.bounds_,loc_,4,basis.periodic_)}};
     }
 
 
@@ -260,6 +454,7 @@ namespace raster_stats {
      *  splittable range concept from the TBB, so what you get
      *  is a 2D domain that can be broken into chunks.
      *  VT is the storage type of the vertex, size_t or unsigned.
+     *  Use dispatch_index() to pick uint32_t when the extent allows.
      */
     template<class VT>
 	class array_basis {
@@ -275,20 +470,25 @@ namespace raster_stats {
     public:
         bounds_type whole_;
 		bounds_type bounds_;
+        //! Whether the edges of the bounds wrap around to meet.
+        bool        periodic_;
 	public:
 
-        array_basis(const bounds_type whole, size_t granularity) :
-            whole_(whole),bounds_(whole),
+        array_basis(const bounds_type whole, size_t granularity,
+                    bool periodic=false) :
+            whole_(whole),bounds_(whole),periodic_(periodic),
             range_(whole[0][0],whole[0][1],granularity,
                    whole[1][0],whole[1][1],granularity)
         {
         }
         array_basis(const array_basis& b) : whole_(b.whole_),bounds_(b.bounds_),
+                                            periodic_(b.periodic_),
                                             range_(b.range_) {}
 		~array_basis() {}
 
 		array_basis( array_basis& r, tbb::split ) :
-            whole_(r.whole_), range_(r.range_,tbb::split())
+            whole_(r.whole_), periodic_(r.periodic_),
+            range_(r.range_,tbb::split())
 		{
             bounds_[0][0]=range_.rows().begin();
             bounds_[0][1]=range_.rows().end();
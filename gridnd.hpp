@@ -0,0 +1,268 @@
+/*! gridnd.hpp
+ *  The N-dimensional counterpart of grid2d.hpp, for stacks of rasters
+ *  such as a land-use raster for each year. The basis, the vertex
+ *  iterator and the neighbor iterator plug into union_find_st
+ *  the same way that the two-dimensional ones do.
+ */
+#ifndef _GRIDND_HPP_
+#define _GRIDND_HPP_ 1
+
+#include <cstddef>
+#include <boost/array.hpp>
+#include <boost/iterator/iterator_facade.hpp>
+
+
+namespace raster_stats {
+
+    //! Counts the offsets in {-1,0,+1}^D for nd_stencil.
+    template<size_t D>
+    struct nd_codes
+    {
+        static constexpr size_t codes() {
+            size_t n=1;
+            for (size_t d=0; d<D; d++) {
+                n*=3;
+            }
+            return n;
+        }
+
+        //! Offset d of the code, with digit 0, 1, 2 meaning -1, 0, +1.
+        static constexpr int digit(size_t code, size_t d) {
+            for (size_t skip=D-1; skip>d; skip--) {
+                code/=3;
+            }
+            return int(code%3)-1;
+        }
+
+        static constexpr size_t nonzero(size_t code) {
+            size_t n=0;
+            for (size_t d=0; d<D; d++) {
+                if (digit(code,d)!=0) n++;
+            }
+            return n;
+        }
+
+        static constexpr size_t count(size_t k) {
+            size_t n=0;
+            for (size_t code=0; code<codes(); code++) {
+                if (nonzero(code)>0 && nonzero(code)<=k) n++;
+            }
+            return n;
+        }
+    };
+
+
+
+    /*! Neighbor offsets in D dimensions. K is the largest number of
+     *  coordinates a neighbor may differ in, so in three dimensions
+     *  K=1, 2, 3 give 6, 18 and 26-connectivity. The first causal
+     *  entries come before the center in row-major order, and the rest
+     *  are their mirror images.
+     */
+    template<size_t D, size_t K>
+    struct nd_stencil
+    {
+        typedef nd_codes<D> codes_t;
+        static constexpr int size=codes_t::count(K);
+        static constexpr int causal=size/2;
+
+        int offsets[size][D];
+
+        constexpr nd_stencil() : offsets()
+        {
+            int n=0;
+            // Codes below the center are exactly those whose first
+            // nonzero digit is -1, in row-major order.
+            for (size_t code=0; code<codes_t::codes()/2; code++) {
+                size_t nonzero=codes_t::nonzero(code);
+                if (nonzero>0 && nonzero<=K) {
+                    for (size_t d=0; d<D; d++) {
+                        offsets[n][d]=codes_t::digit(code,d);
+                        offsets[n+causal][d]=-codes_t::digit(code,d);
+                    }
+                    n++;
+                }
+            }
+        }
+    };
+
+
+    typedef nd_stencil<3,1> stencil_six;
+    typedef nd_stencil<3,2> stencil_eighteen;
+    typedef nd_stencil<3,3> stencil_twentysix;
+
+
+
+    /*! Walks the bounds of an nd_basis in row-major order,
+     *  the last coordinate fastest.
+     */
+    template<class BASIS>
+    class nd_vertex_iterator :
+        public boost::iterator_facade<nd_vertex_iterator<BASIS>,
+           typename BASIS::vertex_type const,
+           boost::forward_traversal_tag>
+    {
+    public:
+        typedef typename BASIS::bounds_type bounds_type;
+        typedef typename BASIS::vertex_type vertex_type;
+    private:
+        bounds_type bounds_;
+        vertex_type loc_;
+    public:
+        nd_vertex_iterator() {}
+        nd_vertex_iterator(const bounds_type& bounds, const vertex_type& loc)
+            : bounds_(bounds), loc_(loc) {}
+        friend class boost::iterator_core_access;
+
+        void increment() {
+            for (size_t d=BASIS::dimension-1; d>0; d--) {
+                if (++loc_[d]!=bounds_[d][1]) {
+                    return;
+                }
+                loc_[d]=bounds_[d][0];
+            }
+            ++loc_[0];
+        }
+
+        bool equal(nd_vertex_iterator const& other) const
+        {
+            return loc_==other.loc_;
+        }
+
+        vertex_type const& dereference() const {
+            return loc_;
+        }
+    };
+
+
+
+    /*! Visits the neighbors of a vertex that lie within the bounds,
+     *  in the order of the STENCIL table.
+     */
+    template<class BASIS,class STENCIL>
+    class nd_adjacent_iterator :
+        public boost::iterator_facade<nd_adjacent_iterator<BASIS,STENCIL>,
+            typename BASIS::vertex_type const,boost::incrementable_traversal_tag>
+    {
+    public:
+        typedef typename BASIS::bounds_type bounds_type;
+        typedef typename BASIS::vertex_type vertex_type;
+    private:
+        static constexpr STENCIL table_{};
+        const bounds_type* bounds_;
+        vertex_type center_;
+        vertex_type neighbor_;
+        int entry_;
+    public:
+        nd_adjacent_iterator(const bounds_type& bounds,
+                             const vertex_type& loc, int entry)
+            : bounds_(&bounds), center_(loc), entry_(entry) {
+            increment();
+        }
+        friend class boost::iterator_core_access;
+
+        void increment() {
+            while (entry_!=STENCIL::size) {
+                entry_++;
+                if (entry_==STENCIL::size) {
+                    return;
+                }
+                bool inside=true;
+                for (size_t d=0; d<BASIS::dimension; d++) {
+                    neighbor_[d]=center_[d]+table_.offsets[entry_][d];
+                    // Unsigned coordinates wrap below zero.
+                    if (neighbor_[d]<(*bounds_)[d][0] ||
+                            neighbor_[d]>=(*bounds_)[d][1]) {
+                        inside=false;
+                    }
+                }
+                if (inside) {
+                    return;
+                }
+            }
+        }
+
+        bool equal(nd_adjacent_iterator const& other) const
+        {
+            return entry_==other.entry_;
+        }
+
+        vertex_type const& dereference() const {
+            return neighbor_;
+        }
+    };
+
+
+
+    /*! A D-dimensional box of vertices. bounds_[d] is the (start, end)
+     *  of coordinate d, as in array_basis. VT is size_t or uint32_t.
+     */
+    template<class VT, size_t D>
+    class nd_basis {
+    public:
+        static constexpr size_t dimension=D;
+        typedef boost::array<VT,D>          vertex_type;
+        typedef boost::array<VT,2>          interval_type;
+        typedef boost::array<interval_type,D> bounds_type;
+        typedef VT                          size_type;
+        typedef nd_vertex_iterator<nd_basis> iterator;
+
+        bounds_type whole_;
+        bounds_type bounds_;
+
+        explicit nd_basis(const bounds_type& whole)
+            : whole_(whole), bounds_(whole) {}
+
+        size_t size() const {
+            size_t n=1;
+            for (size_t d=0; d<D; d++) {
+                n*=bounds_[d][1]-bounds_[d][0];
+            }
+            return n;
+        }
+
+        iterator begin() const {
+            vertex_type loc;
+            for (size_t d=0; d<D; d++) {
+                loc[d]=bounds_[d][0];
+            }
+            return iterator(bounds_,loc);
+        }
+
+        //! One past the last vertex, where increment() carries to.
+        iterator end() const {
+            vertex_type loc;
+            for (size_t d=0; d<D; d++) {
+                loc[d]=bounds_[d][0];
+            }
+            loc[0]=bounds_[0][1];
+            return iterator(bounds_,loc);
+        }
+    };
+
+
+
+    template<class BASIS>
+    boost::array<typename BASIS::iterator,2>
+    make_nd_vertex_iterator(const BASIS& basis)
+    {
+        boost::array<typename BASIS::iterator,2> arr={{basis.begin(),
+                                                       basis.end()}};
+        return arr;
+    }
+
+
+
+    template<class BASIS,class STENCIL>
+    boost::array<nd_adjacent_iterator<BASIS,STENCIL>,2>
+    make_nd_adjacent(const BASIS& basis,
+                     const typename BASIS::vertex_type& loc)
+    {
+        return {{
+                nd_adjacent_iterator<BASIS,STENCIL>(basis.bounds_,loc,-1),
+                nd_adjacent_iterator<BASIS,STENCIL>(basis.bounds_,loc,
+                                                    STENCIL::size)}};
+    }
+}
+
+#endif // _GRIDND_HPP_
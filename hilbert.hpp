@@ -0,0 +1,149 @@
+/*
+ * hilbert.hpp
+ *
+ *  Hilbert-curve ordering for two-dimensional arrays. This is the
+ *  companion to morton.hpp. Z-order makes long jumps at the boundary
+ *  of every quadrant, while consecutive Hilbert indices are always
+ *  nearest neighbors on the grid.
+ */
+
+#ifndef HILBERT_HPP_
+#define HILBERT_HPP_
+
+#include <climits>
+#include <cstdint>
+#include <boost/array.hpp>
+
+
+namespace raster_stats
+{
+
+    /*! Lookup tables for the Hilbert state machine.
+     *  At each level of the curve, the orientation of the sub-square is
+     *  one of four states, which are the combinations of swapping x and y
+     *  (bit 1) and inverting both (bit 2). These tables consume four
+     *  levels at a time, so a 16-bit coordinate takes four lookups.
+     *
+     *  encode_[state][x nibble<<4 | y nibble] = next state<<8 | 8 index bits
+     *  decode_[state][8 index bits]           = next state<<8 | x<<4 | y
+     */
+    struct hilbert_table
+    {
+        static constexpr unsigned levels=4;
+
+        uint16_t encode_[4][256];
+        uint16_t decode_[4][256];
+
+        constexpr hilbert_table() : encode_(), decode_()
+        {
+            for (unsigned state=0; state<4; state++) {
+                for (unsigned xy=0; xy<256; xy++) {
+                    unsigned s=state;
+                    unsigned d=0;
+                    for (int level=levels-1; level>=0; level--) {
+                        unsigned rx=((xy>>4)>>level)&1;
+                        unsigned ry=(xy>>level)&1;
+                        d=(d<<2)|step_encode(s,rx,ry);
+                    }
+                    encode_[state][xy]=static_cast<uint16_t>((s<<8)|d);
+                }
+                for (unsigned d=0; d<256; d++) {
+                    unsigned s=state;
+                    unsigned x=0;
+                    unsigned y=0;
+                    for (int level=levels-1; level>=0; level--) {
+                        unsigned q=step_decode(s,(d>>(2*level))&3);
+                        x=(x<<1)|(q>>1);
+                        y=(y<<1)|(q&1);
+                    }
+                    decode_[state][d]=static_cast<uint16_t>((s<<8)|(x<<4)|y);
+                }
+            }
+        }
+
+    private:
+        //! Returns the curve digit for one level and moves to the next state.
+        static constexpr unsigned step_encode(unsigned& s,unsigned rx,unsigned ry)
+        {
+            if (s&2) { rx^=1; ry^=1; }
+            if (s&1) { unsigned t=rx; rx=ry; ry=t; }
+            s^=rotation(rx,ry);
+            return (3*rx)^ry;
+        }
+
+        //! Returns the raw quadrant, x<<1|y, for one digit of the curve.
+        static constexpr unsigned step_decode(unsigned& s,unsigned digit)
+        {
+            unsigned tx=(digit>>1)&1;
+            unsigned ty=(digit&1)^tx;
+            unsigned rx=tx;
+            unsigned ry=ty;
+            if (s&1) { unsigned t=rx; rx=ry; ry=t; }
+            if (s&2) { rx^=1; ry^=1; }
+            s^=rotation(tx,ty);
+            return (rx<<1)|ry;
+        }
+
+        static constexpr unsigned rotation(unsigned tx, unsigned ty)
+        {
+            return (ty==0) ? ((tx==1) ? 3 : 1) : 0;
+        }
+    };
+
+
+
+    struct hilbert_calculations
+    {
+        static constexpr hilbert_table table{};
+
+        /*! The number of levels needed for a side of length n, rounded up
+         *  to a whole number of table lookups.
+         */
+        static unsigned order(size_t n)
+        {
+            unsigned bits=0;
+            while (bits<CHAR_BIT*sizeof(size_t)/2 && (size_t(1)<<bits)<n) {
+                bits++;
+            }
+            return ((bits+hilbert_table::levels-1)/hilbert_table::levels)*
+                hilbert_table::levels;
+        }
+
+        /*! Combine an x and y coordinate into a single Hilbert index.
+         *  The order is the number of bits of x and y to use and must
+         *  be a multiple of hilbert_table::levels.
+         */
+        template<typename XY, typename M>
+        static M combine_xy(const boost::array<XY,2>& x, unsigned order)
+        {
+            M d=0;
+            unsigned state=0;
+            for (int shift=int(order)-int(hilbert_table::levels); shift>=0;
+                 shift-=hilbert_table::levels) {
+                unsigned xy=(((x[0]>>shift)&0xf)<<4)|((x[1]>>shift)&0xf);
+                uint16_t entry=table.encode_[state][xy];
+                d=(d<<(2*hilbert_table::levels))|(entry&0xff);
+                state=entry>>8;
+            }
+            return d;
+        }
+
+
+        template<typename XY, typename M>
+        static boost::array<XY,2> detangle(M n, unsigned order)
+        {
+            boost::array<XY,2> xy = {{0, 0}};
+            unsigned state=0;
+            for (int shift=int(order)-int(hilbert_table::levels); shift>=0;
+                 shift-=hilbert_table::levels) {
+                uint16_t entry=table.decode_[state][(n>>(2*shift))&0xff];
+                xy[0]=(xy[0]<<hilbert_table::levels)|((entry>>4)&0xf);
+                xy[1]=(xy[1]<<hilbert_table::levels)|(entry&0xf);
+                state=entry>>8;
+            }
+            return xy;
+        }
+    };
+}
+
+#endif /* HILBERT_HPP_ */
@@ -4,14 +4,25 @@
 #include <iostream>
 #include <algorithm>
 #include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <zlib.h>
+#include <limits>
 #include <boost/assert.hpp>
 #include <boost/array.hpp>
 #include <boost/numeric/ublas/matrix.hpp>
 #include <boost/numeric/ublas/matrix_proxy.hpp>
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
 #include "tiffio.h"
 #include "xtiffio.h"
 //#include "geotiff/xtiffio.h"
 #include "io_geotiff.hpp"
+#include "io_mmap.hpp"
+#include "replicated_view.hpp"
 
 using namespace std;
 using namespace boost::numeric::ublas;
@@ -114,124 +125,633 @@ void tiff_data_format(const char* filename)
 }
 
 
-std::shared_ptr<landscape_t> read_tiff(const char* filename)
+/* libtiff only reads a private tag if it knows the tag's type when the
+ * file opens, so GDAL's nodata tag is added to every TIFF through a tag
+ * extender. The extender is installed when this file is loaded, and it
+ * calls whichever extender was there before, such as libgeotiff's.
+ * The GeoTIFF tags are defined here too, as libgeotiff defines them,
+ * so write_tiff_labels can copy them whether or not XTIFFOpen did.
+ * libtiff skips tags that are already defined.
+ */
+namespace {
+    TIFFExtendProc parent_extender = 0;
+
+    void extend_gdal_tags(TIFF* raster)
+    {
+        static const TIFFFieldInfo gdal_fields[] = {
+            { gdal_nodata_tag, -1, -1, TIFF_ASCII, FIELD_CUSTOM, 1, 0,
+              const_cast<char*>("GDALNoDataValue") },
+            { geo_pixel_scale_tag, -1, -1, TIFF_DOUBLE, FIELD_CUSTOM, 1, 1,
+              const_cast<char*>("GeoPixelScale") },
+            { geo_tie_points_tag, -1, -1, TIFF_DOUBLE, FIELD_CUSTOM, 1, 1,
+              const_cast<char*>("GeoTiePoints") },
+            { geo_trans_matrix_tag, -1, -1, TIFF_DOUBLE, FIELD_CUSTOM, 1, 1,
+              const_cast<char*>("GeoTransformationMatrix") },
+            { geo_key_directory_tag, -1, -1, TIFF_SHORT, FIELD_CUSTOM, 1, 1,
+              const_cast<char*>("GeoKeyDirectory") },
+            { geo_double_params_tag, -1, -1, TIFF_DOUBLE, FIELD_CUSTOM, 1, 1,
+              const_cast<char*>("GeoDoubleParams") },
+            { geo_ascii_params_tag, -1, -1, TIFF_ASCII, FIELD_CUSTOM, 1, 0,
+              const_cast<char*>("GeoASCIIParams") }
+        };
+        TIFFMergeFieldInfo(raster, gdal_fields,
+                           sizeof(gdal_fields)/sizeof(gdal_fields[0]));
+        if (parent_extender) {
+            parent_extender(raster);
+        }
+    }
+
+    struct install_gdal_tags {
+        install_gdal_tags() {
+            parent_extender = TIFFSetTagExtender(extend_gdal_tags);
+        }
+    } gdal_tags_installed;
+}
+
+
+
+/*! GDAL writes the nodata value as text, such as "255" or "-9999".
+ *  Returns false if the tag is absent or the value is not a whole
+ *  number that a pixel can hold, in which case no pixel is nodata.
+ */
+bool tiff_nodata(const char* filename, landscape_t::value_type& nodata)
 {
-    uint32 width=0, height=0;
     TIFF* raster = XTIFFOpen(filename,"r");
 	if ( 0 == raster ) {
 	 	throw std::runtime_error("Could not open TIFF.");
 	}
 
+    char* text = 0;
+    bool found = TIFFGetField(raster, gdal_nodata_tag, &text) && text;
+    double value = 0;
+    if (found) {
+        char* end = 0;
+        value = std::strtod(text, &end);
+        found = end!=text && value==std::floor(value) &&
+            value>=std::numeric_limits<landscape_t::value_type>::min() &&
+            value<=std::numeric_limits<landscape_t::value_type>::max();
+    }
+    XTIFFClose(raster);
+
+    if (found) {
+        nodata = static_cast<landscape_t::value_type>(value);
+    }
+    return found;
+}
+
+
+
+namespace {
+    //! Closes the TIFF when it goes out of scope, even on a throw.
+    struct tiff_handle {
+        TIFF* raster;
+        explicit tiff_handle(const char* filename, const char* mode="r")
+            : raster(XTIFFOpen(filename,mode)) {
+            if ( 0 == raster ) {
+                throw std::runtime_error("Could not open TIFF.");
+            }
+        }
+        ~tiff_handle() { XTIFFClose(raster); }
+        operator TIFF*() const { return raster; }
+    private:
+        tiff_handle(const tiff_handle&);
+        tiff_handle& operator=(const tiff_handle&);
+    };
+}
+
+
+
+//! Whether a sample in the file is exactly a T, so it can be copied.
+template<class T>
+bool sample_type_matches(const tiff_sample_format& format)
+{
+    uint16 expected = SAMPLEFORMAT_UINT;
+    if (!std::numeric_limits<T>::is_integer) {
+        expected = SAMPLEFORMAT_IEEEFP;
+    } else if (std::numeric_limits<T>::is_signed) {
+        expected = SAMPLEFORMAT_INT;
+    }
+    return format.bits_per_sample == 8*sizeof(T) &&
+        format.sample_format == expected;
+}
+
+
+
+tiff_sample_format tiff_samples(TIFF* raster)
+{
+    tiff_sample_format format;
+    format.bits_per_sample = 1;
+    format.sample_format = SAMPLEFORMAT_UINT;
+    format.samples_per_pixel = 1;
+    format.planar_config = PLANARCONFIG_CONTIG;
+    TIFFGetFieldDefaulted(raster, TIFFTAG_BITSPERSAMPLE, &format.bits_per_sample);
+    TIFFGetFieldDefaulted(raster, TIFFTAG_SAMPLEFORMAT, &format.sample_format);
+    TIFFGetFieldDefaulted(raster, TIFFTAG_SAMPLESPERPIXEL, &format.samples_per_pixel);
+    TIFFGetFieldDefaulted(raster, TIFFTAG_PLANARCONFIG, &format.planar_config);
+    return format;
+}
+
+
+
+tiff_sample_format tiff_samples(const char* filename)
+{
+    tiff_handle raster(filename);
+    return tiff_samples(raster);
+}
+
+
+
+/*! Reads a TIFF by strip or tile rather than by scanline. Each TBB
+ *  worker opens the file for itself, because a TIFF handle holds
+ *  decoder state, and decodes a run of strips or tiles into its own
+ *  buffer. Rows go into the bands with memcpy when a row holds one
+ *  band, or with a strided copy that splits interleaved samples, the
+ *  first scanline at the bottom as before. Separate planes are strips
+ *  or tiles of their own, after all of those of the plane before.
+ *  Work is cut into at most chunk_cnt runs so the file is not opened
+ *  once per strip. There may be fewer bands than samples, in which
+ *  case only the first bands.size() samples are read, and the strips
+ *  or tiles of later separate planes are not decoded at all.
+ */
+template<class T>
+void read_tiff_blocks(const char* filename, TIFF* raster,
+                      const tiff_sample_format& format,
+                      std::vector<boost::numeric::ublas::matrix<T>*>& bands)
+{
+    const size_t chunk_cnt = 64;
+    const uint32 width = bands[0]->size2();
+    const uint32 height = bands[0]->size1();
+    const bool separate = format.planar_config == PLANARCONFIG_SEPARATE &&
+        format.samples_per_pixel > 1;
+    // Samples per pixel within a row of the file.
+    const uint32 interleave = separate ? 1 : format.samples_per_pixel;
+
+    // Copies n pixels starting at src to (file_row, col) of the bands.
+    // plane is the band of a separate plane, or -1 for interleaved rows.
+    auto put_row = [&](uint32 file_row, const T* src, uint32 col, uint32 n,
+                       int plane) {
+        const size_t offset = size_t(height-file_row-1)*width+col;
+        if (plane >= 0) {
+            ::memcpy(&bands[plane]->data()[offset], src, n*sizeof(T));
+            return;
+        }
+        for (size_t band=0; band<bands.size(); band++) {
+            T* dst = &bands[band]->data()[offset];
+            if (interleave == 1) {
+                ::memcpy(dst, src, n*sizeof(T));
+            } else {
+                for (uint32 k=0; k<n; k++) {
+                    dst[k] = src[size_t(k)*interleave+band];
+                }
+            }
+        }
+    };
+
+    if (TIFFIsTiled(raster)) {
+        uint32 tile_width=0, tile_length=0;
+        TIFFGetField(raster, TIFFTAG_TILEWIDTH, &tile_width);
+        TIFFGetField(raster, TIFFTAG_TILELENGTH, &tile_length);
+        const uint32 tiles_across = (width+tile_width-1)/tile_width;
+        const ttile_t tile_cnt = TIFFNumberOfTiles(raster);
+        const ttile_t plane_tiles = separate ?
+            tile_cnt/format.samples_per_pixel : tile_cnt;
+        const ttile_t read_cnt = separate ? plane_tiles*bands.size() : tile_cnt;
+        tbb::parallel_for(tbb::blocked_range<ttile_t>(0, read_cnt,
+                              std::max<size_t>(1, read_cnt/chunk_cnt)),
+            [&](const tbb::blocked_range<ttile_t>& tiles) {
+                tiff_handle local(filename);
+                const tmsize_t tile_size = TIFFTileSize(local);
+                std::vector<T> buffer((tile_size+sizeof(T)-1)/sizeof(T));
+                for (ttile_t tile=tiles.begin(); tile!=tiles.end(); tile++) {
+                    if (TIFFReadEncodedTile(local, tile, &buffer[0],
+                                            tile_size) < 0) {
+                        throw std::runtime_error("Could not read TIFF tile.");
+                    }
+                    const ttile_t in_plane = tile%plane_tiles;
+                    const int plane = separate ? int(tile/plane_tiles) : -1;
+                    const uint32 x = (in_plane%tiles_across)*tile_width;
+                    const uint32 y = (in_plane/tiles_across)*tile_length;
+                    const uint32 cols = std::min(tile_width, width-x);
+                    const uint32 rows = std::min(tile_length, height-y);
+                    for (uint32 row=0; row<rows; row++) {
+                        put_row(y+row, &buffer[size_t(row)*tile_width*interleave],
+                                x, cols, plane);
+                    }
+                }
+            });
+    } else {
+        uint32 rows_per_strip=height;
+        TIFFGetFieldDefaulted(raster, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+        rows_per_strip = std::min(rows_per_strip, height);
+        const tstrip_t strip_cnt = TIFFNumberOfStrips(raster);
+        const tstrip_t plane_strips = separate ?
+            strip_cnt/format.samples_per_pixel : strip_cnt;
+        const tstrip_t read_cnt = separate ? plane_strips*bands.size() : strip_cnt;
+        tbb::parallel_for(tbb::blocked_range<tstrip_t>(0, read_cnt,
+                              std::max<size_t>(1, read_cnt/chunk_cnt)),
+            [&](const tbb::blocked_range<tstrip_t>& strips) {
+                tiff_handle local(filename);
+                const tmsize_t strip_size = TIFFStripSize(local);
+                std::vector<T> buffer((strip_size+sizeof(T)-1)/sizeof(T));
+                for (tstrip_t strip=strips.begin(); strip!=strips.end(); strip++) {
+                    if (TIFFReadEncodedStrip(local, strip, &buffer[0],
+                                             strip_size) < 0) {
+                        throw std::runtime_error("Could not read TIFF strip.");
+                    }
+                    const int plane = separate ? int(strip/plane_strips) : -1;
+                    const uint32 y = (strip%plane_strips)*rows_per_strip;
+                    const uint32 rows = std::min(rows_per_strip, height-y);
+                    for (uint32 row=0; row<rows; row++) {
+                        put_row(y+row, &buffer[size_t(row)*width*interleave],
+                                0, width, plane);
+                    }
+                }
+            });
+    }
+}
+
+
+
+/*! Unpacks the first sample of each pixel, where samples are 1, 2 or
+ *  4 bits, one pixel to a byte, the first scanline at the bottom.
+ *  libtiff reads these only by scanline, so this is not parallel.
+ */
+void read_tiff_packed(TIFF* raster, const tiff_sample_format& format,
+                      landscape_t& band)
+{
+    const uint16 bits = format.bits_per_sample;
+    if (bits != 1 && bits != 2 && bits != 4) {
+        throw std::runtime_error("Can only unpack TIFF samples of 1, 2 or 4 bits.");
+    }
+    if (TIFFIsTiled(raster)) {
+        throw std::runtime_error("Can only unpack TIFF samples from strips.");
+    }
+    const uint32 height = band.size1();
+    const uint32 width = band.size2();
+    if (0 == width || 0 == height) {
+        return;
+    }
+    const uint32 interleave = (format.planar_config == PLANARCONFIG_SEPARATE) ?
+        1 : format.samples_per_pixel;
+    const unsigned mask = (1u<<bits)-1;
+    std::vector<uint8> line(TIFFScanlineSize(raster));
+    for (uint32 row=0; row<height; row++) {
+        if (TIFFReadScanline(raster, &line[0], row, 0) < 0) {
+            throw std::runtime_error("Could not read TIFF scanline.");
+        }
+        landscape_t::value_type* out = &band.data()[size_t(height-row-1)*width];
+        for (uint32 col=0; col<width; col++) {
+            // The first sample is in the high bits of its byte.
+            const size_t bit = size_t(col)*interleave*bits;
+            out[col] = (line[bit/8] >> (8-bits-bit%8)) & mask;
+        }
+    }
+}
+
+
+
+//! Width and height of an open TIFF.
+void tiff_size(TIFF* raster, uint32& width, uint32& height)
+{
     int read_width = TIFFGetField(raster, TIFFTAG_IMAGEWIDTH, &width);
-    assert(read_width == 1);
     int read_height = TIFFGetField(raster, TIFFTAG_IMAGELENGTH, &height);
-    assert(read_height == 1);
     if (read_width != 1 || read_height != 1) {
 		throw std::runtime_error("Could not read TIFF width and height.");
     }
-	
-	// Create a boost matrix large enough to hold the scan lines.
-	std::shared_ptr<landscape_t> image(new landscape_t(height,width));
-	landscape_t& rimage = *image;
-	
-	uint32 scanline_size = TIFFScanlineSize(raster);
+}
 
-	// Create a separate buffer to hold a single scan line b/c this can be longer than matrix width.
-	uint8* line_buffer = static_cast<uint8*>(_TIFFmalloc(TIFFScanlineSize(raster)));
-	
-	// Read scan lines and copy the used length into the matrix, from the top left.
-	const int pixel_size = 1;
-	for (size_t row_idx = 0; row_idx < height; row_idx++) {
-		TIFFReadScanline(raster, line_buffer, row_idx);
-		//::memcpy(&image->data()+(height-row_idx-1)*width, line_buffer, pixel_size*width);
-		for (size_t col_idx=0; col_idx<width; col_idx++) {
-			rimage(height-row_idx-1,col_idx) = line_buffer[col_idx];
-		}
-	}
 
-	_TIFFfree(line_buffer);
 
-    XTIFFClose(raster);
-	return image;
+template<class T>
+std::vector<std::shared_ptr<boost::numeric::ublas::matrix<T> > >
+read_tiff_bands(const char* filename)
+{
+    typedef boost::numeric::ublas::matrix<T> band_t;
+    uint32 width=0, height=0;
+    tiff_handle raster(filename);
+    tiff_size(raster, width, height);
+
+    const tiff_sample_format format = tiff_samples(raster);
+    if (!sample_type_matches<T>(format)) {
+        throw std::runtime_error("TIFF samples are not of the requested type. "
+                                 "Check them with tiff_samples.");
+    }
+
+    std::vector<std::shared_ptr<band_t> > bands;
+    std::vector<band_t*> targets;
+    for (uint16 band=0; band<format.samples_per_pixel; band++) {
+        bands.push_back(std::make_shared<band_t>(height,width));
+        targets.push_back(bands.back().get());
+    }
+    if (0 != width && 0 != height) {
+        read_tiff_blocks(filename, raster, format, targets);
+    }
+    return bands;
 }
 
 
 
-/*! This creates a new matrix of the given size using copies
- *  of the given matrix. It copies the matrix in blocks using
- *  BLAS functions.
+template std::vector<std::shared_ptr<boost::numeric::ublas::matrix<uint8_t> > >
+    read_tiff_bands<uint8_t>(const char* filename);
+template std::vector<std::shared_ptr<boost::numeric::ublas::matrix<int8_t> > >
+    read_tiff_bands<int8_t>(const char* filename);
+template std::vector<std::shared_ptr<boost::numeric::ublas::matrix<uint16_t> > >
+    read_tiff_bands<uint16_t>(const char* filename);
+template std::vector<std::shared_ptr<boost::numeric::ublas::matrix<int16_t> > >
+    read_tiff_bands<int16_t>(const char* filename);
+template std::vector<std::shared_ptr<boost::numeric::ublas::matrix<uint32_t> > >
+    read_tiff_bands<uint32_t>(const char* filename);
+template std::vector<std::shared_ptr<boost::numeric::ublas::matrix<int32_t> > >
+    read_tiff_bands<int32_t>(const char* filename);
+template std::vector<std::shared_ptr<boost::numeric::ublas::matrix<float> > >
+    read_tiff_bands<float>(const char* filename);
+template std::vector<std::shared_ptr<boost::numeric::ublas::matrix<double> > >
+    read_tiff_bands<double>(const char* filename);
+
+
+
+/*! The first band of a TIFF of unsigned samples of 8 bits or fewer.
+ *  Other bands are not decoded. Samples of 1, 2 or 4 bits are
+ *  unpacked, one to a pixel. Other sample types throw, where they
+ *  were once read a byte at a time.
  */
-std::shared_ptr<landscape_t> resize_replicate(std::shared_ptr<landscape_t> praster,
-                               boost::array<landscape_t::size_type,2> ns)
+std::shared_ptr<landscape_t> read_tiff(const char* filename)
 {
-  const landscape_t& raster(*praster);
+    uint32 width=0, height=0;
+    tiff_handle raster(filename);
+    tiff_size(raster, width, height);
+
+    auto band = std::make_shared<landscape_t>(height,width);
+    const tiff_sample_format format = tiff_samples(raster);
+    if (format.bits_per_sample < 8 && format.sample_format == SAMPLEFORMAT_UINT) {
+        read_tiff_packed(raster, format, *band);
+        return band;
+    }
+    if (!sample_type_matches<landscape_t::value_type>(format)) {
+        throw std::runtime_error("TIFF samples are not 8-bit unsigned. "
+                                 "Read them with read_tiff_bands.");
+    }
+    std::vector<landscape_t*> targets(1, band.get());
+    if (0 != width && 0 != height) {
+        read_tiff_blocks(filename, raster, format, targets);
+    }
+    return band;
+}
+
 
-  std::shared_ptr<landscape_t> pmorph(new landscape_t(ns[0],ns[1]));
-  landscape_t& morph(*pmorph);
 
-  const boost::array<landscape_t::size_type,2> os = {{ raster.size1(), raster.size2() }};
+/*! The tiles are hashed in parallel once the strips are decoded, not
+ *  strip by strip, because hash tiles follow the raster rather than the
+ *  file's strips or tiles. That way the same pixels hash the same
+ *  whether they came from a TIFF, a .npy or memory.
+ */
+std::shared_ptr<landscape_t> read_tiff(const char* filename,
+                                       raster_tile_hashes& hashes,
+                                       size_t tile_size)
+{
+    std::shared_ptr<landscape_t> raster = read_tiff(filename);
+    hashes = hash_tiles(*raster, tile_size);
+    return raster;
+}
 
-  typedef landscape_t::size_type size_type;
 
-  // Copy the data in blocks.
-  size_type iblocks = ns[0]/os[0];
-  size_type jblocks = ns[1]/os[1];
 
-  for (size_type i=0; i<iblocks; i++) {
-    for (size_type j=0; j<jblocks; j++) {
-		noalias(project(morph,
-			range(i*os[0],(i+1)*os[0]),
-			range(j*os[1],(j+1)*os[1])
-			))=raster;
+/*! Copies the georeferencing of one TIFF to another: the pixel scale,
+ *  tie points or transformation, and the GeoKey directory with its
+ *  parameters. Tags the source lacks are left out.
+ */
+void copy_geo_tags(TIFF* source, TIFF* destination)
+{
+    const ttag_t double_tags[] = { geo_pixel_scale_tag, geo_tie_points_tag,
+                                   geo_trans_matrix_tag, geo_double_params_tag };
+    for (ttag_t tag : double_tags) {
+        uint16 count = 0;
+        double* values = 0;
+        if (TIFFGetField(source, tag, &count, &values) && values) {
+            TIFFSetField(destination, tag, count, values);
+        }
+    }
+    uint16 key_cnt = 0;
+    uint16* keys = 0;
+    if (TIFFGetField(source, geo_key_directory_tag, &key_cnt, &keys) && keys) {
+        TIFFSetField(destination, geo_key_directory_tag, key_cnt, keys);
+    }
+    char* text = 0;
+    if (TIFFGetField(source, geo_ascii_params_tag, &text) && text) {
+        TIFFSetField(destination, geo_ascii_params_tag, text);
     }
-	// The end of the row has a partial block.
-    if (0 != ns[1] % os[1]) {
-      auto col_lrange = range(jblocks*os[1],ns[1]);
-      auto col_rrange = range(0,ns[1]%os[1]);
-      BOOST_ASSERT(col_lrange.size() == col_rrange.size());
+}
+
+
 
-      auto end_block_view = project(morph,range(i*os[0],(i+1)*os[0]),col_lrange);
-      auto end_raster_view = project(raster,range(0,os[0]),col_rrange);
-      noalias(end_block_view) = end_raster_view;
+/*! Writes labels in tiles of side tile, which TIFF asks be a multiple
+ *  of 16. Deflate tiles are compressed with zlib by TBB workers, a batch
+ *  at a time, and written in order with TIFFWriteRawTile, because
+ *  libtiff's own encoder runs one tile at a time. Uncompressed tiles
+ *  are filled the same way. ZSTD goes through libtiff's encoder, one
+ *  tile at a time, if libtiff was built with it. The first scanline
+ *  of the file is the last row of labels, as read_tiff reads it.
+ */
+void write_tiff_labels(const label_landscape_t& labels, const char* filename,
+                       const char* geo_source, tiff_compression compression,
+                       size_t tile)
+{
+    typedef label_landscape_t::value_type label_type;
+    if (0 == tile || tile%16 != 0) {
+        throw std::runtime_error("TIFF tiles must be a multiple of 16 wide.");
+    }
+    if (tiff_zstd == compression && !TIFFIsCODECConfigured(COMPRESSION_ZSTD)) {
+        throw std::runtime_error("This libtiff cannot write ZSTD.");
+    }
+    const uint32 width = labels.size2();
+    const uint32 height = labels.size1();
+
+    tiff_handle out(filename, "w");
+    TIFFSetField(out, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(out, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, 8*sizeof(label_type));
+    TIFFSetField(out, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+    TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(out, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(out, TIFFTAG_TILEWIDTH, uint32(tile));
+    TIFFSetField(out, TIFFTAG_TILELENGTH, uint32(tile));
+    const uint16 codes[] = { COMPRESSION_NONE, COMPRESSION_ADOBE_DEFLATE,
+                             COMPRESSION_ZSTD };
+    TIFFSetField(out, TIFFTAG_COMPRESSION, codes[compression]);
+    if (geo_source) {
+        tiff_handle source(geo_source);
+        copy_geo_tags(source, out);
+    }
+    if (0 == width || 0 == height) {
+        return;
     }
-  }
-  // Rows at the end may not have been copied yet.
-  if (0 != ns[0] % os[0]) {
-    const auto row_lrange = range(iblocks*os[0],ns[0]);
-    const auto row_rrange = range(0,ns[0]%os[0]);
-    BOOST_ASSERT(row_lrange.size() == row_rrange.size());
 
-    for (int j=0; j<jblocks; j++) {
-      const auto col_lrange = range(j*os[1],(j+1)*os[1]);
-      const auto col_rrange = range(0,os[1]);
-      BOOST_ASSERT(col_lrange.size() == col_rrange.size());
+    const uint32 tiles_across = (width+tile-1)/tile;
+    const uint32 tile_cnt = tiles_across*((height+tile-1)/tile);
+    const size_t tile_bytes = tile*tile*sizeof(label_type);
+
+    // Copies the labels under one tile into buffer, zero past the edges.
+    auto fill_tile = [&](uint32 index, std::vector<label_type>& buffer) {
+        const uint32 x = (index%tiles_across)*tile;
+        const uint32 y = (index/tiles_across)*tile;
+        const uint32 cols = std::min<uint32>(tile, width-x);
+        const uint32 rows = std::min<uint32>(tile, height-y);
+        buffer.assign(tile*tile, 0);
+        for (uint32 row=0; row<rows; row++) {
+            const label_type* src = &labels.data()[size_t(height-y-row-1)*width+x];
+            ::memcpy(&buffer[size_t(row)*tile], src, cols*sizeof(label_type));
+        }
+    };
+
+    if (tiff_zstd == compression) {
+        std::vector<label_type> buffer;
+        for (uint32 index=0; index<tile_cnt; index++) {
+            fill_tile(index, buffer);
+            if (TIFFWriteEncodedTile(out, index, &buffer[0], tile_bytes) < 0) {
+                throw std::runtime_error("Could not write TIFF tile.");
+            }
+        }
+        return;
+    }
 
-      auto chopped_block = project(morph,row_lrange,col_lrange);
-      auto chopped_raster = project(raster,row_rrange,col_rrange);
-      noalias(chopped_block) = chopped_raster;
+    // Enough tiles per batch to keep the workers busy, without holding
+    // more than a few hundred tiles in memory.
+    const uint32 batch_cnt = 256;
+    std::vector<std::vector<unsigned char> > encoded(batch_cnt);
+    for (uint32 first=0; first<tile_cnt; first+=batch_cnt) {
+        const uint32 last = std::min(tile_cnt, first+batch_cnt);
+        tbb::parallel_for(tbb::blocked_range<uint32>(first, last),
+            [&](const tbb::blocked_range<uint32>& tiles) {
+                std::vector<label_type> buffer;
+                for (uint32 index=tiles.begin(); index!=tiles.end(); index++) {
+                    fill_tile(index, buffer);
+                    std::vector<unsigned char>& bytes = encoded[index-first];
+                    if (tiff_none == compression) {
+                        bytes.resize(tile_bytes);
+                        ::memcpy(&bytes[0], &buffer[0], tile_bytes);
+                        continue;
+                    }
+                    uLongf size = compressBound(tile_bytes);
+                    bytes.resize(size);
+                    if (compress2(&bytes[0], &size,
+                                  reinterpret_cast<const Bytef*>(&buffer[0]),
+                                  tile_bytes, Z_DEFAULT_COMPRESSION) != Z_OK) {
+                        throw std::runtime_error("Could not deflate TIFF tile.");
+                    }
+                    bytes.resize(size);
+                }
+            });
+        for (uint32 index=first; index<last; index++) {
+            std::vector<unsigned char>& bytes = encoded[index-first];
+            if (TIFFWriteRawTile(out, index, &bytes[0], bytes.size()) < 0) {
+                throw std::runtime_error("Could not write TIFF tile.");
+            }
+        }
     }
+}
 
-    if (0 != ns[1] % os[1]) {
-      auto col_lrange = range(jblocks*os[1],ns[1]);
-      auto col_rrange = range(0,ns[1]%os[1]);
-      BOOST_ASSERT(col_lrange.size() == col_rrange.size());
 
-      auto corner_block = project(morph,row_lrange,col_lrange);
-      auto corner_raster = project(raster,row_rrange,col_rrange);
-      noalias(corner_block) = corner_raster;
+
+/*! Finds where the pixels sit in the file so they can be used in place.
+ *  That only works if the strips are uncompressed, one byte per pixel,
+ *  one sample per pixel, and laid end-to-end without padding.
+ */
+std::shared_ptr<mapped_raster> map_tiff(const char* filename)
+{
+    uint32 width=0, height=0;
+    TIFF* raster = XTIFFOpen(filename,"r");
+	if ( 0 == raster ) {
+	 	throw std::runtime_error("Could not open TIFF.");
+	}
+
+    uint16 compression=COMPRESSION_NONE, bits_per_sample=1;
+    uint16 samples_per_pixel=1, planar_config=PLANARCONFIG_CONTIG;
+    toff_t* strip_offsets=0;
+    toff_t* strip_byte_counts=0;
+    bool readable = TIFFGetField(raster, TIFFTAG_IMAGEWIDTH, &width) &&
+        TIFFGetField(raster, TIFFTAG_IMAGELENGTH, &height) &&
+        TIFFGetFieldDefaulted(raster, TIFFTAG_COMPRESSION, &compression) &&
+        TIFFGetFieldDefaulted(raster, TIFFTAG_BITSPERSAMPLE, &bits_per_sample) &&
+        TIFFGetFieldDefaulted(raster, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel) &&
+        TIFFGetFieldDefaulted(raster, TIFFTAG_PLANARCONFIG, &planar_config);
+    if (!readable || TIFFIsTiled(raster) || compression != COMPRESSION_NONE ||
+            bits_per_sample != 8 || samples_per_pixel != 1 ||
+            TIFFScanlineSize(raster) != tmsize_t(width) ||
+            !TIFFGetField(raster, TIFFTAG_STRIPOFFSETS, &strip_offsets) ||
+            !TIFFGetField(raster, TIFFTAG_STRIPBYTECOUNTS, &strip_byte_counts)) {
+        XTIFFClose(raster);
+        throw std::runtime_error("Can only map uncompressed, stripped, 8-bit TIFF.");
     }
+
+    tstrip_t strip_cnt = TIFFNumberOfStrips(raster);
+    toff_t first_offset = strip_offsets[0];
+    for (tstrip_t strip_idx=1; strip_idx<strip_cnt; strip_idx++) {
+        if (strip_offsets[strip_idx] !=
+                strip_offsets[strip_idx-1]+strip_byte_counts[strip_idx-1]) {
+            XTIFFClose(raster);
+            throw std::runtime_error("TIFF strips are not contiguous, so it cannot be mapped.");
+        }
+    }
+    XTIFFClose(raster);
+
+    // read_tiff puts the first scanline at the bottom, so start
+    // the view at the last scanline and step backwards.
+    auto mapped = std::make_shared<mapped_raster>(filename);
+    mapped->set_view(first_offset+size_t(height-1)*width, height, width,
+                     -std::ptrdiff_t(width));
+    return mapped;
+}
+
+
+
+/*! This creates a new matrix of the given size using copies
+ *  of the given matrix. TBB workers copy bands of rows, each row
+ *  with memcpy from the source row it repeats, so the pages of the
+ *  new matrix are first written by the threads that fill them.
+ */
+std::shared_ptr<landscape_t> resize_replicate(std::shared_ptr<landscape_t> praster,
+                               boost::array<landscape_t::size_type,2> ns)
+{
+  const replicated_landscape_t replicated = make_replicated(*praster, ns);
+
+  // ublas leaves the storage of a landscape_t uninitialized.
+  std::shared_ptr<landscape_t> pmorph(new landscape_t(ns[0],ns[1]));
+  if (0 == ns[0] || 0 == ns[1]) {
+    return pmorph;
   }
+  landscape_t::value_type* morph = &pmorph->data()[0];
+  const size_t grain = std::max<size_t>(1, (size_t(1)<<16)/ns[1]);
+
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, ns[0], grain),
+    [&](const tbb::blocked_range<size_t>& rows) {
+      for (size_t i=rows.begin(); i!=rows.end(); i++) {
+        replicated.copy_row(i, morph+i*ns[1]);
+      }
+    });
   return pmorph;
 }
 
 
 
-/*! Fills a portion of a raster of the given size with the given range of values.
+namespace {
+  //! Rows [b[0],b[1]) and columns [b[2],b[3]) are all value.
+  struct colored_region {
+    boost::array<landscape_t::size_type,4> b;
+    landscape_t::value_type value;
+  };
+}
+
+
+
+/*! Splits a portion of a raster of the given size among the given
+ *  range of values, appending one region for each value to regions.
  *  b is the bounds within the matrix.
  *  vals is the half-open range of values to assign, so (2,3] means assign 2
  *  to everything.
  */
-size_t color_range(landscape_t& raster, boost::array<landscape_t::size_type,4> b,
+size_t color_range(std::vector<colored_region>& regions,
+                   boost::array<landscape_t::size_type,4> b,
                    boost::array<landscape_t::value_type,2> vals)
 {
     typedef boost::array<landscape_t::size_type,4> dim_t;
@@ -240,10 +760,8 @@ size_t color_range(landscape_t& raster, boost::array<landscape_t::size_type,4> b
     size_t color_cnt=0;
     BOOST_ASSERT(vals[1]>vals[0]);
     if (vals[1]-vals[0]==1 || (b[1]-b[0]==1 && b[3]-b[2]==1)) {
-        auto tile=project(raster,range(b[0],b[1]),range(b[2],b[3]));
-        noalias(tile) = scalar_matrix<landscape_t::value_type>(
-                                    b[1]-b[0],b[3]-b[2],vals[0]
-                                    );
+        colored_region region = { b, vals[0] };
+        regions.push_back(region);
         color_cnt += 1;
     } else {
         landscape_t::value_type midval = (vals[0]+vals[1])/2;
@@ -253,18 +771,18 @@ size_t color_range(landscape_t& raster, boost::array<landscape_t::size_type,4> b
             auto mid=(b[1]+b[0])/2;
             dim_t long_low = {b[0],mid,b[2],b[3]};
             val_t low = {vals[0],midval};
-            color_cnt += color_range(raster,long_low,low);
+            color_cnt += color_range(regions,long_low,low);
             dim_t long_high = {mid,b[1],b[2],b[3]};
             val_t high = {midval,vals[1]};
-            color_cnt += color_range(raster,long_high,high);
+            color_cnt += color_range(regions,long_high,high);
         } else {
             auto mid=(b[3]+b[2])/2;
             dim_t wide_left={b[0],b[1],b[2],mid};
             val_t left={vals[0],midval};
-            color_cnt += color_range(raster,wide_left,left);
+            color_cnt += color_range(regions,wide_left,left);
             dim_t wide_right={b[0],b[1],mid,b[3]};
             val_t right={midval,vals[1]};
-            color_cnt += color_range(raster,wide_right,right);
+            color_cnt += color_range(regions,wide_right,right);
         }
     }
     return color_cnt;
@@ -274,21 +792,47 @@ size_t color_range(landscape_t& raster, boost::array<landscape_t::size_type,4> b
 
 /*! Creates a raster of the given size with the given range of values.
  *  ns is the total size of the raster, and vals is the range of values.
- *  Both are half-open intervals.
+ *  Both are half-open intervals. The regions are worked out first,
+ *  then TBB workers fill bands of rows, a memset for each region
+ *  that crosses a row.
  */
 std::shared_ptr<landscape_t> multi_value(boost::array<landscape_t::size_type,2> ns,
                                            boost::array<landscape_t::value_type,2> vals)
 {
-    typedef landscape_t::value_type value_type;
     std::shared_ptr<landscape_t> pmorph(new landscape_t(ns[0],ns[1]));
+    if (0 == ns[0] || 0 == ns[1]) {
+        return pmorph;
+    }
 
     typedef boost::array<landscape_t::size_type,4> region_t;
     region_t whole = {0,ns[0],0,ns[1]};
-    size_t color_cnt = color_range(*pmorph, whole, vals);
+    std::vector<colored_region> regions;
+    size_t color_cnt = color_range(regions, whole, vals);
     BOOST_ASSERT( color_cnt == vals[1] - vals[0] );
     if ( color_cnt < vals[1]-vals[0] ) {
         throw runtime_error("The requested matrix was too small to hold all the values.");
     }
+
+    landscape_t::value_type* morph = &pmorph->data()[0];
+    const size_t grain = std::max<size_t>(1, (size_t(1)<<16)/std::max<size_t>(1,ns[1]));
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, ns[0], grain),
+        [&](const tbb::blocked_range<size_t>& rows) {
+            std::vector<const colored_region*> crossing;
+            for (const auto& region : regions) {
+                if (region.b[0]<rows.end() && region.b[1]>rows.begin()) {
+                    crossing.push_back(&region);
+                }
+            }
+            for (size_t i=rows.begin(); i!=rows.end(); i++) {
+                landscape_t::value_type* row = morph+i*ns[1];
+                for (const colored_region* region : crossing) {
+                    if (region->b[0]<=i && i<region->b[1]) {
+                        std::memset(row+region->b[2], region->value,
+                                    region->b[3]-region->b[2]);
+                    }
+                }
+            }
+        });
     return pmorph;
 }
 
@@ -6,13 +6,65 @@
 
 #include <utility>
 #include <memory>
+#include <vector>
+#include <cstdint>
 #include <boost/array.hpp>
 #include "raster.hpp"
+#include "raster_hash.hpp"
 
 namespace raster_stats {
+    //! The ASCII tag in which GDAL stores a band's nodata value.
+    const unsigned int gdal_nodata_tag = 42113;
+    //! The GeoTIFF tags that place a raster on the earth.
+    const unsigned int geo_pixel_scale_tag = 33550;
+    const unsigned int geo_tie_points_tag = 33922;
+    const unsigned int geo_trans_matrix_tag = 34264;
+    const unsigned int geo_key_directory_tag = 34735;
+    const unsigned int geo_double_params_tag = 34736;
+    const unsigned int geo_ascii_params_tag = 34737;
+
+    //! How write_tiff_labels compresses its tiles.
+    enum tiff_compression { tiff_none, tiff_deflate, tiff_zstd };
+
+    //! How the samples of a TIFF are stored, with TIFF defaults filled in.
+    struct tiff_sample_format {
+        uint16_t bits_per_sample;
+        //! SAMPLEFORMAT_UINT, _INT or _IEEEFP.
+        uint16_t sample_format;
+        uint16_t samples_per_pixel;
+        //! PLANARCONFIG_CONTIG for interleaved samples, or _SEPARATE.
+        uint16_t planar_config;
+    };
+
     boost::array<size_t,2> tiff_dimensions(const char* filename);
     void tiff_data_format(const char* filename);
+    tiff_sample_format tiff_samples(const char* filename);
+    /*! One matrix per sample, such as one per band of a multispectral
+     *  image. T must match the file's samples exactly, for instance
+     *  uint16_t for a 16-bit class map or float for 32-bit IEEE.
+     *  Defined for 8, 16 and 32-bit integers, float and double.
+     */
+    template<class T>
+    std::vector<std::shared_ptr<boost::numeric::ublas::matrix<T> > >
+    read_tiff_bands(const char* filename);
+    //! Reads the GDAL nodata value, if the file has one that fits a pixel.
+    bool tiff_nodata(const char* filename, landscape_t::value_type& nodata);
+    /*! Band 0 of a TIFF of unsigned samples of 8 bits or fewer, with
+     *  1, 2 and 4-bit samples unpacked to a pixel each.
+     */
     std::shared_ptr<landscape_t> read_tiff(const char* filename);
+    //! Reads the TIFF and fills hashes from the pixels as read_tiff lays them out.
+    std::shared_ptr<landscape_t> read_tiff(const char* filename,
+                                           raster_tile_hashes& hashes,
+                                           size_t tile_size=256);
+    /*! Writes a 32-bit, tiled, compressed TIFF of cluster labels, such as
+     *  from cluster_labels. If geo_source is given, its GeoTIFF tags are
+     *  copied so the labels line up with the raster they came from.
+     */
+    void write_tiff_labels(const label_landscape_t& labels, const char* filename,
+                           const char* geo_source=0,
+                           tiff_compression compression=tiff_deflate,
+                           size_t tile=256);
     std::shared_ptr<landscape_t> resize_replicate(
                                        std::shared_ptr<landscape_t> praster,
                                        boost::array<landscape_t::size_type,2> ns);
@@ -1,9 +1,20 @@
 #define BOOST_TEST_MODULE io_geotiff
+#include <fstream>
+#include <vector>
+#include <string>
+#include <iterator>
+#include <algorithm>
 #include <boost/test/included/unit_test.hpp>
 #include <boost/bind.hpp>
 #include <boost/array.hpp>
 #include "raster.hpp"
 #include "io_geotiff.hpp"
+#include "io_mmap.hpp"
+#include "gather_clusters.hpp"
+#include "io_ppm.hpp"
+#include "test_directory.hpp"
+#include "tiffio.h"
+#include "xtiffio.h"
 
 using namespace std;
 using namespace boost::unit_test;
@@ -54,6 +65,33 @@ BOOST_AUTO_TEST_CASE( resize_replicate_test )
   BOOST_CHECK_EQUAL((*larger_down)(8,1),3);
 }
 
+BOOST_AUTO_TEST_CASE( resize_replicate_parallel )
+{
+  // Tall enough for several TBB bands and wide enough to double the rows.
+  landscape_t source(13,7);
+  for (size_t i=0; i<source.size1(); i++) {
+    for (size_t j=0; j<source.size2(); j++) {
+      source(i,j)=i*7+j;
+    }
+  }
+  typedef boost::array<size_t,2> dim_t;
+  dim_t sizes[] = {{{5,3}}, {{13,7}}, {{40000,9}}, {{30,1000}}, {{0,0}}};
+  for (const dim_t& ns : sizes) {
+    auto whole = resize_replicate(std::make_shared<landscape_t>(source), ns);
+    BOOST_REQUIRE_EQUAL(whole->size1(), ns[0]);
+    BOOST_REQUIRE_EQUAL(whole->size2(), ns[1]);
+    size_t wrong=0;
+    for (size_t i=0; i<ns[0]; i++) {
+      for (size_t j=0; j<ns[1]; j++) {
+        wrong += (*whole)(i,j)!=source(i%13,j%7);
+      }
+    }
+    BOOST_CHECK_EQUAL(wrong, 0);
+  }
+}
+
+
+
 BOOST_AUTO_TEST_CASE( generate_single_raster )
 {
   typedef boost::array<size_t,2> dim_t;
@@ -88,4 +126,537 @@ BOOST_AUTO_TEST_CASE( generate_raster )
 }
 
 
+BOOST_AUTO_TEST_CASE( generate_raster_regions )
+{
+  // Every value fills one rectangle, tall enough for several TBB bands.
+  typedef boost::array<size_t,2> dim_t;
+  dim_t xy = {{3000,50}};
+  boost::array<unsigned char,2> vals = {{0,200}};
+  auto landscape = multi_value(xy,vals);
+  std::vector<size_t> lo1(256,xy[0]), hi1(256,0), lo2(256,xy[1]), hi2(256,0);
+  std::vector<size_t> cnt(256,0);
+  for (size_t i=0; i<xy[0]; i++) {
+    for (size_t j=0; j<xy[1]; j++) {
+      unsigned char v=(*landscape)(i,j);
+      lo1[v]=std::min(lo1[v],i); hi1[v]=std::max(hi1[v],i+1);
+      lo2[v]=std::min(lo2[v],j); hi2[v]=std::max(hi2[v],j+1);
+      cnt[v]++;
+    }
+  }
+  for (size_t v=0; v<256; v++) {
+    if (v<200) {
+      BOOST_CHECK_EQUAL(cnt[v], (hi1[v]-lo1[v])*(hi2[v]-lo2[v]));
+    } else {
+      BOOST_CHECK_EQUAL(cnt[v], 0);
+    }
+  }
+}
+
+
+BOOST_AUTO_TEST_CASE( generate_empty_raster )
+{
+  typedef boost::array<size_t,2> dim_t;
+  boost::array<unsigned char,2> vals = {{0,4}};
+  auto no_rows = multi_value(dim_t{{0,10}},vals);
+  BOOST_CHECK_EQUAL(no_rows->size1(),0);
+  BOOST_CHECK_EQUAL(no_rows->size2(),10);
+  auto no_columns = multi_value(dim_t{{10,0}},vals);
+  BOOST_CHECK_EQUAL(no_columns->size1(),10);
+  BOOST_CHECK_EQUAL(no_columns->size2(),0);
+}
+
+
+BOOST_AUTO_TEST_CASE( map_tiff_matches_read )
+{
+  auto landscape = read_tiff(SMALL_TIFF);
+  auto mapped = map_raster(SMALL_TIFF);
+  const landscape_view_t& view = mapped->view();
+  BOOST_CHECK_EQUAL(view.size1(),landscape->size1());
+  BOOST_CHECK_EQUAL(view.size2(),landscape->size2());
+  for (size_t i=0; i<view.size1(); i++) {
+    for (size_t j=0; j<view.size2(); j++) {
+      BOOST_CHECK_EQUAL(view(i,j),(*landscape)(i,j));
+    }
+  }
+}
+
+
+
+BOOST_AUTO_TEST_CASE( map_npy_and_raw )
+{
+  test_directory directory;
+  const std::string npy_name = directory.file("map_test.npy");
+  {
+    std::string header("{'descr': '|u1', 'fortran_order': False, 'shape': (3, 4), }");
+    header.append(128-10-header.size()-1,' ');
+    header.push_back('\n');
+    std::ofstream out(npy_name, std::ios::binary);
+    out.write("\x93NUMPY\x01\x00",8);
+    out.put(static_cast<char>(header.size()));
+    out.put(0);
+    out << header;
+    for (char v=0; v<12; v++) {
+      out.put(v);
+    }
+  }
+  auto mapped = map_raster(npy_name.c_str());
+  const landscape_view_t& view = mapped->view();
+  BOOST_CHECK_EQUAL(view.size1(),3);
+  BOOST_CHECK_EQUAL(view.size2(),4);
+  BOOST_CHECK_EQUAL(view(0,0),0);
+  BOOST_CHECK_EQUAL(view(1,2),6);
+  BOOST_CHECK_EQUAL(view(2,3),11);
+
+  // The same bytes, read as a headerless file starting at the pixels.
+  boost::array<size_t,2> dims = {{2,6}};
+  auto raw = map_raw(npy_name.c_str(),dims,128);
+  BOOST_CHECK_EQUAL(raw->view()(1,0),6);
+
+  boost::array<size_t,2> too_big = {{100,100}};
+  BOOST_CHECK_THROW(map_raw(npy_name.c_str(),too_big,128),std::runtime_error);
+}
+
+
+BOOST_AUTO_TEST_CASE( read_gdal_nodata )
+{
+  test_directory directory;
+  const std::string tiff_name = directory.file("nodata_test.tif");
+  {
+    TIFF* out = XTIFFOpen(tiff_name.c_str(),"w");
+    BOOST_REQUIRE(out);
+    TIFFSetField(out, TIFFTAG_IMAGEWIDTH, 4);
+    TIFFSetField(out, TIFFTAG_IMAGELENGTH, 2);
+    TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(out, gdal_nodata_tag, "255");
+    unsigned char line[4] = {255,1,1,255};
+    for (uint32 row=0; row<2; row++) {
+      TIFFWriteScanline(out, line, row);
+    }
+    XTIFFClose(out);
+  }
+  landscape_t::value_type nodata = 0;
+  BOOST_CHECK(tiff_nodata(tiff_name.c_str(), nodata));
+  BOOST_CHECK_EQUAL(nodata, 255);
+
+  BOOST_CHECK(!tiff_nodata(SMALL_TIFF, nodata));
+}
+
+
+/*! Writes pixel (row,col)=(row*7+col*3)%256, by strip when tile is
+ *  zero and by square tiles of that side otherwise.
+ */
+void write_pattern_tiff(const char* name, uint32 width, uint32 height,
+                        uint32 tile, uint16 compression)
+{
+  TIFF* out = XTIFFOpen(name,"w");
+  BOOST_REQUIRE(out);
+  TIFFSetField(out, TIFFTAG_IMAGEWIDTH, width);
+  TIFFSetField(out, TIFFTAG_IMAGELENGTH, height);
+  TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, 8);
+  TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, 1);
+  TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+  TIFFSetField(out, TIFFTAG_COMPRESSION, compression);
+  if (tile) {
+    TIFFSetField(out, TIFFTAG_TILEWIDTH, tile);
+    TIFFSetField(out, TIFFTAG_TILELENGTH, tile);
+    std::vector<unsigned char> buffer(tile*tile);
+    for (uint32 y=0; y<height; y+=tile) {
+      for (uint32 x=0; x<width; x+=tile) {
+        for (uint32 r=0; r<tile; r++) {
+          for (uint32 c=0; c<tile; c++) {
+            buffer[r*tile+c]=((y+r)*7+(x+c)*3)%256;
+          }
+        }
+        TIFFWriteEncodedTile(out, TIFFComputeTile(out,x,y,0,0),
+                             &buffer[0], buffer.size());
+      }
+    }
+  } else {
+    TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, 3);
+    std::vector<unsigned char> line(width);
+    for (uint32 row=0; row<height; row++) {
+      for (uint32 col=0; col<width; col++) {
+        line[col]=(row*7+col*3)%256;
+      }
+      TIFFWriteScanline(out, &line[0], row);
+    }
+  }
+  XTIFFClose(out);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( read_strips_and_tiles )
+{
+  test_directory directory;
+  const std::string tiff_name = directory.file("blocks_test.tif");
+  const uint32 width=45, height=38;
+  std::vector<uint16> compressions(1,COMPRESSION_NONE);
+  if (TIFFIsCODECConfigured(COMPRESSION_ADOBE_DEFLATE)) {
+    compressions.push_back(COMPRESSION_ADOBE_DEFLATE);
+  }
+  for (size_t c=0; c<compressions.size(); c++) {
+    for (uint32 tile=0; tile<=16; tile+=16) {
+      write_pattern_tiff(tiff_name.c_str(), width, height, tile, compressions[c]);
+      raster_tile_hashes hashes;
+      auto landscape = read_tiff(tiff_name.c_str(), hashes, 32);
+      BOOST_CHECK_EQUAL(hashes.raster, hash_tiles(*landscape, 32).raster);
+      BOOST_REQUIRE_EQUAL(landscape->size1(),height);
+      BOOST_REQUIRE_EQUAL(landscape->size2(),width);
+      // The first scanline is at the bottom.
+      for (uint32 row=0; row<height; row++) {
+        for (uint32 col=0; col<width; col++) {
+          BOOST_CHECK_EQUAL((*landscape)(height-row-1,col),(row*7+col*3)%256);
+        }
+      }
+    }
+  }
+}
+
+
+/*! Writes a pattern band b holds at (row,col), for every sample type
+ *  T, samples bands, interleaved or separate, by strip or by tile.
+ */
+template<class T>
+T band_pattern(uint32 row, uint32 col, uint16 band)
+{
+  return T((row*7+col*3+band*11)%251)+T(band)/T(2);
+}
+
+
+
+template<class T>
+void write_band_tiff(const char* name, uint32 width, uint32 height,
+                     uint16 samples, uint16 format, uint16 planar, uint32 tile)
+{
+  TIFF* out = XTIFFOpen(name,"w");
+  BOOST_REQUIRE(out);
+  TIFFSetField(out, TIFFTAG_IMAGEWIDTH, width);
+  TIFFSetField(out, TIFFTAG_IMAGELENGTH, height);
+  TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, 8*sizeof(T));
+  TIFFSetField(out, TIFFTAG_SAMPLEFORMAT, format);
+  TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, samples);
+  TIFFSetField(out, TIFFTAG_PLANARCONFIG, planar);
+  TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+  TIFFSetField(out, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+  const bool separate = planar==PLANARCONFIG_SEPARATE;
+  const uint16 planes = separate ? samples : 1;
+  const uint16 interleave = separate ? 1 : samples;
+  if (tile) {
+    TIFFSetField(out, TIFFTAG_TILEWIDTH, tile);
+    TIFFSetField(out, TIFFTAG_TILELENGTH, tile);
+    std::vector<T> buffer(tile*tile*interleave);
+    for (uint16 plane=0; plane<planes; plane++) {
+      for (uint32 y=0; y<height; y+=tile) {
+        for (uint32 x=0; x<width; x+=tile) {
+          for (uint32 r=0; r<tile; r++) {
+            for (uint32 c=0; c<tile; c++) {
+              for (uint16 s=0; s<interleave; s++) {
+                buffer[(r*tile+c)*interleave+s]=
+                  band_pattern<T>(y+r,x+c,separate ? plane : s);
+              }
+            }
+          }
+          TIFFWriteEncodedTile(out, TIFFComputeTile(out,x,y,0,plane),
+                               &buffer[0], buffer.size()*sizeof(T));
+        }
+      }
+    }
+  } else {
+    TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, 3);
+    std::vector<T> line(width*interleave);
+    for (uint16 plane=0; plane<planes; plane++) {
+      for (uint32 row=0; row<height; row++) {
+        for (uint32 col=0; col<width; col++) {
+          for (uint16 s=0; s<interleave; s++) {
+            line[col*interleave+s]=band_pattern<T>(row,col,separate ? plane : s);
+          }
+        }
+        TIFFWriteScanline(out, &line[0], row, plane);
+      }
+    }
+  }
+  XTIFFClose(out);
+}
+
+
+
+template<class T>
+void check_band_tiff(uint16 samples, uint16 format, uint16 planar, uint32 tile)
+{
+  test_directory directory;
+  const std::string tiff_name = directory.file("bands_test.tif");
+  const uint32 width = 37, height = 29;
+  write_band_tiff<T>(tiff_name.c_str(), width, height, samples, format,
+                     planar, tile);
+  tiff_sample_format found = tiff_samples(tiff_name.c_str());
+  BOOST_CHECK_EQUAL(found.bits_per_sample, 8*sizeof(T));
+  BOOST_CHECK_EQUAL(found.samples_per_pixel, samples);
+
+  auto bands = read_tiff_bands<T>(tiff_name.c_str());
+  BOOST_REQUIRE_EQUAL(bands.size(), samples);
+  for (uint16 band=0; band<samples; band++) {
+    BOOST_REQUIRE_EQUAL(bands[band]->size1(),height);
+    BOOST_REQUIRE_EQUAL(bands[band]->size2(),width);
+    size_t wrong=0;
+    for (uint32 row=0; row<height; row++) {
+      for (uint32 col=0; col<width; col++) {
+        wrong += (*bands[band])(height-row-1,col)!=band_pattern<T>(row,col,band);
+      }
+    }
+    BOOST_CHECK_EQUAL(wrong, 0);
+  }
+}
+
+
+
+BOOST_AUTO_TEST_CASE( read_sample_types )
+{
+  uint32 tiles[] = { 0, 16 };
+  for (uint32 tile : tiles) {
+    check_band_tiff<uint16_t>(1, SAMPLEFORMAT_UINT, PLANARCONFIG_CONTIG, tile);
+    check_band_tiff<int32_t>(1, SAMPLEFORMAT_INT, PLANARCONFIG_CONTIG, tile);
+    check_band_tiff<float>(1, SAMPLEFORMAT_IEEEFP, PLANARCONFIG_CONTIG, tile);
+    check_band_tiff<unsigned char>(3, SAMPLEFORMAT_UINT, PLANARCONFIG_CONTIG, tile);
+    check_band_tiff<unsigned char>(3, SAMPLEFORMAT_UINT, PLANARCONFIG_SEPARATE, tile);
+    check_band_tiff<float>(2, SAMPLEFORMAT_IEEEFP, PLANARCONFIG_SEPARATE, tile);
+  }
+}
+
+
+
+BOOST_AUTO_TEST_CASE( read_first_band )
+{
+  // read_tiff takes band 0, whether samples are interleaved or separate.
+  test_directory directory;
+  const std::string tiff_name = directory.file("first_band_test.tif");
+  uint16 planars[] = { PLANARCONFIG_CONTIG, PLANARCONFIG_SEPARATE };
+  for (uint16 planar : planars) {
+    for (uint32 tile=0; tile<=16; tile+=16) {
+      write_band_tiff<unsigned char>(tiff_name.c_str(), 37, 29, 3,
+                                     SAMPLEFORMAT_UINT, planar, tile);
+      auto first = read_tiff(tiff_name.c_str());
+      auto bands = read_tiff_bands<unsigned char>(tiff_name.c_str());
+      BOOST_REQUIRE_EQUAL(first->size1(), 29);
+      BOOST_REQUIRE_EQUAL(first->size2(), 37);
+      BOOST_CHECK(std::equal(first->data().begin(), first->data().end(),
+                             bands[0]->data().begin()));
+    }
+  }
+}
+
+
+
+BOOST_AUTO_TEST_CASE( read_packed_samples )
+{
+  // Samples under a byte are unpacked, one to a pixel.
+  test_directory directory;
+  const std::string tiff_name = directory.file("packed_test.tif");
+  const uint32 width = 13, height = 5;
+  uint16 bit_cnts[] = { 1, 2, 4 };
+  for (uint16 bits : bit_cnts) {
+    const unsigned mask = (1u<<bits)-1;
+    {
+      TIFF* out = XTIFFOpen(tiff_name.c_str(),"w");
+      BOOST_REQUIRE(out);
+      TIFFSetField(out, TIFFTAG_IMAGEWIDTH, width);
+      TIFFSetField(out, TIFFTAG_IMAGELENGTH, height);
+      TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, bits);
+      TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, 1);
+      TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+      TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, 2);
+      std::vector<unsigned char> line((width*bits+7)/8);
+      for (uint32 row=0; row<height; row++) {
+        std::fill(line.begin(), line.end(), 0);
+        for (uint32 col=0; col<width; col++) {
+          const size_t bit = size_t(col)*bits;
+          line[bit/8] |= ((row+col*3)&mask) << (8-bits-bit%8);
+        }
+        TIFFWriteScanline(out, &line[0], row);
+      }
+      XTIFFClose(out);
+    }
+    auto landscape = read_tiff(tiff_name.c_str());
+    BOOST_REQUIRE_EQUAL(landscape->size1(), height);
+    BOOST_REQUIRE_EQUAL(landscape->size2(), width);
+    size_t wrong=0;
+    for (uint32 row=0; row<height; row++) {
+      for (uint32 col=0; col<width; col++) {
+        wrong += (*landscape)(height-row-1,col) != ((row+col*3)&mask);
+      }
+    }
+    BOOST_CHECK_EQUAL(wrong, 0);
+  }
+}
+
+
+
+BOOST_AUTO_TEST_CASE( read_wrong_sample_type )
+{
+  test_directory directory;
+  const std::string tiff_name = directory.file("wrong_type_test.tif");
+  write_band_tiff<uint16_t>(tiff_name.c_str(), 8, 8, 1, SAMPLEFORMAT_UINT,
+                            PLANARCONFIG_CONTIG, 0);
+  BOOST_CHECK_THROW(read_tiff(tiff_name.c_str()), std::runtime_error);
+  BOOST_CHECK_THROW(read_tiff_bands<int16_t>(tiff_name.c_str()),
+                    std::runtime_error);
+  BOOST_CHECK_NO_THROW(read_tiff_bands<uint16_t>(tiff_name.c_str()));
+}
+
+
+
+BOOST_AUTO_TEST_CASE( write_labels_tiled )
+{
+  test_directory directory;
+  const std::string source_name = directory.file("labels_source.tif");
+  const std::string tiff_name = directory.file("labels_test.tif");
+  // A source with georeferencing to copy.
+  {
+    TIFF* source = XTIFFOpen(source_name.c_str(),"w");
+    BOOST_REQUIRE(source);
+    TIFFSetField(source, TIFFTAG_IMAGEWIDTH, 8);
+    TIFFSetField(source, TIFFTAG_IMAGELENGTH, 1);
+    TIFFSetField(source, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(source, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(source, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    double scale[] = { 30, 30, 0 };
+    double tie[] = { 0, 0, 0, 500000, 4100000, 0 };
+    uint16 keys[] = { 1, 1, 0, 1, 3072, 0, 1, 26917 };
+    TIFFSetField(source, geo_pixel_scale_tag, 3, scale);
+    TIFFSetField(source, geo_tie_points_tag, 6, tie);
+    TIFFSetField(source, geo_key_directory_tag, 8, keys);
+    TIFFSetField(source, geo_ascii_params_tag, "NAD83 / UTM zone 17N|");
+    unsigned char line[8] = { 0 };
+    TIFFWriteScanline(source, line, 0);
+    XTIFFClose(source);
+  }
+
+  // 475 tiles, more than one batch, and edges that are not whole tiles.
+  const size_t width = 397, height = 301;
+  cluster_t clusters(3);
+  for (size_t pixel=0; pixel<width*height; pixel++) {
+    if (pixel%5) {
+      std::next(clusters.begin(), pixel%3)->push_back(pixel);
+    }
+  }
+  label_landscape_t labels = cluster_labels(clusters, height, width);
+  BOOST_CHECK_EQUAL(labels(0,0), 0);
+  BOOST_CHECK_EQUAL(labels(0,1), 2);
+
+  std::vector<tiff_compression> compressions = { tiff_none, tiff_deflate };
+  if (TIFFIsCODECConfigured(COMPRESSION_ZSTD)) {
+    compressions.push_back(tiff_zstd);
+  }
+  for (tiff_compression compression : compressions) {
+    write_tiff_labels(labels, tiff_name.c_str(), source_name.c_str(),
+                      compression, 16);
+    auto bands = read_tiff_bands<uint32_t>(tiff_name.c_str());
+    BOOST_REQUIRE_EQUAL(bands.size(), 1);
+    BOOST_REQUIRE_EQUAL(bands[0]->size1(), height);
+    BOOST_REQUIRE_EQUAL(bands[0]->size2(), width);
+    BOOST_CHECK(std::equal(labels.data().begin(), labels.data().end(),
+                           bands[0]->data().begin()));
+
+    TIFF* written = XTIFFOpen(tiff_name.c_str(),"r");
+    BOOST_REQUIRE(written);
+    BOOST_CHECK(TIFFIsTiled(written));
+    uint16 count = 0;
+    double* values = 0;
+    BOOST_REQUIRE(TIFFGetField(written, geo_tie_points_tag, &count, &values));
+    BOOST_CHECK_EQUAL(count, 6);
+    BOOST_CHECK_EQUAL(values[4], 4100000);
+    uint16* keys = 0;
+    BOOST_REQUIRE(TIFFGetField(written, geo_key_directory_tag, &count, &keys));
+    BOOST_CHECK_EQUAL(count, 8);
+    BOOST_CHECK_EQUAL(keys[7], 26917);
+    char* text = 0;
+    BOOST_REQUIRE(TIFFGetField(written, geo_ascii_params_tag, &text));
+    BOOST_CHECK_EQUAL(std::string(text), "NAD83 / UTM zone 17N|");
+    XTIFFClose(written);
+  }
+  BOOST_CHECK_THROW(write_tiff_labels(labels, tiff_name.c_str(), 0,
+                                      tiff_deflate, 20),
+                    std::runtime_error);
+}
+
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+
+BOOST_AUTO_TEST_SUITE( ppm )
+
+//! Reads back a binary PGM or PPM header and its pixels.
+std::vector<unsigned char> read_netpbm(const char* name, std::string& magic,
+                                       size_t& width, size_t& height)
+{
+  std::ifstream in(name, std::ios::binary);
+  int maxval = 0;
+  in >> magic >> width >> height >> maxval;
+  BOOST_CHECK_EQUAL(maxval, 255);
+  in.get();
+  std::vector<char> bytes((std::istreambuf_iterator<char>(in)),
+                          std::istreambuf_iterator<char>());
+  return std::vector<unsigned char>(bytes.begin(), bytes.end());
+}
+
+
+
+BOOST_AUTO_TEST_CASE( write_binary_pgm )
+{
+  test_directory directory;
+  const std::string name = directory.file("binary_test.pgm");
+  landscape_t raster(3,5);
+  for (size_t i=0; i<raster.size1(); i++) {
+    for (size_t j=0; j<raster.size2(); j++) {
+      raster(i,j) = 200+10*i+j;
+    }
+  }
+  write_ppm(raster, name.c_str());
+  std::string magic;
+  size_t width=0, height=0;
+  auto pixels = read_netpbm(name.c_str(), magic, width, height);
+  BOOST_CHECK_EQUAL(magic, "P5");
+  BOOST_CHECK_EQUAL(width, 5);
+  BOOST_CHECK_EQUAL(height, 3);
+  BOOST_REQUIRE_EQUAL(pixels.size(), 15);
+  // The last row is written first.
+  for (size_t i=0; i<height; i++) {
+    for (size_t j=0; j<width; j++) {
+      BOOST_CHECK_EQUAL(pixels[i*width+j], raster(height-i-1,j));
+    }
+  }
+}
+
+
+
+BOOST_AUTO_TEST_CASE( write_label_ppm )
+{
+  test_directory directory;
+  const std::string name = directory.file("labels_test.ppm");
+  label_landscape_t labels(2,4);
+  for (size_t k=0; k<labels.data().size(); k++) {
+    labels.data()[k] = k;
+  }
+  write_ppm_labels(labels, name.c_str());
+  std::string magic;
+  size_t width=0, height=0;
+  auto pixels = read_netpbm(name.c_str(), magic, width, height);
+  BOOST_CHECK_EQUAL(magic, "P6");
+  BOOST_REQUIRE_EQUAL(pixels.size(), 3*8);
+  BOOST_CHECK_EQUAL(label_color(0), 0);
+  BOOST_CHECK(label_color(1) != label_color(2));
+  for (size_t i=0; i<height; i++) {
+    for (size_t j=0; j<width; j++) {
+      const unsigned char* rgb = &pixels[3*(i*width+j)];
+      uint32_t color = (rgb[0]<<16) | (rgb[1]<<8) | rgb[2];
+      BOOST_CHECK_EQUAL(color, label_color(labels(height-i-1,j)));
+    }
+  }
+}
+
+
 BOOST_AUTO_TEST_SUITE_END()
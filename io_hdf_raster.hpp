@@ -0,0 +1,320 @@
+#ifndef _IO_HDF_RASTER_HPP_
+#define _IO_HDF_RASTER_HPP_ 1
+
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/array.hpp>
+#include <boost/numeric/ublas/matrix.hpp>
+#include "H5Cpp.h"
+#include "raster.hpp"
+#include "raster_pyramid.hpp"
+
+
+/*! Store rasters and cluster results in HDF5, so a pipeline can stream
+ *  through a file larger than memory and pick up where it stopped.
+ *  Rasters are chunked, deflated 2D datasets, read and written as bands
+ *  of whole rows, which are hyperslabs. Each raster dataset counts how
+ *  many rows have been written in order, in its "rows written"
+ *  attribute, so a restarted run can skip them. Clusters are stored
+ *  as CSR, a group holding "offsets", where cluster k is
+ *  members[offsets[k]] to members[offsets[k+1]], and "members".
+ *  A pyramid is a group holding "classes", a raster "mode k" for each
+ *  level k, and "presence k" for the levels that have masks, so one
+ *  level can be read alone with read_raster.
+ *  Errors from HDF5 come out as H5::Exception.
+ */
+
+
+namespace raster_stats
+{
+    //! The HDF5 type of a pixel.
+    template<class T> const H5::PredType& hdf_type();
+    template<> inline const H5::PredType& hdf_type<unsigned char>() {
+        return H5::PredType::NATIVE_UCHAR;
+    }
+    template<> inline const H5::PredType& hdf_type<uint16_t>() {
+        return H5::PredType::NATIVE_UINT16;
+    }
+    template<> inline const H5::PredType& hdf_type<uint32_t>() {
+        return H5::PredType::NATIVE_UINT32;
+    }
+    template<> inline const H5::PredType& hdf_type<uint64_t>() {
+        return H5::PredType::NATIVE_UINT64;
+    }
+    template<> inline const H5::PredType& hdf_type<float>() {
+        return H5::PredType::NATIVE_FLOAT;
+    }
+
+
+
+    class raster_file
+    {
+        H5::H5File file_;
+        static const char* rows_written_name() { return "rows written"; }
+
+        /*! Chunked, and deflated if deflate is above zero. The callers
+         *  make maxdims unlimited, because HDF5 takes a chunk larger
+         *  than a fixed-size dataset only then, and a chunk here may be
+         *  larger than the data or the data may be empty.
+         */
+        H5::DSetCreatPropList chunked(int rank, const hsize_t* chunk,
+                                      int deflate) {
+            H5::DSetCreatPropList properties;
+            properties.setChunk(rank, chunk);
+            if (deflate>0) {
+                properties.setDeflate(deflate);
+            }
+            return properties;
+        }
+
+        template<class T>
+        void write_array(const std::string& name, const std::vector<T>& values,
+                         int deflate) {
+            hsize_t dims[1] = { values.size() };
+            hsize_t maxdims[1] = { H5S_UNLIMITED };
+            hsize_t chunk[1] = { std::min<hsize_t>(std::max<hsize_t>(dims[0],1),
+                                                   1<<16) };
+            H5::DataSpace space(1, dims, maxdims);
+            H5::DataSet dataset = file_.createDataSet(name, hdf_type<T>(), space,
+                                             chunked(1, chunk, deflate));
+            if (!values.empty()) {
+                dataset.write(&values[0], hdf_type<T>());
+            }
+        }
+
+        template<class T>
+        std::vector<T> read_array(const std::string& name) {
+            H5::DataSet dataset = file_.openDataSet(name);
+            hsize_t dims[1] = { 0 };
+            dataset.getSpace().getSimpleExtentDims(dims);
+            std::vector<T> values(dims[0]);
+            if (!values.empty()) {
+                dataset.read(&values[0], hdf_type<T>());
+            }
+            return values;
+        }
+
+        //! Selects rows [first_row, first_row+rows) of a raster.
+        H5::DataSpace select_rows(H5::DataSet& dataset, size_t first_row,
+                                  size_t rows, size_t jcnt) {
+            H5::DataSpace file_space = dataset.getSpace();
+            hsize_t dims[2] = { 0, 0 };
+            file_space.getSimpleExtentDims(dims);
+            if (first_row+rows>dims[0] || jcnt!=dims[1]) {
+                throw std::runtime_error("Rows do not fit the HDF5 raster.");
+            }
+            hsize_t start[2] = { first_row, 0 };
+            hsize_t count[2] = { rows, jcnt };
+            file_space.selectHyperslab(H5S_SELECT_SET, count, start);
+            return file_space;
+        }
+
+    public:
+        /*! Opens a file to read and write, or creates it, emptied,
+         *  if create is true.
+         */
+        raster_file(const std::string& filename, bool create)
+            : file_(filename, create ? H5F_ACC_TRUNC : H5F_ACC_RDWR) {}
+
+        /*! Makes an empty raster of icnt rows and jcnt columns, stored
+         *  in square chunks of side chunk and deflated at level deflate,
+         *  0 for none. Fill it with write_rows.
+         */
+        template<class T>
+        void create_raster(const std::string& name, size_t icnt, size_t jcnt,
+                           size_t chunk=256, int deflate=4) {
+            hsize_t dims[2] = { icnt, jcnt };
+            hsize_t maxdims[2] = { H5S_UNLIMITED, H5S_UNLIMITED };
+            hsize_t chunks[2] = { std::max<hsize_t>(1,std::min<hsize_t>(chunk,icnt)),
+                                  std::max<hsize_t>(1,std::min<hsize_t>(chunk,jcnt)) };
+            H5::DataSpace space(2, dims, maxdims);
+            H5::DataSet dataset = file_.createDataSet(name, hdf_type<T>(), space,
+                                             chunked(2, chunks, deflate));
+            uint64_t none = 0;
+            dataset.createAttribute(rows_written_name(),
+                                    H5::PredType::NATIVE_UINT64,
+                                    H5::DataSpace(H5S_SCALAR))
+                .write(H5::PredType::NATIVE_UINT64, &none);
+        }
+
+        //! Rows and columns of a raster.
+        boost::array<size_t,2> dimensions(const std::string& name) {
+            hsize_t dims[2] = { 0, 0 };
+            file_.openDataSet(name).getSpace().getSimpleExtentDims(dims);
+            boost::array<size_t,2> ns = {{ size_t(dims[0]), size_t(dims[1]) }};
+            return ns;
+        }
+
+        /*! Writes band, all of whose rows are raster rows from first_row.
+         *  If the band starts where the last one in order ended, the
+         *  "rows written" attribute moves past it.
+         */
+        template<class T>
+        void write_rows(const std::string& name,
+                        const boost::numeric::ublas::matrix<T>& band,
+                        size_t first_row) {
+            if (0 == band.size1()) {
+                return;
+            }
+            H5::DataSet dataset = file_.openDataSet(name);
+            H5::DataSpace file_space = select_rows(dataset, first_row,
+                                                   band.size1(), band.size2());
+            hsize_t count[2] = { band.size1(), band.size2() };
+            H5::DataSpace memory_space(2, count);
+            dataset.write(&band.data()[0], hdf_type<T>(), memory_space, file_space);
+
+            H5::Attribute attribute = dataset.openAttribute(rows_written_name());
+            uint64_t written = 0;
+            attribute.read(H5::PredType::NATIVE_UINT64, &written);
+            if (first_row<=written && first_row+band.size1()>written) {
+                written = first_row+band.size1();
+                attribute.write(H5::PredType::NATIVE_UINT64, &written);
+            }
+        }
+
+        //! How many rows from the first have been written, in order.
+        size_t rows_written(const std::string& name) {
+            uint64_t written = 0;
+            file_.openDataSet(name).openAttribute(rows_written_name())
+                .read(H5::PredType::NATIVE_UINT64, &written);
+            return written;
+        }
+
+        //! Reads band.size1() rows from first_row into band.
+        template<class T>
+        void read_rows(const std::string& name,
+                       boost::numeric::ublas::matrix<T>& band,
+                       size_t first_row) {
+            if (0 == band.size1()) {
+                return;
+            }
+            H5::DataSet dataset = file_.openDataSet(name);
+            H5::DataSpace file_space = select_rows(dataset, first_row,
+                                                   band.size1(), band.size2());
+            hsize_t count[2] = { band.size1(), band.size2() };
+            H5::DataSpace memory_space(2, count);
+            dataset.read(&band.data()[0], hdf_type<T>(), memory_space, file_space);
+        }
+
+        /*! Calls f(band, first_row) for bands of rows rows from
+         *  first_row to the end, the last band possibly shorter, so
+         *  only one band is in memory at a time. rows must not be 0.
+         */
+        template<class T, class F>
+        void for_each_band(const std::string& name, size_t rows, F f,
+                           size_t first_row=0) {
+            if (0 == rows) {
+                throw std::runtime_error("Bands must have rows.");
+            }
+            const boost::array<size_t,2> ns = dimensions(name);
+            boost::numeric::ublas::matrix<T> band;
+            for (size_t row=first_row; row<ns[0]; row+=rows) {
+                band.resize(std::min(rows, ns[0]-row), ns[1], false);
+                read_rows(name, band, row);
+                f(static_cast<const boost::numeric::ublas::matrix<T>&>(band), row);
+            }
+        }
+
+        //! Writes a whole raster at once.
+        template<class T>
+        void write_raster(const std::string& name,
+                          const boost::numeric::ublas::matrix<T>& raster,
+                          size_t chunk=256, int deflate=4) {
+            create_raster<T>(name, raster.size1(), raster.size2(), chunk, deflate);
+            write_rows(name, raster, 0);
+        }
+
+        template<class T>
+        std::shared_ptr<boost::numeric::ublas::matrix<T> >
+        read_raster(const std::string& name) {
+            const boost::array<size_t,2> ns = dimensions(name);
+            auto raster = std::make_shared<boost::numeric::ublas::matrix<T> >(
+                                                                 ns[0], ns[1]);
+            read_rows(name, *raster, 0);
+            return raster;
+        }
+
+        //! Writes clusters as CSR in a new group called name.
+        template<class CLUSTERS>
+        void write_clusters(const std::string& name, const CLUSTERS& clusters,
+                            int deflate=4) {
+            std::vector<uint64_t> offsets(1, 0);
+            std::vector<uint64_t> members;
+            for (const auto& cluster : clusters) {
+                members.insert(members.end(), cluster.begin(), cluster.end());
+                offsets.push_back(members.size());
+            }
+            file_.createGroup(name);
+            write_array(name+"/offsets", offsets, deflate);
+            write_array(name+"/members", members, deflate);
+        }
+
+        cluster_t read_clusters(const std::string& name) {
+            std::vector<uint64_t> offsets = read_array<uint64_t>(name+"/offsets");
+            std::vector<uint64_t> members = read_array<uint64_t>(name+"/members");
+            if (offsets.empty() || offsets.back()!=members.size()) {
+                throw std::runtime_error("HDF5 cluster offsets do not match members.");
+            }
+            cluster_t clusters;
+            for (size_t k=0; k+1<offsets.size(); k++) {
+                clusters.emplace_back(members.begin()+offsets[k],
+                                      members.begin()+offsets[k+1]);
+            }
+            return clusters;
+        }
+
+        //! The name of a raster of the pyramid in group name.
+        static std::string pyramid_level(const std::string& name,
+                                         const char* kind, size_t level) {
+            std::stringstream level_name;
+            level_name << name << "/" << kind << " " << level;
+            return level_name.str();
+        }
+
+        //! Writes every level of pyramid in a new group called name.
+        void write_pyramid(const std::string& name, const raster_pyramid& pyramid,
+                           size_t chunk=256, int deflate=4) {
+            H5::Group group = file_.createGroup(name);
+            uint64_t levels = pyramid.levels();
+            group.createAttribute("levels", H5::PredType::NATIVE_UINT64,
+                                  H5::DataSpace(H5S_SCALAR))
+                .write(H5::PredType::NATIVE_UINT64, &levels);
+            write_array(name+"/classes", pyramid.classes, deflate);
+            for (size_t level=0; level<pyramid.levels(); level++) {
+                write_raster(pyramid_level(name, "mode", level),
+                             pyramid.mode[level], chunk, deflate);
+                if (!pyramid.presence[level].data().empty()) {
+                    write_raster(pyramid_level(name, "presence", level),
+                                 pyramid.presence[level], chunk, deflate);
+                }
+            }
+        }
+
+        raster_pyramid read_pyramid(const std::string& name) {
+            uint64_t levels = 0;
+            file_.openGroup(name).openAttribute("levels")
+                .read(H5::PredType::NATIVE_UINT64, &levels);
+            raster_pyramid pyramid;
+            pyramid.classes = read_array<unsigned char>(name+"/classes");
+            for (size_t level=0; level<levels; level++) {
+                pyramid.mode.push_back(
+                    *read_raster<unsigned char>(pyramid_level(name, "mode", level)));
+                pyramid.presence.push_back(presence_landscape_t());
+                if (level>0 && !pyramid.classes.empty()) {
+                    pyramid.presence.back() =
+                        *read_raster<uint64_t>(pyramid_level(name, "presence", level));
+                }
+            }
+            return pyramid;
+        }
+    };
+}
+
+
+#endif // _IO_HDF_RASTER_HPP_
@@ -0,0 +1,236 @@
+/*! io_mmap.cpp
+ *  Maps raster files into memory for zero-copy reading.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "io_mmap.hpp"
+
+using namespace std;
+
+namespace raster_stats {
+
+
+mapped_raster::mapped_raster(const char* filename)
+    : filename_(filename), fd_(-1), map_(0), map_size_(0)
+{
+    fd_ = ::open(filename, O_RDONLY);
+    if (fd_ < 0) {
+        throw std::runtime_error("Could not open file to map: "+filename_);
+    }
+    struct stat file_stat;
+    if (0 != ::fstat(fd_, &file_stat) || file_stat.st_size == 0) {
+        ::close(fd_);
+        throw std::runtime_error("Could not find size of file to map: "+filename_);
+    }
+    map_size_ = file_stat.st_size;
+
+    // MAP_SHARED of a read-only file means every process mapping it
+    // reads the same pages from the page cache.
+    void* addr = ::mmap(0, map_size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (MAP_FAILED == addr) {
+        ::close(fd_);
+        throw std::runtime_error("Could not map file: "+filename_);
+    }
+    map_ = static_cast<const unsigned char*>(addr);
+}
+
+
+
+mapped_raster::~mapped_raster()
+{
+    if (map_) {
+        ::munmap(const_cast<unsigned char*>(map_), map_size_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+
+
+void mapped_raster::set_view(size_t offset, size_t size1, size_t size2,
+                             landscape_view_t::stride_type stride)
+{
+    if (size1 == 0 || size2 == 0) {
+        throw std::runtime_error("Mapped raster has no pixels: "+filename_);
+    }
+    // Check the first and last rows, whichever direction the stride goes.
+    std::ptrdiff_t last_row = std::ptrdiff_t(offset) + stride*std::ptrdiff_t(size1-1);
+    std::ptrdiff_t low  = std::min<std::ptrdiff_t>(offset, last_row);
+    std::ptrdiff_t high = std::max<std::ptrdiff_t>(offset, last_row) + size2;
+    if (low < 0 || size_t(high) > map_size_) {
+        throw std::runtime_error("Raster extends past the end of the file: "+
+                                 filename_);
+    }
+    view_ = landscape_view_t(map_+offset, size1, size2, stride);
+}
+
+
+
+void mapped_raster::prefetch() const
+{
+    ::madvise(const_cast<unsigned char*>(map_), map_size_, MADV_WILLNEED);
+}
+
+
+
+bool mapped_raster::contains(uint64_t offset, uint64_t count,
+                             size_t item_size) const
+{
+    // Divide rather than multiply, so a corrupt count cannot overflow.
+    return offset <= map_size_ && offset%std::min<size_t>(item_size,8) == 0 &&
+        count <= (map_size_-offset)/item_size;
+}
+
+
+
+mapped_file_writer::mapped_file_writer(const std::string& filename,
+                                       const std::string& what)
+    : filename_(filename), what_(what), committed_(false)
+{
+    std::stringstream temporary;
+    temporary << filename << ".tmp" << ::getpid();
+    temporary_ = temporary.str();
+    out_.open(temporary_.c_str(), ios::out | ios::binary);
+    if (!out_) {
+        throw std::runtime_error("Could not write "+what_+": "+filename_);
+    }
+}
+
+
+
+mapped_file_writer::~mapped_file_writer()
+{
+    if (!committed_) {
+        out_.close();
+        std::remove(temporary_.c_str());
+    }
+}
+
+
+
+void mapped_file_writer::write_padded_bytes(const void* bytes, size_t size)
+{
+    if (size) {
+        out_.write(static_cast<const char*>(bytes), size);
+    }
+    const char zeros[8] = { 0 };
+    out_.write(zeros, align8(size)-size);
+}
+
+
+
+void mapped_file_writer::commit()
+{
+    out_.close();
+    if (!out_ || 0 != std::rename(temporary_.c_str(), filename_.c_str())) {
+        throw std::runtime_error("Could not write "+what_+": "+filename_);
+    }
+    committed_ = true;
+}
+
+
+
+std::shared_ptr<mapped_raster> map_raw(const char* filename,
+                                       boost::array<size_t,2> dims,
+                                       size_t offset)
+{
+    auto mapped = std::make_shared<mapped_raster>(filename);
+    mapped->set_view(offset, dims[0], dims[1], dims[1]);
+    return mapped;
+}
+
+
+
+/*! The .npy format is a magic string, a version, a header length,
+ *  and a header that is a Python dict literal, such as
+ *  {'descr': '|u1', 'fortran_order': False, 'shape': (7, 24), }
+ *  The data follows immediately, row-major unless fortran_order is True.
+ */
+std::shared_ptr<mapped_raster> map_npy(const char* filename)
+{
+    auto mapped = std::make_shared<mapped_raster>(filename);
+    const unsigned char* bytes = mapped->data();
+    const size_t file_size = mapped->size();
+
+    const char magic[] = "\x93NUMPY";
+    if (file_size < 10 || 0 != std::memcmp(bytes, magic, 6)) {
+        throw std::runtime_error("Not a numpy file.");
+    }
+    size_t header_len, header_start;
+    if (bytes[6] == 1) {
+        header_len   = bytes[8] | (bytes[9]<<8);
+        header_start = 10;
+    } else {
+        if (file_size < 12) {
+            throw std::runtime_error("Numpy header is truncated.");
+        }
+        header_len   = bytes[8] | (bytes[9]<<8) | (bytes[10]<<16) |
+            (size_t(bytes[11])<<24);
+        header_start = 12;
+    }
+    if (header_start+header_len > file_size) {
+        throw std::runtime_error("Numpy header is truncated.");
+    }
+    std::string header(reinterpret_cast<const char*>(bytes+header_start),
+                       header_len);
+
+    size_t descr = header.find("'descr'");
+    if (descr == std::string::npos ||
+            header.find("u1'", descr) == std::string::npos) {
+        throw std::runtime_error("Can only map numpy arrays of uint8.");
+    }
+    if (header.find("'fortran_order': False") == std::string::npos) {
+        throw std::runtime_error("Can only map C-ordered numpy arrays.");
+    }
+    size_t shape = header.find("'shape'");
+    size_t open_paren = header.find('(', shape);
+    size_t close_paren = header.find(')', open_paren);
+    if (shape == std::string::npos || open_paren == std::string::npos ||
+            close_paren == std::string::npos) {
+        throw std::runtime_error("Could not read numpy shape.");
+    }
+    std::stringstream shape_str(header.substr(open_paren+1,
+                                              close_paren-open_paren-1));
+    boost::array<size_t,2> dims;
+    char comma;
+    if (!(shape_str >> dims[0] >> comma >> dims[1]) || comma != ',') {
+        throw std::runtime_error("Can only map two-dimensional numpy arrays.");
+    }
+    // A trailing comma is allowed, but not a third dimension.
+    size_t third;
+    if (shape_str >> comma && shape_str >> third) {
+        throw std::runtime_error("Can only map two-dimensional numpy arrays.");
+    }
+
+    mapped->set_view(header_start+header_len, dims[0], dims[1], dims[1]);
+    return mapped;
+}
+
+
+
+std::shared_ptr<mapped_raster> map_raster(const char* filename)
+{
+    std::string name(filename);
+    size_t dot = name.rfind('.');
+    std::string extension = (dot == std::string::npos) ? "" : name.substr(dot);
+    if (extension == ".npy") {
+        return map_npy(filename);
+    } else if (extension == ".tif" || extension == ".tiff") {
+        return map_tiff(filename);
+    }
+    throw std::runtime_error("Cannot tell how to map "+name+
+                             ". Use map_raw for headerless files.");
+}
+
+
+} // namespace
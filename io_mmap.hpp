@@ -0,0 +1,109 @@
+/*! io_mmap.hpp
+ *  Memory-mapped raster input. The file is mapped read-only and shared,
+ *  so every job on a node that maps the same file uses the same pages
+ *  of the page cache, and the engines read pixels straight from them.
+ */
+#ifndef _IO_MMAP_HPP_
+#define _IO_MMAP_HPP_ 1
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <memory>
+#include <boost/array.hpp>
+#include "raster_view.hpp"
+
+namespace raster_stats {
+
+    /*! Owns the mapping of one file and a view of the raster in it.
+     *  The view is only good as long as this object lives.
+     */
+    class mapped_raster {
+        std::string          filename_;
+        int                  fd_;
+        const unsigned char* map_;
+        size_t               map_size_;
+        landscape_view_t     view_;
+    public:
+        explicit mapped_raster(const char* filename);
+        ~mapped_raster();
+        mapped_raster(const mapped_raster&) = delete;
+        mapped_raster& operator=(const mapped_raster&) = delete;
+
+        const std::string& filename() const { return filename_; }
+        const unsigned char* data() const { return map_; }
+        size_t size() const { return map_size_; }
+        const landscape_view_t& view() const { return view_; }
+
+        /*! Place the view over the file. offset is the byte offset of
+         *  pixel (0,0). Throws if any row would fall outside the file.
+         */
+        void set_view(size_t offset, size_t size1, size_t size2,
+                      landscape_view_t::stride_type stride);
+
+        //! Ask the kernel to start reading the whole file in.
+        void prefetch() const;
+
+        /*! True if count values of item_size bytes, from offset, are
+         *  inside the file and offset is a multiple of item_size or of
+         *  8, whichever is less, so the values can be read in place.
+         */
+        bool contains(uint64_t offset, uint64_t count, size_t item_size) const;
+    };
+
+
+
+    //! offset rounded up to a multiple of 8 bytes.
+    inline size_t align8(size_t offset) { return (offset+7) & ~size_t(7); }
+
+
+    /*! Writes a file of 8-byte-aligned arrays to be mapped in place.
+     *  It writes to a temporary file, which commit() renames to
+     *  filename, so a reader never maps a half-written file. Without
+     *  commit(), the temporary file is removed. what names the kind
+     *  of file in errors.
+     */
+    class mapped_file_writer {
+        std::string   filename_;
+        std::string   what_;
+        std::string   temporary_;
+        std::ofstream out_;
+        bool          committed_;
+
+        void write_padded_bytes(const void* bytes, size_t size);
+    public:
+        mapped_file_writer(const std::string& filename, const std::string& what);
+        ~mapped_file_writer();
+        mapped_file_writer(const mapped_file_writer&) = delete;
+        mapped_file_writer& operator=(const mapped_file_writer&) = delete;
+
+        //! Writes n values, then zeros up to the next multiple of 8 bytes.
+        template<class T>
+        void write_padded(const T* values, size_t n) {
+            write_padded_bytes(values, n*sizeof(T));
+        }
+
+        //! Closes the file and renames it to filename.
+        void commit();
+    };
+
+
+    //! Map headerless bytes, row-major, starting at offset.
+    std::shared_ptr<mapped_raster> map_raw(const char* filename,
+                                           boost::array<size_t,2> dims,
+                                           size_t offset=0);
+
+    //! Map a two-dimensional, C-ordered, uint8 numpy .npy file.
+    std::shared_ptr<mapped_raster> map_npy(const char* filename);
+
+    /*! Map an uncompressed, 8-bit, single-band, stripped TIFF.
+     *  Rows are presented bottom-up, the same as read_tiff().
+     *  This lives in io_geotiff.cpp because it needs libtiff.
+     */
+    std::shared_ptr<mapped_raster> map_tiff(const char* filename);
+
+    //! Choose map_npy or map_tiff from the file extension.
+    std::shared_ptr<mapped_raster> map_raster(const char* filename);
+}
+
+#endif // _IO_MMAP_HPP_
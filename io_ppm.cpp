@@ -1,5 +1,9 @@
-#include <iostream>
 #include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
 #include "io_ppm.hpp"
 
 using namespace std;
@@ -7,18 +11,90 @@ using namespace std;
 namespace raster_stats {
 
 
-void write_ppm(const landscape_t& raster, const char* filename) {
-	ofstream out(filename);
-	// Write the width first, then the height.
-	out << "P5 " << raster.size1() << " " << raster.size2() << " 16" << endl;
-	for (size_t row_idx=0; row_idx<raster.size1(); row_idx++ ) {
-		size_t rev_row_idx = raster.size2()-row_idx-1;
-		for (size_t col_idx=0; col_idx<raster.size2(); col_idx++) {
-			//cout << rev_row_idx << " " << col_idx << endl;
-			out << (int) raster(rev_row_idx,col_idx) << " ";
+namespace {
+	//! Rows are converted and written this many bytes at a time.
+	const size_t block_bytes = size_t(1)<<22;
+
+	/*! Writes the header, then converts rows in blocks of block_bytes
+	 *  with put_row(row, out) and writes each block in one call. Rows go
+	 *  last first, as the rasters keep the first scanline at the bottom.
+	 *  Conversion of a block is split among TBB workers.
+	 */
+	template<class PUT_ROW>
+	void write_netpbm(const char* filename, const char* magic,
+					  size_t height, size_t width, size_t channels,
+					  PUT_ROW put_row) {
+		ofstream out(filename, ios::out | ios::binary);
+		if (!out) {
+			throw runtime_error("Could not open PPM file.");
+		}
+		// Width first, then height.
+		out << magic << "\n" << width << " " << height << "\n255\n";
+
+		const size_t row_bytes = width*channels;
+		if (0 == row_bytes) {
+			return;
+		}
+		const size_t block_rows = max<size_t>(1, block_bytes/row_bytes);
+		vector<unsigned char> block(min(block_rows, height)*row_bytes);
+		for (size_t first=0; first<height; first+=block_rows) {
+			const size_t rows = min(block_rows, height-first);
+			tbb::parallel_for(tbb::blocked_range<size_t>(0, rows),
+				[&](const tbb::blocked_range<size_t>& range) {
+					for (size_t r=range.begin(); r!=range.end(); r++) {
+						put_row(height-first-r-1, &block[r*row_bytes]);
+					}
+				});
+			out.write(reinterpret_cast<const char*>(&block[0]), rows*row_bytes);
 		}
-		out << endl;
+		if (!out) {
+			throw runtime_error("Could not write PPM file.");
+		}
+	}
+}
+
+
+
+void write_ppm(const landscape_t& raster, const char* filename) {
+	const size_t width = raster.size2();
+	write_netpbm(filename, "P5", raster.size1(), width, 1,
+		[&](size_t row, unsigned char* out) {
+			copy_n(&raster.data()[row*width], width, out);
+		});
+}
+
+
+
+/*! The finalizer of MurmurHash3, which spreads consecutive labels
+ *  over the whole range. Colors are kept away from black.
+ */
+uint32_t label_color(uint32_t label) {
+	if (0 == label) {
+		return 0;
 	}
+	uint32_t h = label;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return (h & 0xffffff) | 0x404040;
+}
+
+
+
+void write_ppm_labels(const label_landscape_t& labels, const char* filename) {
+	const size_t width = labels.size2();
+	write_netpbm(filename, "P6", labels.size1(), width, 3,
+		[&](size_t row, unsigned char* out) {
+			const uint32_t* in = &labels.data()[row*width];
+			for (size_t col=0; col<width; col++) {
+				const uint32_t color = label_color(in[col]);
+				out[3*col] = color >> 16;
+				out[3*col+1] = (color >> 8) & 0xff;
+				out[3*col+2] = color & 0xff;
+			}
+		});
 }
 
 
@@ -1,13 +1,23 @@
-/*! This file writes the PPM file format, an easy text-only format.
+/*! This file writes the binary PGM and PPM file formats, which are easy
+ *  to check by eye in any image viewer.
  */
 #ifndef _IO_PPM_H_
 #define _IO_PPM_H_ 1
 
 
+#include <cstdint>
 #include "raster.hpp"
 
 namespace raster_stats {
+	//! A greyscale PGM (P5), one byte per pixel, the last row first.
 	void write_ppm(const landscape_t& raster, const char* filename);
+	/*! A color PPM (P6) of cluster labels. Each label gets a color
+	 *  from a hash, so neighboring clusters rarely look alike.
+	 *  Label 0, pixels in no cluster, is black.
+	 */
+	void write_ppm_labels(const label_landscape_t& labels, const char* filename);
+	//! The red, green and blue of a label, packed as 0xRRGGBB.
+	uint32_t label_color(uint32_t label);
 }
 
 #endif // _IO_PPM_H_
@@ -3,6 +3,7 @@
  */
 
 #include <iostream>
+#include <sstream>
 #include <functional>
 #include <boost/program_options.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
@@ -50,18 +51,79 @@ void random_reorder(RandomAccessIter begin, RandomAccessIter end,
 
 
 
+/*! Adds a timing test of the serial union-find on a checkerboard
+ *  stored with the given layout. Vertices are 32-bit when they fit.
+ */
+template<class MAP>
+void add_layout_test(vector<std::shared_ptr<timing_harness>>& tests,
+                     const std::string& layout, size_t side_length,
+                     size_t block, size_t depth)
+{
+    std::stringstream name;
+    name << layout << "_" << side_length;
+    dispatch_index(side_length,side_length,[&](auto index) {
+        typedef array_basis<decltype(index)> basis_t;
+
+        auto bd=make_data<basis_t,MAP>(side_length,side_length,block,depth);
+        auto basis=bd.template get<0>();
+        auto data=bd.template get<1>();
+
+        auto run=single_run<basis_t,MAP>(basis,data);
+        tests.push_back(make_timing(run,name.str()));
+    });
+}
+
+
+
+//! A list of block sizes to instantiate, each a power of two.
+template<size_t... B>
+struct block_sizes {};
+
+
+inline void add_block_matrix(vector<std::shared_ptr<timing_harness>>& tests,
+                             size_t side_length, size_t depth, block_sizes<>)
+{
+}
+
+
+
+/*! Times both blocked layouts at each compile-time block size,
+ *  next to the same layouts given the block size at runtime.
+ */
+template<size_t B, size_t... REST>
+void add_block_matrix(vector<std::shared_ptr<timing_harness>>& tests,
+                      size_t side_length, size_t depth, block_sizes<B,REST...>)
+{
+    std::stringstream suffix;
+    suffix << "_b" << B;
+    add_layout_test<transform_map<transform_ij_blocked_static<B>,unsigned char>>(
+                    tests,"blocked_static"+suffix.str(),side_length,B,depth);
+    add_layout_test<transform_map<transform_ij_blocked,unsigned char>>(
+                    tests,"blocked"+suffix.str(),side_length,B,depth);
+    add_layout_test<transform_map<transform_ij_full_blocked_static<B>,
+                                  unsigned char>>(
+                    tests,"full_blocked_static"+suffix.str(),side_length,B,depth);
+    add_layout_test<transform_map<transform_ij_full_blocked,unsigned char>>(
+                    tests,"full_blocked"+suffix.str(),side_length,B,depth);
+    add_block_matrix(tests,side_length,depth,block_sizes<REST...>());
+}
+
+
+
+
 int main(int argc, char* argv[])
 {
     po::options_description desc("Allowed options");
-    size_t side_length;
+    std::vector<size_t> side_lengths;
     size_t iterations;
     size_t count;
     size_t depth;
     size_t block;
     desc.add_options()
         ("help","show help message")
-        ("size,s", po::value<size_t>(&side_length)->default_value(100),
-         "length of a side of the raster")
+        ("size,s", po::value<std::vector<size_t>>(&side_lengths)
+             ->multitoken()->default_value(std::vector<size_t>(1,100),"100"),
+         "lengths of a side of the raster, one test set for each")
         ("depth,d", po::value<size_t>(&depth)->default_value(100),
          "number of land use types")
         ("block,b", po::value<size_t>(&block)->default_value(32),
@@ -70,6 +132,8 @@ int main(int argc, char* argv[])
          "number of times to run test during a single timing run")
         ("count,c",po::value<size_t>(&count)->default_value(1),
          "number of times to run sets of iterations of all tests")
+        ("block-matrix",
+         "time blocked layouts at every block size from 4 to 128")
         ("tiff", po::value<std::string>(),"filename of a TIFF to read")
         ;
 
@@ -94,39 +158,23 @@ int main(int argc, char* argv[])
 	
 	vector<std::shared_ptr<timing_harness>> tests;
 
-    // Create the first test using simple ij
-    typedef array_basis<size_t> basis_t;
-    typedef transform_map<transform_ij,unsigned char> map_t;
-
-    auto bd=make_data<basis_t,map_t>(side_length,side_length,block,depth);
-    auto basis=bd.get<0>();
-    auto data=bd.get<1>();
-
-    auto run=single_run<basis_t,map_t>(basis,data);
-    auto timing0=make_timing(run,"single");
-    tests.push_back(timing0);
-
-    // Create the second test with a blocked transform.
-    typedef transform_map<transform_ij_blocked,unsigned char> mapb_t;
-
-    auto bdb=make_data<basis_t,mapb_t>(side_length,side_length,block,depth);
-    auto basisb=bdb.get<0>();
-    auto datab=bdb.get<1>();
-
-    auto run1=single_run<basis_t,mapb_t>(basisb,datab);
-    auto timing1=make_timing(run1,"blocked");
-    tests.push_back(timing1);
-
-    // The third test uses a full blocking.
-    typedef transform_map<transform_ij_full_blocked,unsigned char> mapc_t;
-
-    auto bdc=make_data<basis_t,mapc_t>(side_length,side_length,block,depth);
-    auto basisc=bdc.get<0>();
-    auto datac=bdc.get<1>();
-
-    auto run2=single_run<basis_t,mapc_t>(basisc,datac);
-    auto timing2=make_timing(run2,"full_blocked");
-    tests.push_back(timing2);
+    // Compare storage layouts for each raster size.
+    for (auto side=side_lengths.begin(); side!=side_lengths.end(); side++) {
+        add_layout_test<transform_map<transform_ij,unsigned char>>(
+                                   tests,"single",*side,block,depth);
+        add_layout_test<transform_map<transform_ij_blocked,unsigned char>>(
+                                   tests,"blocked",*side,block,depth);
+        add_layout_test<transform_map<transform_ij_full_blocked,unsigned char>>(
+                                   tests,"full_blocked",*side,block,depth);
+        add_layout_test<transform_map<transform_morton_ij,unsigned char>>(
+                                   tests,"morton",*side,block,depth);
+        add_layout_test<transform_map<transform_hilbert_ij,unsigned char>>(
+                                   tests,"hilbert",*side,block,depth);
+        if (vm.count("block-matrix")) {
+            add_block_matrix(tests,*side,depth,
+                             block_sizes<4,8,16,32,64,128>());
+        }
+    }
 
 
     // Run all tests, randomizing the order for each set of runs.
@@ -8,6 +8,7 @@
 #ifndef MORTON_HPP_
 #define MORTON_HPP_
 
+#include <climits>
 #include <boost/array.hpp>
 
 
@@ -77,6 +78,17 @@ namespace raster_stats
 
 
 
+    template<size_t x,size_t y,size_t z>
+    struct morton_xyz
+    {
+        typedef size_t value_type;
+        static value_type const value=(morton_d<x,0,3>::value|
+                                       morton_d<y,1,3>::value|
+                                       morton_d<z,2,3>::value);
+    };
+
+
+
     struct morton_calculations
     {
         /*! Combine an x and y cooordinate into a single Morton coordinate.
@@ -112,6 +124,40 @@ namespace raster_stats
         }
 
 
+        /*! Interleave D coordinates, bit i of coordinate dim going to
+         *  bit D*i+dim, as morton_d<x,dim,D> does at compile time.
+         */
+        template<size_t D, typename XY, typename M>
+        static M combine(const boost::array<XY,D>& x)
+        {
+            const size_t relevant_bits =
+                tmin<sizeof(M)*CHAR_BIT/D,sizeof(XY)*CHAR_BIT>::value;
+            M z=0;
+            for (size_t i=0; i < relevant_bits; i++) {
+                for (size_t dim=0; dim<D; dim++) {
+                    z |= M((x[dim]>>i) & 1) << (D*i+dim);
+                }
+            }
+            return z;
+        }
+
+
+        template<size_t D, typename XY, typename M>
+        static boost::array<XY,D> detangle(M n)
+        {
+            const size_t relevant_bits =
+                tmin<sizeof(M)*CHAR_BIT/D,sizeof(XY)*CHAR_BIT>::value;
+            boost::array<XY,D> x;
+            x.fill(0);
+            for (size_t i=0; i<relevant_bits; i++) {
+                for (size_t dim=0; dim<D; dim++) {
+                    x[dim] |= XY((n>>(D*i+dim)) & 1) << i;
+                }
+            }
+            return x;
+        }
+
+
         /*! Given an x and y interleaved into a single value, add another interleaved value.
          *  A Morton coordinate, added to an interleaved x, will increment only in x.
          *  This is basically a bit-shifting re-implementation of addition over every
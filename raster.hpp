@@ -2,16 +2,29 @@
 #define _RASTER_H_ 1
 
 #include <map>
+#include <cstdint>
 #include <utility>
 #include <list>
+#include <memory_resource>
 #include <boost/numeric/ublas/matrix.hpp>
+#include <boost/multi_array.hpp>
 
 namespace raster_stats {
 
 //! The raster image holding the landscape characteristics.
 typedef boost::numeric::ublas::matrix<unsigned char> landscape_t;
+//! A continuous raster, such as elevation or NDVI.
+typedef boost::numeric::ublas::matrix<float> float_landscape_t;
+//! A class map with more than 256 classes, as from read_tiff_bands<uint16_t>.
+typedef boost::numeric::ublas::matrix<uint16_t> class16_landscape_t;
+//! Cluster numbers per pixel, as written by write_tiff_labels.
+typedef boost::numeric::ublas::matrix<uint32_t> label_landscape_t;
+//! A stack of rasters, such as one per year, indexed (layer, i, j).
+typedef boost::multi_array<unsigned char,3> volume_t;
 //! A map from an individual quadrant to a list of neighboring, similar quadrants.
 typedef std::list<std::list<size_t> > cluster_t;
+//! The same, with every node allocated from a std::pmr::memory_resource.
+typedef std::pmr::list<std::pmr::list<size_t> > cluster_pmr_t;
 //! The (i,j) coordinates of a quadrant of the landscape.
 typedef std::pair<size_t,size_t> loc_t;
 typedef std::map<loc_t,std::list<loc_t> > cluster_loc_t;
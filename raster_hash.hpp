@@ -0,0 +1,216 @@
+/*! raster_hash.hpp
+ *  A 64-bit hash of a raster's dimensions and pixels, so results can be
+ *  looked up by what went into them rather than by file name, and so
+ *  incremental jobs can tell which tiles changed.
+ *
+ *  The raster is cut into tiles, each tile is hashed with XXH64 by a
+ *  TBB worker, and the raster's hash is XXH64 of the dimensions and
+ *  the tile hashes in row-major order. The tile hashes come with it.
+ *  Pixels are hashed row by row, so a view and a copy of the same
+ *  pixels hash the same, whatever the stride or the file they came from.
+ */
+#ifndef _RASTER_HASH_HPP_
+#define _RASTER_HASH_HPP_ 1
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range2d.h"
+#include "raster_view.hpp"
+
+namespace raster_stats {
+
+    /*! XXH64, fed any number of times before digest(). Four lanes take
+     *  32 bytes at a time, independent of one another, so their
+     *  multiplies overlap in the pipeline.
+     */
+    class xxh64 {
+        static const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+        static const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+        static const uint64_t prime3 = 0x165667B19E3779F9ULL;
+        static const uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+        static const uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+        uint64_t      seed_;
+        uint64_t      lane_[4];
+        uint64_t      total_;
+        unsigned char stripe_[32];
+        size_t        stripe_used_;
+
+        static uint64_t rotl(uint64_t x, int r) { return (x<<r) | (x>>(64-r)); }
+        static uint64_t read64(const unsigned char* p) {
+            uint64_t v;
+            std::memcpy(&v, p, 8);
+            return v;
+        }
+        static uint32_t read32(const unsigned char* p) {
+            uint32_t v;
+            std::memcpy(&v, p, 4);
+            return v;
+        }
+        static uint64_t round(uint64_t lane, uint64_t input) {
+            lane += input*prime2;
+            return rotl(lane, 31)*prime1;
+        }
+        static uint64_t merge(uint64_t hash, uint64_t lane) {
+            hash ^= round(0, lane);
+            return hash*prime1+prime4;
+        }
+        void consume(const unsigned char* p) {
+            lane_[0] = round(lane_[0], read64(p));
+            lane_[1] = round(lane_[1], read64(p+8));
+            lane_[2] = round(lane_[2], read64(p+16));
+            lane_[3] = round(lane_[3], read64(p+24));
+        }
+    public:
+        explicit xxh64(uint64_t seed=0) : seed_(seed), total_(0), stripe_used_(0) {
+            lane_[0] = seed+prime1+prime2;
+            lane_[1] = seed+prime2;
+            lane_[2] = seed;
+            lane_[3] = seed-prime1;
+        }
+
+        void update(const void* bytes, size_t n) {
+            const unsigned char* p = static_cast<const unsigned char*>(bytes);
+            total_ += n;
+            if (stripe_used_) {
+                const size_t take = std::min(n, 32-stripe_used_);
+                std::memcpy(stripe_+stripe_used_, p, take);
+                stripe_used_ += take;
+                p += take;
+                n -= take;
+                if (stripe_used_ < 32) {
+                    return;
+                }
+                consume(stripe_);
+                stripe_used_ = 0;
+            }
+            for (; n>=32; p+=32, n-=32) {
+                consume(p);
+            }
+            std::memcpy(stripe_, p, n);
+            stripe_used_ = n;
+        }
+
+        uint64_t digest() const {
+            uint64_t hash;
+            if (total_ >= 32) {
+                hash = rotl(lane_[0],1)+rotl(lane_[1],7)+rotl(lane_[2],12)+
+                    rotl(lane_[3],18);
+                for (int l=0; l<4; l++) {
+                    hash = merge(hash, lane_[l]);
+                }
+            } else {
+                hash = seed_+prime5;
+            }
+            hash += total_;
+            const unsigned char* p = stripe_;
+            size_t n = stripe_used_;
+            for (; n>=8; p+=8, n-=8) {
+                hash ^= round(0, read64(p));
+                hash = rotl(hash,27)*prime1+prime4;
+            }
+            if (n>=4) {
+                hash ^= uint64_t(read32(p))*prime1;
+                hash = rotl(hash,23)*prime2+prime3;
+                p += 4;
+                n -= 4;
+            }
+            for (; n>0; p++, n--) {
+                hash ^= (*p)*prime5;
+                hash = rotl(hash,11)*prime1;
+            }
+            hash ^= hash >> 33;
+            hash *= prime2;
+            hash ^= hash >> 29;
+            hash *= prime3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+    };
+
+
+
+    //! The hash of a raster and of each of its tiles.
+    struct raster_tile_hashes {
+        //! Rows and columns of a tile. Tiles at the edges may be smaller.
+        size_t tile_size1;
+        size_t tile_size2;
+        //! Tiles down and across.
+        size_t tiles1;
+        size_t tiles2;
+        //! Hash of tile (ti,tj) at ti*tiles2+tj.
+        std::vector<uint64_t> tiles;
+        uint64_t raster;
+    };
+
+
+
+    /*! Hashes every tile of the raster in parallel, then the tile
+     *  hashes. Tiles of tile_size by tile_size pixels.
+     */
+    template<class T>
+    raster_tile_hashes hash_tiles(const raster_view<T>& raster,
+                                  size_t tile_size=256) {
+        if (0 == tile_size) {
+            throw std::runtime_error("Hash tiles must have pixels.");
+        }
+        raster_tile_hashes hashes;
+        hashes.tile_size1 = tile_size;
+        hashes.tile_size2 = tile_size;
+        hashes.tiles1 = (raster.size1()+tile_size-1)/tile_size;
+        hashes.tiles2 = (raster.size2()+tile_size-1)/tile_size;
+        hashes.tiles.resize(hashes.tiles1*hashes.tiles2);
+
+        tbb::parallel_for(tbb::blocked_range2d<size_t>(0, hashes.tiles1,
+                                                       0, hashes.tiles2),
+            [&](const tbb::blocked_range2d<size_t>& r) {
+                for (size_t ti=r.rows().begin(); ti!=r.rows().end(); ti++) {
+                    const size_t i_end = std::min(raster.size1(), (ti+1)*tile_size);
+                    for (size_t tj=r.cols().begin(); tj!=r.cols().end(); tj++) {
+                        const size_t j = tj*tile_size;
+                        const size_t width = std::min(raster.size2()-j, tile_size);
+                        xxh64 tile;
+                        for (size_t i=ti*tile_size; i<i_end; i++) {
+                            tile.update(raster.row(i)+j, width*sizeof(T));
+                        }
+                        hashes.tiles[ti*hashes.tiles2+tj] = tile.digest();
+                    }
+                }
+            });
+
+        xxh64 whole;
+        const uint64_t dims[3] = { raster.size1(), raster.size2(), tile_size };
+        whole.update(dims, sizeof(dims));
+        if (!hashes.tiles.empty()) {
+            whole.update(&hashes.tiles[0], hashes.tiles.size()*sizeof(uint64_t));
+        }
+        hashes.raster = whole.digest();
+        return hashes;
+    }
+
+    template<class T>
+    raster_tile_hashes hash_tiles(const boost::numeric::ublas::matrix<T>& raster,
+                                  size_t tile_size=256) {
+        return hash_tiles(make_view(raster), tile_size);
+    }
+
+
+
+    //! The hash of the raster alone, with the default tiles.
+    template<class T>
+    uint64_t raster_hash(const raster_view<T>& raster) {
+        return hash_tiles(raster).raster;
+    }
+
+    template<class T>
+    uint64_t raster_hash(const boost::numeric::ublas::matrix<T>& raster) {
+        return raster_hash(make_view(raster));
+    }
+}
+
+#endif // _RASTER_HASH_HPP_
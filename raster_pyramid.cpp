@@ -0,0 +1,294 @@
+/*! raster_pyramid.cpp
+ *  Builds, writes and maps rasters coarse-grained by twos.
+ */
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+#include "raster_pyramid.hpp"
+
+using namespace std;
+
+namespace raster_stats {
+
+
+namespace {
+    const char pyramid_magic[8] = { 'R','S','P','Y','R','A','M','1' };
+
+
+    /*! Ranks a by how many of the four are equal to it, then by how
+     *  small it is, in one key, so the mode is the largest key.
+     */
+    inline unsigned mode_key(unsigned a, unsigned b, unsigned c, unsigned d) {
+        return ((1u+(a==b)+(a==c)+(a==d))<<8) | (255u-a);
+    }
+
+    /*! Writes the mode of top[2j], top[2j+1], bottom[2j] and
+     *  bottom[2j+1] to out[j]. There are no branches, so the compiler
+     *  can run the loop on vector registers.
+     */
+    void mode_row(const unsigned char* top, const unsigned char* bottom,
+                  size_t n, unsigned char* out) {
+        for (size_t j=0; j<n; j++) {
+            const unsigned a=top[2*j], b=top[2*j+1];
+            const unsigned c=bottom[2*j], d=bottom[2*j+1];
+            const unsigned key = std::max(
+                std::max(mode_key(a,b,c,d), mode_key(b,a,c,d)),
+                std::max(mode_key(c,a,b,d), mode_key(d,a,b,c)));
+            out[j] = 255u-(key&255u);
+        }
+    }
+
+    void presence_row(const uint64_t* top, const uint64_t* bottom,
+                      size_t n, uint64_t* out) {
+        for (size_t j=0; j<n; j++) {
+            out[j] = top[2*j] | top[2*j+1] | bottom[2*j] | bottom[2*j+1];
+        }
+    }
+
+
+    /*! Reduces each 2x2 box of in to one pixel, calling
+     *  row(top, bottom, n, out) for each row of the result, in parallel
+     *  bands of rows. Boxes cut short by an odd edge repeat the pixels
+     *  they have, which leaves both the mode and the union the same.
+     */
+    template<class OUT, class IN, class ROW>
+    boost::numeric::ublas::matrix<OUT> reduce_boxes(const raster_view<IN>& in,
+                                                    ROW row) {
+        const size_t size1 = (in.size1()+1)/2;
+        const size_t size2 = (in.size2()+1)/2;
+        boost::numeric::ublas::matrix<OUT> out(size1, size2);
+        if (0 == size1 || 0 == size2) {
+            return out;
+        }
+        OUT* reduced = &out.data()[0];
+        const size_t whole = in.size2()/2;
+        const size_t grain = std::max<size_t>(1, (size_t(1)<<14)/size2);
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, size1, grain),
+            [&](const tbb::blocked_range<size_t>& rows) {
+                for (size_t i=rows.begin(); i!=rows.end(); i++) {
+                    const IN* top = in.row(2*i);
+                    const IN* bottom = (2*i+1<in.size1()) ? in.row(2*i+1) : top;
+                    OUT* out_row = reduced+i*size2;
+                    row(top, bottom, whole, out_row);
+                    if (whole<size2) {
+                        const IN top_end[2] = { top[2*whole], top[2*whole] };
+                        const IN bottom_end[2] = { bottom[2*whole], bottom[2*whole] };
+                        row(top_end, bottom_end, 1, out_row+whole);
+                    }
+                }
+            });
+        return out;
+    }
+}
+
+
+
+landscape_t downsample_mode(const landscape_view_t& raster)
+{
+    return reduce_boxes<unsigned char>(raster, mode_row);
+}
+
+
+
+presence_landscape_t downsample_presence(const raster_view<uint64_t>& presence)
+{
+    return reduce_boxes<uint64_t>(presence, presence_row);
+}
+
+
+
+presence_landscape_t downsample_classes(const landscape_view_t& raster,
+                                        const std::vector<unsigned char>& classes)
+{
+    if (classes.size()>64) {
+        throw std::runtime_error("A presence mask holds at most 64 classes.");
+    }
+    uint64_t bits[256] = { 0 };
+    for (size_t b=0; b<classes.size(); b++) {
+        bits[classes[b]] |= uint64_t(1)<<b;
+    }
+    return reduce_boxes<uint64_t>(raster,
+        [&bits](const unsigned char* top, const unsigned char* bottom,
+                size_t n, uint64_t* out) {
+            for (size_t j=0; j<n; j++) {
+                out[j] = bits[top[2*j]] | bits[top[2*j+1]] |
+                    bits[bottom[2*j]] | bits[bottom[2*j+1]];
+            }
+        });
+}
+
+
+
+raster_pyramid build_pyramid(const landscape_view_t& raster,
+                             const std::vector<unsigned char>& classes,
+                             size_t level_cnt)
+{
+    if (classes.size()>64) {
+        throw std::runtime_error("A presence mask holds at most 64 classes.");
+    }
+    raster_pyramid pyramid;
+    pyramid.classes = classes;
+
+    landscape_t base(raster.size1(), raster.size2());
+    for (size_t i=0; i<raster.size1() && raster.size2()>0; i++) {
+        std::memcpy(&base(i,0), raster.row(i), raster.size2());
+    }
+    pyramid.mode.push_back(std::move(base));
+    pyramid.presence.push_back(presence_landscape_t());
+
+    for (;;) {
+        const landscape_t& last = pyramid.mode.back();
+        // A level of one pixel is the top, however many level_cnt asks for.
+        const bool top = last.size1()<=1 && last.size2()<=1;
+        if (top || 0 == last.size1() || 0 == last.size2() ||
+                (level_cnt>0 && pyramid.levels()>=level_cnt)) {
+            break;
+        }
+        landscape_t mode = downsample_mode(make_view(last));
+        presence_landscape_t presence;
+        if (!classes.empty()) {
+            presence = (1 == pyramid.levels()) ?
+                downsample_classes(make_view(last), classes) :
+                downsample_presence(make_view(pyramid.presence.back()));
+        }
+        pyramid.mode.push_back(std::move(mode));
+        pyramid.presence.push_back(std::move(presence));
+    }
+    return pyramid;
+}
+
+
+
+raster_pyramid build_pyramid(const landscape_t& raster,
+                             const std::vector<unsigned char>& classes,
+                             size_t level_cnt)
+{
+    return build_pyramid(make_view(raster), classes, level_cnt);
+}
+
+
+
+std::vector<size_t> box_counts(const raster_pyramid& pyramid, size_t bit)
+{
+    if (bit>=pyramid.classes.size()) {
+        throw std::runtime_error("No class for that bit of the presence masks.");
+    }
+    std::vector<size_t> counts;
+    const landscape_t& base = pyramid.mode[0];
+    counts.push_back(std::count(base.data().begin(), base.data().end(),
+                                pyramid.classes[bit]));
+    for (size_t level=1; level<pyramid.levels(); level++) {
+        size_t cnt = 0;
+        for (uint64_t mask : pyramid.presence[level].data()) {
+            cnt += (mask>>bit) & 1;
+        }
+        counts.push_back(cnt);
+    }
+    return counts;
+}
+
+
+
+void write_pyramid_file(const std::string& filename,
+                        const raster_pyramid& pyramid)
+{
+    pyramid_file_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, pyramid_magic, sizeof(pyramid_magic));
+    header.level_cnt = pyramid.levels();
+    header.class_cnt = pyramid.classes.size();
+    std::copy(pyramid.classes.begin(), pyramid.classes.end(), header.classes);
+
+    std::vector<pyramid_level_entry> levels(pyramid.levels());
+    size_t offset = align8(sizeof(header)+levels.size()*sizeof(pyramid_level_entry));
+    for (size_t level=0; level<levels.size(); level++) {
+        const landscape_t& mode = pyramid.mode[level];
+        levels[level].size1 = mode.size1();
+        levels[level].size2 = mode.size2();
+        levels[level].mode_offset = offset;
+        offset = align8(offset+mode.data().size());
+        levels[level].presence_offset = 0;
+        if (!pyramid.presence[level].data().empty()) {
+            levels[level].presence_offset = offset;
+            offset += 8*pyramid.presence[level].data().size();
+        }
+    }
+
+    mapped_file_writer out(filename, "raster pyramid");
+    out.write_padded(&header, 1);
+    out.write_padded(levels.data(), levels.size());
+    for (size_t level=0; level<levels.size(); level++) {
+        const landscape_t& mode = pyramid.mode[level];
+        out.write_padded(mode.data().begin(), mode.data().size());
+        const presence_landscape_t& presence = pyramid.presence[level];
+        out.write_padded(presence.data().begin(), presence.data().size());
+    }
+    out.commit();
+}
+
+
+
+mapped_pyramid::mapped_pyramid(const std::string& filename)
+    : map_(std::make_shared<mapped_raster>(filename.c_str())),
+      header_(0), levels_(0)
+{
+    const size_t file_size = map_->size();
+    if (file_size < sizeof(pyramid_file_header) ||
+            0 != std::memcmp(map_->data(), pyramid_magic, sizeof(pyramid_magic))) {
+        throw std::runtime_error("Not a raster pyramid: "+filename);
+    }
+    header_ = reinterpret_cast<const pyramid_file_header*>(map_->data());
+    levels_ = reinterpret_cast<const pyramid_level_entry*>(
+                                    map_->data()+sizeof(pyramid_file_header));
+    // Each array must lie inside the file.
+    bool fits = header_->class_cnt <= 64 &&
+        map_->contains(sizeof(pyramid_file_header), header_->level_cnt,
+                       sizeof(pyramid_level_entry));
+    for (size_t level=0; fits && level<header_->level_cnt; level++) {
+        const pyramid_level_entry& entry = levels_[level];
+        const uint64_t pixels = entry.size1*entry.size2;
+        fits = map_->contains(entry.mode_offset, pixels, 1) &&
+            (0 == entry.presence_offset ||
+             map_->contains(entry.presence_offset, pixels, 8));
+    }
+    if (!fits) {
+        throw std::runtime_error("Raster pyramid is truncated: "+filename);
+    }
+}
+
+
+
+std::vector<unsigned char> mapped_pyramid::classes() const
+{
+    return std::vector<unsigned char>(header_->classes,
+                                      header_->classes+header_->class_cnt);
+}
+
+
+
+landscape_view_t mapped_pyramid::mode(size_t level) const
+{
+    const pyramid_level_entry& entry = levels_[level];
+    return landscape_view_t(map_->data()+entry.mode_offset,
+                            entry.size1, entry.size2, entry.size2);
+}
+
+
+
+raster_view<uint64_t> mapped_pyramid::presence(size_t level) const
+{
+    const pyramid_level_entry& entry = levels_[level];
+    if (0 == entry.presence_offset) {
+        return raster_view<uint64_t>();
+    }
+    return raster_view<uint64_t>(
+        reinterpret_cast<const uint64_t*>(map_->data()+entry.presence_offset),
+        entry.size1, entry.size2, entry.size2);
+}
+
+
+}
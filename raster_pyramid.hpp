@@ -0,0 +1,134 @@
+/*! raster_pyramid.hpp
+ *  A raster coarse-grained by twos, built once, so that box counting
+ *  and other analyses at many scales read every scale from one place
+ *  instead of regridding the raster for each box size.
+ *
+ *  Level 0 is the raster. Pixel (i,j) of level k+1 summarizes pixels
+ *  (2i..2i+1, 2j..2j+1) of level k, so it covers a box 2^k pixels on
+ *  a side of the raster. Where a dimension is odd, the last box
+ *  is cut short. Each level keeps two summaries of its boxes:
+ *
+ *    mode      the most common class in the box, the smallest on a tie,
+ *              taken from the four below it
+ *    presence  bit b is set if class classes[b] is anywhere in the box,
+ *              for up to 64 classes, so counting set bits of a level is
+ *              the box count for a class at that scale
+ *
+ *  The pyramid can be saved in a file laid out to be mapped in place,
+ *  a header and a table of levels, then 8-byte-aligned arrays, or in
+ *  HDF5 with raster_file::write_pyramid.
+ *
+ *    header
+ *    levels    pyramid_level_entry[level_cnt]
+ *    each level: mode uint8[size1*size2], then presence
+ *                uint64[size1*size2] from level 1 on, if there are classes
+ */
+#ifndef _RASTER_PYRAMID_HPP_
+#define _RASTER_PYRAMID_HPP_ 1
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <boost/numeric/ublas/matrix.hpp>
+#include "raster.hpp"
+#include "raster_view.hpp"
+#include "io_mmap.hpp"
+
+namespace raster_stats {
+
+    //! Which of up to 64 chosen classes are in each box.
+    typedef boost::numeric::ublas::matrix<uint64_t> presence_landscape_t;
+
+
+    struct raster_pyramid {
+        //! Bit b of a presence mask stands for classes[b].
+        std::vector<unsigned char>        classes;
+        //! mode[0] is a copy of the raster.
+        std::vector<landscape_t>          mode;
+        /*! presence[k] has the shape of mode[k]. presence[0] is left
+         *  empty, because the class of a pixel is the pixel, and every
+         *  level is empty when there are no classes.
+         */
+        std::vector<presence_landscape_t> presence;
+
+        size_t levels() const { return mode.size(); }
+    };
+
+
+
+    //! Each pixel is the mode of a 2x2 box of raster.
+    landscape_t downsample_mode(const landscape_view_t& raster);
+
+    //! Each mask is the union of the masks in a 2x2 box of presence.
+    presence_landscape_t downsample_presence(const raster_view<uint64_t>& presence);
+
+    /*! Masks of a 2x2 box of raster, where bit b is set if classes[b]
+     *  is in the box. Throws if there are more than 64 classes.
+     */
+    presence_landscape_t downsample_classes(const landscape_view_t& raster,
+                                            const std::vector<unsigned char>& classes);
+
+    /*! Builds levels of raster until a level is one pixel, or sooner,
+     *  at level_cnt levels, if level_cnt is not zero. Presence
+     *  masks are built only if classes are given. Each level is
+     *  computed in parallel, a band of its rows to a TBB task.
+     */
+    raster_pyramid build_pyramid(const landscape_view_t& raster,
+                                 const std::vector<unsigned char>& classes=
+                                     std::vector<unsigned char>(),
+                                 size_t level_cnt=0);
+    raster_pyramid build_pyramid(const landscape_t& raster,
+                                 const std::vector<unsigned char>& classes=
+                                     std::vector<unsigned char>(),
+                                 size_t level_cnt=0);
+
+    /*! For each level, how many of its boxes hold classes[bit], which
+     *  is what box counting plots against the box size 2^level.
+     */
+    std::vector<size_t> box_counts(const raster_pyramid& pyramid, size_t bit);
+
+
+
+    //! The start of a pyramid file. Offsets are in bytes from the start.
+    struct pyramid_file_header {
+        char     magic[8];
+        uint64_t level_cnt;
+        uint64_t class_cnt;
+        unsigned char classes[64];
+    };
+
+    struct pyramid_level_entry {
+        uint64_t size1;
+        uint64_t size2;
+        uint64_t mode_offset;
+        //! Zero where the level has no presence masks.
+        uint64_t presence_offset;
+    };
+
+
+    //! Writes pyramid to filename, through a mapped_file_writer.
+    void write_pyramid_file(const std::string& filename,
+                            const raster_pyramid& pyramid);
+
+
+    /*! A pyramid file, mapped read-only. The views point into the
+     *  mapping, so they are good as long as this object lives.
+     */
+    class mapped_pyramid {
+        std::shared_ptr<mapped_raster> map_;
+        const pyramid_file_header*     header_;
+        const pyramid_level_entry*     levels_;
+    public:
+        //! Maps a pyramid file and checks its magic and array bounds.
+        explicit mapped_pyramid(const std::string& filename);
+
+        size_t levels() const { return header_->level_cnt; }
+        std::vector<unsigned char> classes() const;
+        landscape_view_t mode(size_t level) const;
+        //! An empty view where the level has no masks.
+        raster_view<uint64_t> presence(size_t level) const;
+    };
+}
+
+#endif // _RASTER_PYRAMID_HPP_
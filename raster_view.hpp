@@ -0,0 +1,225 @@
+/*! raster_view.hpp
+ *  A read-only, two-dimensional window onto pixels that live somewhere
+ *  else, such as a memory-mapped file or a numpy array. Nothing is copied.
+ */
+#ifndef _RASTER_VIEW_HPP_
+#define _RASTER_VIEW_HPP_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <boost/array.hpp>
+#include "raster.hpp"
+
+namespace raster_stats {
+
+    /*! The view is a pointer to pixel (0,0), the dimensions, and the
+     *  distance in elements from one row to the next. The stride may be
+     *  negative, which is how a bottom-up file is presented top-down.
+     *  It answers size1(), size2() and operator()(i,j) like landscape_t,
+     *  so the engines can take either one.
+     */
+    template<class T>
+    class raster_view {
+    public:
+        typedef T              value_type;
+        typedef size_t         size_type;
+        typedef std::ptrdiff_t stride_type;
+    private:
+        const T*    origin_;
+        size_type   size1_;
+        size_type   size2_;
+        stride_type stride_;
+    public:
+        raster_view() : origin_(0), size1_(0), size2_(0), stride_(0) {}
+
+        raster_view(const T* origin, size_type size1, size_type size2,
+                    stride_type stride)
+            : origin_(origin), size1_(size1), size2_(size2), stride_(stride) {}
+
+        //! View the whole of a ublas matrix, which is stored row-major.
+        explicit raster_view(const boost::numeric::ublas::matrix<T>& m)
+            : origin_(m.data().size() ? &m.data()[0] : 0),
+              size1_(m.size1()), size2_(m.size2()),
+              stride_(m.size2()) {}
+
+        size_type size1() const { return size1_; }
+        size_type size2() const { return size2_; }
+        stride_type stride() const { return stride_; }
+
+        const T* row(size_type i) const { return origin_+stride_*std::ptrdiff_t(i); }
+
+        const T& operator()(size_type i, size_type j) const {
+            return row(i)[j];
+        }
+
+        //! Linear index i*size2()+j, for code that numbers pixels that way.
+        const T& operator[](size_type n) const {
+            return (*this)(n/size2_,n%size2_);
+        }
+
+        //! True when rows follow one another, top to bottom, with no gap.
+        bool contiguous() const { return stride_==std::ptrdiff_t(size2_); }
+
+        /*! The pixels inside bounds, as a view of their own that shares
+         *  this one's stride. bounds is ((row start, row end),
+         *  (col start, col end)), the same as array_basis::bounds_.
+         *  Engines given the window number its pixels from its own
+         *  top-left, i*width+j, and window_index maps them back.
+         */
+        template<class B>
+        raster_view window(const boost::array<boost::array<B,2>,2>& bounds) const {
+            if (bounds[0][0]>bounds[0][1] || size_type(bounds[0][1])>size1_ ||
+                    bounds[1][0]>bounds[1][1] || size_type(bounds[1][1])>size2_) {
+                throw std::runtime_error("Window lies outside the raster.");
+            }
+            return raster_view(row(bounds[0][0])+bounds[1][0],
+                               bounds[0][1]-bounds[0][0],
+                               bounds[1][1]-bounds[1][0], stride_);
+        }
+    };
+
+
+
+    //! Property-map access by (i,j), so AreEqual can compare views.
+    template<class T,class K>
+    inline const T& get(const raster_view<T>& v, const boost::array<K,2>& k)
+    {
+        return v(k[0],k[1]);
+    }
+
+
+    //! Property-map access by linear index, i*size2()+j.
+    template<class T>
+    inline const T& get(const raster_view<T>& v, size_t n)
+    {
+        return v[n];
+    }
+
+
+    template<class T>
+    raster_view<T> make_view(const boost::numeric::ublas::matrix<T>& m)
+    {
+        return raster_view<T>(m);
+    }
+
+
+    template<class T>
+    raster_view<T> make_view(const raster_view<T>& v)
+    {
+        return v;
+    }
+
+
+    //! A window onto a matrix, clustered in place without a copy.
+    template<class T,class B>
+    raster_view<T> make_window(const boost::numeric::ublas::matrix<T>& m,
+                               const boost::array<boost::array<B,2>,2>& bounds)
+    {
+        return raster_view<T>(m).window(bounds);
+    }
+
+
+    template<class T,class B>
+    raster_view<T> make_window(const raster_view<T>& v,
+                               const boost::array<boost::array<B,2>,2>& bounds)
+    {
+        return v.window(bounds);
+    }
+
+
+    /*! Turns pixel n of a window, numbered i*width+j within it, into
+     *  the number of the same pixel in the raster it was cut from.
+     */
+    template<class B>
+    size_t window_index(const boost::array<boost::array<B,2>,2>& bounds,
+                        size_t whole_size2, size_t n)
+    {
+        const size_t width=bounds[1][1]-bounds[1][0];
+        return (bounds[0][0]+n/width)*whole_size2+bounds[1][0]+n%width;
+    }
+
+
+    typedef raster_view<landscape_t::value_type> landscape_view_t;
+    typedef raster_view<float_landscape_t::value_type> float_view_t;
+    typedef raster_view<class16_landscape_t::value_type> class16_view_t;
+
+
+
+    /*! Returns the first pixel in [begin,end) that is not value.
+     *  Compares eight pixels at a time, so long runs of nodata
+     *  cost one load per word. memchr finds the end of the next run.
+     */
+    inline const unsigned char* skip_value(const unsigned char* begin,
+                                           const unsigned char* end,
+                                           unsigned char value)
+    {
+        const uint64_t broadcast=UINT64_C(0x0101010101010101)*value;
+        while (end-begin>=8) {
+            uint64_t word;
+            std::memcpy(&word,begin,8);
+            if (word!=broadcast) {
+                break;
+            }
+            begin+=8;
+        }
+        while (begin!=end && *begin==value) {
+            ++begin;
+        }
+        return begin;
+    }
+
+
+    /*! True if every pixel in rows [i0,i1) and columns [j0,j1) has the
+     *  value of the first, so an engine may skip the unions inside it.
+     */
+    inline bool uniform_region(const landscape_view_t& raster,
+                               size_t i0, size_t i1, size_t j0, size_t j1)
+    {
+        const unsigned char value=raster(i0,j0);
+        for (size_t i=i0; i<i1; i++) {
+            const unsigned char* row=raster.row(i);
+            if (skip_value(row+j0,row+j1,value)!=row+j1) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    inline bool uniform_region(const landscape_t& raster,
+                               size_t i0, size_t i1, size_t j0, size_t j1)
+    {
+        return uniform_region(make_view(raster),i0,i1,j0,j1);
+    }
+
+
+
+    //! The same test for wider pixels, such as 16-bit classes.
+    template<class T>
+    bool uniform_region(const raster_view<T>& raster,
+                        size_t i0, size_t i1, size_t j0, size_t j1)
+    {
+        const T value=raster(i0,j0);
+        for (size_t i=i0; i<i1; i++) {
+            const T* row=raster.row(i);
+            for (size_t j=j0; j<j1; j++) {
+                if (row[j]!=value) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+
+    template<class T>
+    bool uniform_region(const boost::numeric::ublas::matrix<T>& raster,
+                        size_t i0, size_t i1, size_t j0, size_t j1)
+    {
+        return uniform_region(make_view(raster),i0,i1,j0,j1);
+    }
+}
+
+#endif // _RASTER_VIEW_HPP_
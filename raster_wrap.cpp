@@ -2,6 +2,7 @@
  *  This file is the main wrapper around the code to find clusters in landscapes.
  */
 #include <functional>
+#include <vector>
 #include <boost/python.hpp>
 #include <boost/python/extract.hpp>
 #include <boost/python/numeric.hpp>
@@ -14,6 +15,9 @@
 #include "timing.hpp"
 #include "raster.hpp"
 #include "cluster.hpp"
+#include "cluster_cache.hpp"
+#include "raster_hash.hpp"
+#include "raster_pyramid.hpp"
 
 using namespace raster_stats;
 using namespace std;
@@ -61,6 +65,13 @@ struct numpy_type<unsigned char> {
 };
 
 
+template<>
+struct numpy_type<float> {
+	static const char kind     ='f';
+	static const char type_num =11;
+};
+
+
 
 
 template<typename T>
@@ -84,6 +95,40 @@ const boost::multi_array<T,2> numpy_array_extract(PyObject* array)
 }
 
 
+/*! Views the numpy array's own pixels, for engines that read in place.
+ *  Rows may be any distance apart, but pixels within a row must touch.
+ */
+template<typename T>
+raster_view<T> numpy_view_extract(PyObject* array)
+{
+	PyArray_Descr* description = PyArray_DESCR(array);
+	if (description->kind != numpy_type<T>::kind ||
+			description->elsize != sizeof(T)) {
+		throw runtime_error("Tried to view an array of a different type.");
+	}
+	if (PyArray_NDIM(array) != 2 || PyArray_STRIDES(array)[1] != sizeof(T) ||
+			PyArray_STRIDES(array)[0] % sizeof(T) != 0) {
+		throw runtime_error("Can only view a two-dimensional array with contiguous rows.");
+	}
+	return raster_view<T>(static_cast<const T*>(PyArray_DATA(array)),
+		PyArray_DIMS(array)[0], PyArray_DIMS(array)[1],
+		PyArray_STRIDES(array)[0]/std::ptrdiff_t(sizeof(T)));
+}
+
+
+/*! bounds is ((row start, row end), (col start, col end)).
+ */
+boost::array<boost::array<size_t,2>,2> window_extract(object bounds)
+{
+	boost::array<boost::array<size_t,2>,2> window;
+	for (size_t axis=0; axis<2; axis++) {
+		window[axis][0] = extract<size_t>(bounds[axis][0]);
+		window[axis][1] = extract<size_t>(bounds[axis][1]);
+	}
+	return window;
+}
+
+
 /*! This class is a Python iterator created to present a list<list<size_t>> as a list of python lists.
  */
 struct ClusterIter {
@@ -296,6 +341,194 @@ long long find_clusters_remap_time_wrap(size_t n, object raster_object) {
 	return timeit([&raster](){ find_clusters_remap(raster); }, n).count();
 }
 
+/*! Returns (clusters, wraps), where wraps holds a (wraps in i, wraps in j)
+ *  tuple for each cluster, in the same order.
+ */
+boost::python::tuple find_clusters_periodic_wrap(object raster_object) {
+	const landscape_t raster = numpy_array_extract<arr_type>(raster_object.ptr());
+	wrapped_clusters found = find_clusters_periodic(raster);
+	boost::python::list wraps;
+	for (auto wrap=found.wraps.begin(); wrap!=found.wraps.end(); wrap++) {
+		wraps.append(boost::python::make_tuple((*wrap)[0],(*wrap)[1]));
+	}
+	return boost::python::make_tuple(ClusterWrap(found.clusters), wraps);
+}
+
+long long find_clusters_periodic_time_wrap(size_t n, object raster_object) {
+	const landscape_t raster = numpy_array_extract<arr_type>(raster_object.ptr());
+	return timeit([&raster](){ find_clusters_periodic(raster); }, n).count();
+}
+
+/*! Leaves out pixels equal to nodata, such as the value
+ *  io_geotiff reads from the GDAL_NODATA tag.
+ */
+ClusterWrap* find_clusters_nodata_wrap(object raster_object, arr_type nodata) {
+	const landscape_t raster = numpy_array_extract<arr_type>(raster_object.ptr());
+	cluster_t clusters = find_clusters_nodata(raster, nodata);
+	return new ClusterWrap(clusters);
+}
+
+long long find_clusters_nodata_time_wrap(size_t n, object raster_object, arr_type nodata) {
+	const landscape_t raster = numpy_array_extract<arr_type>(raster_object.ptr());
+	return timeit([&raster,nodata](){ find_clusters_nodata(raster, nodata); }, n).count();
+}
+
+/*! groups is a sequence of sequences of classes, such as
+ *  [[41,42,43],[21,22]]. The classes in each one cluster together.
+ */
+class_lut<arr_type> class_lut_extract(object groups) {
+	class_lut<arr_type> lut;
+	for (long g=0; g<len(groups); g++) {
+		object group=groups[g];
+		std::vector<arr_type> classes;
+		for (long c=0; c<len(group); c++) {
+			classes.push_back(extract<arr_type>(group[c]));
+		}
+		lut.merge(classes.begin(),classes.end());
+	}
+	return lut;
+}
+
+ClusterWrap* find_clusters_grouped_wrap(object raster_object, object groups) {
+	const landscape_t raster = numpy_array_extract<arr_type>(raster_object.ptr());
+	cluster_t clusters = find_clusters_grouped(raster, class_lut_extract(groups));
+	return new ClusterWrap(clusters);
+}
+
+long long find_clusters_grouped_time_wrap(size_t n, object raster_object, object groups) {
+	const landscape_t raster = numpy_array_extract<arr_type>(raster_object.ptr());
+	const class_lut<arr_type> lut = class_lut_extract(groups);
+	return timeit([&raster,&lut](){ find_clusters_grouped(raster, lut); }, n).count();
+}
+
+/*! Clusters one window of the array in place, with no copy.
+ *  Pixel numbers are i*width+j within the window.
+ */
+ClusterWrap* find_clusters_window_wrap(object raster_object, object bounds) {
+	const landscape_view_t window =
+		numpy_view_extract<arr_type>(raster_object.ptr()).window(window_extract(bounds));
+	cluster_t clusters = find_clusters_twopass(window);
+	return new ClusterWrap(clusters);
+}
+
+long long find_clusters_window_time_wrap(size_t n, object raster_object, object bounds) {
+	const landscape_view_t window =
+		numpy_view_extract<arr_type>(raster_object.ptr()).window(window_extract(bounds));
+	return timeit([&window](){ find_clusters_twopass(window); }, n).count();
+}
+
+/*! Clusters the array repeated to rows by cols, as timing.py's
+ *  resize_array would make it, but without making it.
+ */
+ClusterWrap* find_clusters_replicated_wrap(object raster_object, size_t rows, size_t cols) {
+	const landscape_view_t source = numpy_view_extract<arr_type>(raster_object.ptr());
+	boost::array<size_t,2> ns = {{ rows, cols }};
+	cluster_t clusters = find_clusters_twopass(make_replicated(source, ns));
+	return new ClusterWrap(clusters);
+}
+
+long long find_clusters_replicated_time_wrap(size_t n, object raster_object,
+		size_t rows, size_t cols) {
+	const landscape_view_t source = numpy_view_extract<arr_type>(raster_object.ptr());
+	boost::array<size_t,2> ns = {{ rows, cols }};
+	const replicated_landscape_t raster = make_replicated(source, ns);
+	return timeit([&raster](){ find_clusters_twopass(raster); }, n).count();
+}
+
+/*! XXH64 of the array's shape and tiles, read in place, as a key for
+ *  caches. Equal arrays hash equal, whatever their strides.
+ */
+uint64_t raster_hash_wrap(object raster_object) {
+	return raster_hash(numpy_view_extract<arr_type>(raster_object.ptr()));
+}
+
+/*! Returns (hash, tiles), where tiles is a list of rows of tile hashes,
+ *  so an incremental job can see which tiles changed since last time.
+ */
+boost::python::tuple hash_tiles_wrap(object raster_object, size_t tile_size) {
+	raster_tile_hashes hashes =
+		hash_tiles(numpy_view_extract<arr_type>(raster_object.ptr()), tile_size);
+	boost::python::list rows;
+	for (size_t ti=0; ti<hashes.tiles1; ti++) {
+		boost::python::list row;
+		for (size_t tj=0; tj<hashes.tiles2; tj++) {
+			row.append(hashes.tiles[ti*hashes.tiles2+tj]);
+		}
+		rows.append(row);
+	}
+	return boost::python::make_tuple(hashes.raster, rows);
+}
+
+/*! For each class in the list, how many boxes of side 2^k hold it,
+ *  for k from 0 until one box covers the array, as Fractals.capacity1
+ *  counts them, from one pass over a pyramid.
+ */
+boost::python::list box_counts_wrap(object raster_object, object classes_object) {
+	std::vector<arr_type> classes;
+	for (long c=0; c<len(classes_object); c++) {
+		classes.push_back(extract<arr_type>(classes_object[c]));
+	}
+	const raster_pyramid pyramid =
+		build_pyramid(numpy_view_extract<arr_type>(raster_object.ptr()), classes);
+	boost::python::list result;
+	for (size_t bit=0; bit<classes.size(); bit++) {
+		boost::python::list counts;
+		for (size_t count : box_counts(pyramid, bit)) {
+			counts.append(count);
+		}
+		result.append(counts);
+	}
+	return result;
+}
+
+/*! The same clusters as find_clusters, looked up in directory by the
+ *  array's hash first, and saved there if they were not found.
+ */
+ClusterWrap* find_clusters_cached_wrap(object raster_object, std::string directory) {
+	const landscape_view_t raster = numpy_view_extract<arr_type>(raster_object.ptr());
+	auto cached = find_clusters_cached(raster, directory, "find_clusters_twopass",
+		[](const landscape_view_t& r) { return find_clusters_twopass(r); });
+	return new ClusterWrap(cached->clusters());
+}
+
+/*! Clusters a float32 array, such as elevation, in place. Neighbors
+ *  join when their values differ by less than tolerance.
+ */
+ClusterWrap* find_clusters_tolerance_wrap(object raster_object, float tolerance) {
+	const float_view_t raster = numpy_view_extract<float>(raster_object.ptr());
+	cluster_t clusters = find_clusters_tolerance(raster, tolerance);
+	return new ClusterWrap(clusters);
+}
+
+long long find_clusters_tolerance_time_wrap(size_t n, object raster_object, float tolerance) {
+	const float_view_t raster = numpy_view_extract<float>(raster_object.ptr());
+	return timeit([&raster,tolerance](){ find_clusters_tolerance(raster, tolerance); }, n).count();
+}
+
+/*! edges is a sorted sequence of bin boundaries, such as quantiles.
+ */
+ClusterWrap* find_clusters_binned_wrap(object raster_object, object edges_object) {
+	const float_view_t raster = numpy_view_extract<float>(raster_object.ptr());
+	std::vector<float> edges;
+	for (long e=0; e<len(edges_object); e++) {
+		edges.push_back(extract<float>(edges_object[e]));
+	}
+	cluster_t clusters = find_clusters_binned(raster, edges);
+	return new ClusterWrap(clusters);
+}
+
+/*! bands is a sequence of aligned uint8 arrays, viewed in place.
+ */
+ClusterWrap* find_clusters_bands_wrap(object bands_object) {
+	std::vector<landscape_view_t> bands;
+	for (long b=0; b<len(bands_object); b++) {
+		object band=bands_object[b];
+		bands.push_back(numpy_view_extract<arr_type>(band.ptr()));
+	}
+	cluster_t clusters = find_clusters_bands(bands);
+	return new ClusterWrap(clusters);
+}
+
 boost::python::list get_list(void) {
 	boost::python::list retlist;
 	retlist.append(boost::python::make_tuple(3,4));
@@ -358,6 +591,24 @@ BOOST_PYTHON_MODULE(raster_stats) {
 	def( "find_clusters_pointer_time", find_clusters_pointer_time_wrap ) ;
 	def( "find_clusters_remap", find_clusters_remap_wrap, return_value_policy<manage_new_object>() ) ;
 	def( "find_clusters_remap_time", find_clusters_remap_time_wrap ) ;
+	def( "find_clusters_periodic", find_clusters_periodic_wrap ) ;
+	def( "find_clusters_periodic_time", find_clusters_periodic_time_wrap ) ;
+	def( "find_clusters_nodata", find_clusters_nodata_wrap, return_value_policy<manage_new_object>() ) ;
+	def( "find_clusters_nodata_time", find_clusters_nodata_time_wrap ) ;
+	def( "find_clusters_grouped", find_clusters_grouped_wrap, return_value_policy<manage_new_object>() ) ;
+	def( "find_clusters_grouped_time", find_clusters_grouped_time_wrap ) ;
+	def( "find_clusters_window", find_clusters_window_wrap, return_value_policy<manage_new_object>() ) ;
+	def( "find_clusters_window_time", find_clusters_window_time_wrap ) ;
+	def( "find_clusters_cached", find_clusters_cached_wrap, return_value_policy<manage_new_object>() ) ;
+	def( "find_clusters_replicated", find_clusters_replicated_wrap, return_value_policy<manage_new_object>() ) ;
+	def( "find_clusters_replicated_time", find_clusters_replicated_time_wrap ) ;
+	def( "raster_hash", raster_hash_wrap ) ;
+	def( "hash_tiles", hash_tiles_wrap ) ;
+	def( "box_counts", box_counts_wrap ) ;
+	def( "find_clusters_tolerance", find_clusters_tolerance_wrap, return_value_policy<manage_new_object>() ) ;
+	def( "find_clusters_tolerance_time", find_clusters_tolerance_time_wrap ) ;
+	def( "find_clusters_binned", find_clusters_binned_wrap, return_value_policy<manage_new_object>() ) ;
+	def( "find_clusters_bands", find_clusters_bands_wrap, return_value_policy<manage_new_object>() ) ;
 
 	def("get_list", get_list) ;
 }
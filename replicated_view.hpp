@@ -0,0 +1,126 @@
+/*! replicated_view.hpp
+ *  A raster that is a smaller raster repeated, as resize_replicate makes,
+ *  without making it. Pixel (i,j) is read from (i mod h, j mod w) of the
+ *  source when it is asked for, so a scaling benchmark can cluster a
+ *  raster far larger than memory from a source that fits in cache.
+ */
+#ifndef _REPLICATED_VIEW_HPP_
+#define _REPLICATED_VIEW_HPP_ 1
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <boost/array.hpp>
+#include "raster.hpp"
+#include "raster_view.hpp"
+
+namespace raster_stats {
+
+    /*! Answers size1(), size2() and operator()(i,j) like landscape_t, so
+     *  the engines that read pixel by pixel take it as they are. Engines
+     *  that read whole rows can use copy_row.
+     */
+    template<class T>
+    class replicated_view {
+    public:
+        typedef T      value_type;
+        typedef size_t size_type;
+    private:
+        raster_view<T> source_;
+        size_type      size1_;
+        size_type      size2_;
+
+        //! i mod n, without a divide for the first copy.
+        static size_type wrap(size_type i, size_type n) {
+            return (i<n) ? i : i%n;
+        }
+    public:
+        replicated_view() : size1_(0), size2_(0) {}
+
+        replicated_view(const raster_view<T>& source, size_type size1,
+                        size_type size2)
+            : source_(source), size1_(size1), size2_(size2) {
+            if ((size1>0 || size2>0) &&
+                    (source.size1()==0 || source.size2()==0)) {
+                throw std::runtime_error("Cannot replicate an empty raster.");
+            }
+        }
+
+        size_type size1() const { return size1_; }
+        size_type size2() const { return size2_; }
+        const raster_view<T>& source() const { return source_; }
+
+        const T& operator()(size_type i, size_type j) const {
+            return source_(wrap(i,source_.size1()),wrap(j,source_.size2()));
+        }
+
+        //! Linear index i*size2()+j, for code that numbers pixels that way.
+        const T& operator[](size_type n) const {
+            return (*this)(n/size2_,n%size2_);
+        }
+
+        /*! Writes row i to out, size2() values. After the first run of
+         *  the source, it copies what it has written so far, doubling
+         *  each time, so a narrow source takes few memcpy calls.
+         */
+        void copy_row(size_type i, T* out) const {
+            const T* row=source_.row(wrap(i,source_.size1()));
+            size_type done=std::min(source_.size2(), size2_);
+            std::memcpy(out, row, done*sizeof(T));
+            while (done<size2_) {
+                const size_type n=std::min(done, size2_-done);
+                std::memcpy(out+done, out, n*sizeof(T));
+                done+=n;
+            }
+        }
+    };
+
+
+    typedef replicated_view<unsigned char> replicated_landscape_t;
+
+
+    //! Repeats raster until it is ns[0] by ns[1].
+    template<class T>
+    replicated_view<T> make_replicated(const raster_view<T>& raster,
+                                       boost::array<size_t,2> ns)
+    {
+        return replicated_view<T>(raster, ns[0], ns[1]);
+    }
+
+
+    template<class T>
+    replicated_view<T> make_replicated(const boost::numeric::ublas::matrix<T>& raster,
+                                       boost::array<size_t,2> ns)
+    {
+        return replicated_view<T>(make_view(raster), ns[0], ns[1]);
+    }
+
+
+
+    /*! The same test as for a landscape, with one skip_value for each
+     *  piece of a source row that the region covers.
+     */
+    inline bool uniform_region(const replicated_landscape_t& raster,
+                               size_t i0, size_t i1, size_t j0, size_t j1)
+    {
+        const landscape_view_t& source=raster.source();
+        const size_t h=source.size1();
+        const size_t w=source.size2();
+        const unsigned char value=raster(i0,j0);
+        for (size_t i=i0; i<i1; i++) {
+            const unsigned char* row=source.row(i%h);
+            for (size_t j=j0; j<j1; ) {
+                const size_t begin=j%w;
+                const size_t end=std::min(w, begin+(j1-j));
+                if (skip_value(row+begin,row+end,value)!=row+end) {
+                    return false;
+                }
+                j+=end-begin;
+            }
+        }
+        return true;
+    }
+}
+
+#endif // _REPLICATED_VIEW_HPP_
@@ -0,0 +1,89 @@
+#ifndef _SCRATCH_ARENA_HPP_
+#define _SCRATCH_ARENA_HPP_ 1
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <memory_resource>
+
+
+namespace raster_stats {
+
+    /*! Passes allocations through to another resource and counts
+     *  how many bytes were asked for, so the arena knows how much
+     *  it overflowed its buffer.
+     */
+    class counting_resource : public std::pmr::memory_resource {
+        std::pmr::memory_resource* upstream_;
+        size_t bytes_;
+    public:
+        explicit counting_resource(std::pmr::memory_resource* upstream)
+            : upstream_(upstream), bytes_(0) {}
+
+        size_t bytes() const { return bytes_; }
+        void reset() { bytes_=0; }
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) {
+            bytes_+=bytes;
+            return upstream_->allocate(bytes,alignment);
+        }
+        void do_deallocate(void* p, size_t bytes, size_t alignment) {
+            upstream_->deallocate(p,bytes,alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& b) const noexcept {
+            return this==&b;
+        }
+    };
+
+
+
+    /*! Scratch space for clustering that is freed in one shot.
+     *  Everything allocated from resource() is bump-allocated from
+     *  one buffer, deallocation does nothing, and release() hands all
+     *  of it back at once. If a run needed more than the buffer, the
+     *  buffer grows on release() so the next run fits, which means
+     *  repeated runs on similar rasters stop touching the heap.
+     *
+     *  An arena is for one thread at a time.
+     */
+    class scratch_arena {
+        std::vector<std::max_align_t> buffer_;
+        counting_resource overflow_;
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+    public:
+        explicit scratch_arena(size_t initial_bytes=(1<<20))
+            : buffer_(initial_bytes/sizeof(std::max_align_t)+1),
+              overflow_(std::pmr::new_delete_resource())
+        {
+            reset_arena();
+        }
+        scratch_arena(const scratch_arena&) = delete;
+        scratch_arena& operator=(const scratch_arena&) = delete;
+
+        std::pmr::memory_resource* resource() { return arena_.get(); }
+
+        //! Bytes available before the arena goes to the heap.
+        size_t capacity() const { return buffer_.size()*sizeof(std::max_align_t); }
+
+        //! Frees everything allocated since the last release.
+        void release() {
+            arena_->release();
+            if (overflow_.bytes()>0) {
+                size_t needed=capacity()+overflow_.bytes();
+                arena_.reset();
+                buffer_.clear();
+                buffer_.shrink_to_fit();
+                buffer_.resize(needed/sizeof(std::max_align_t)+1);
+                reset_arena();
+            }
+            overflow_.reset();
+        }
+    private:
+        void reset_arena() {
+            arena_.reset(new std::pmr::monotonic_buffer_resource(
+                             &buffer_[0],capacity(),&overflow_));
+        }
+    };
+}
+
+#endif // _SCRATCH_ARENA_HPP_
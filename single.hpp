@@ -1,11 +1,15 @@
 #ifndef _SINGLE_HPP_
 #define _SINGLE_HPP_ 1
 
+#include <algorithm>
 #include <functional>
 #include <memory>
+#include <map>
+#include <memory_resource>
 #include "boost/concept/assert.hpp"
 #include "boost/property_map/property_map.hpp"
 #include "boost/pending/disjoint_sets.hpp"
+#include "grid2d.hpp"
 
 
 
@@ -14,6 +18,8 @@ namespace raster_stats {
 
     /*! This binary comparison uses an associative property map
      *  to determine whether the two vertices are equal.
+     *  A vertex whose coordinates are a narrower integer than
+     *  the map's key, as from array_basis<uint32_t>, is widened.
      */
     template<class Vertex,class Property>
     struct AreEqual :
@@ -25,6 +31,17 @@ namespace raster_stats {
         bool operator()(const Vertex& a, const Vertex& b) const {
             return get(p_,a)==get(p_,b);
         }
+        template<class V>
+        bool operator()(const V& a, const V& b) const {
+            return get(p_,widen(a))==get(p_,widen(b));
+        }
+    private:
+        template<class V>
+        static Vertex widen(const V& v) {
+            Vertex k;
+            std::copy(v.begin(),v.end(),k.begin());
+            return k;
+        }
     };
 
 
@@ -48,6 +65,25 @@ namespace raster_stats {
         construct_disjoint_set()
             : rank_pmap_(rank_map_), parent_pmap_(parent_map_),
               dset_(rank_pmap_,parent_pmap_) {}
+
+        //! For RANK and PARENT that allocate from a memory resource.
+        explicit construct_disjoint_set(std::pmr::memory_resource* resource)
+            : rank_map_(resource), parent_map_(resource),
+              rank_pmap_(rank_map_), parent_pmap_(parent_map_),
+              dset_(rank_pmap_,parent_pmap_) {}
+    };
+
+
+
+    /*! A RANK or PARENT policy for construct_disjoint_set whose nodes
+     *  come from a memory resource, such as scratch_arena::resource().
+     */
+    template<typename FROM, typename TO>
+    struct pmr_map : public std::pmr::map<FROM,TO>
+    {
+        pmr_map() {}
+        explicit pmr_map(std::pmr::memory_resource* resource)
+            : std::pmr::map<FROM,TO>(resource) {}
     };
 
 
@@ -63,6 +99,9 @@ namespace raster_stats {
 	class union_find_st : public CONSTRUCT
 	{
     public:
+        union_find_st() {}
+        explicit union_find_st(std::pmr::memory_resource* resource)
+            : CONSTRUCT(resource) {}
 
         template<class BASIS, class TEST, class ITER, class ADJACENCY>
 		void operator()(const BASIS& basis, const TEST& compare,
@@ -96,6 +135,37 @@ namespace raster_stats {
             std::cout << "Number unioned " << unioned << std::endl;
             std::cout << "Not unioned " << total-unioned << std::endl;
 	    }
+
+
+        /*! The same union-find over a row-major sweep with a stencil,
+         *  such as stencil_four or stencil_eight. Only the causal half
+         *  of the stencil is needed, and those neighbors are already
+         *  sets, so there is no lookup or bounds test per neighbor
+         *  away from the edges.
+         */
+        template<class BASIS, class TEST, class STENCIL>
+        void operator()(const BASIS& basis, const TEST& compare, STENCIL)
+        {
+            typedef typename BASIS::vertex_type vertex_type;
+            stencil_sweep<STENCIL,0,STENCIL::causal>(basis,
+                [this](const vertex_type& v) {
+                    this->dset_.make_set(v);
+                },
+                [this,&compare](const vertex_type& v, const vertex_type& n) {
+                    if (compare(n,v)) {
+                        this->dset_.union_set(n,v);
+                    }
+                });
+            // Neighbors across a periodic edge were not sets yet.
+            if (basis.periodic_) {
+                stencil_seams<STENCIL,0,STENCIL::causal>(basis,
+                    [this,&compare](const vertex_type& v, const vertex_type& n) {
+                        if (compare(n,v)) {
+                            this->dset_.union_set(n,v);
+                        }
+                    });
+            }
+        }
 	};
 
 }
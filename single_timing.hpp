@@ -35,7 +35,8 @@ namespace raster_stats
 
             auto transform=std::make_shared<typename MAP::transform_type>(
                                                          extent[0],block);
-            auto data=std::make_shared<MAP>(*transform,extent[0]*extent[1]);
+            auto data=std::make_shared<MAP>(*transform,
+                                            storage_size(*transform,extent));
 
             limits[0]=0;
             limits[1]=level_cnt;
@@ -72,9 +73,7 @@ namespace raster_stats
                                            bound_map> disj_t;
 
             union_find_st<disj_t> ufind;
-            ufind(*basis_,comparison,
-                  make_vertex_iterator<BASIS>,
-                  make_four_adjacent<BASIS>);
+            ufind(*basis_,comparison,stencil_four());
     
             //auto clusters = gather_clusters(ufind.rank_pmap_,ufind.dset_,
             //                                extent);
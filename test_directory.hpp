@@ -0,0 +1,44 @@
+/*! test_directory.hpp
+ *  A place for the files a unit test writes, so tests neither leave
+ *  files where they are run nor read each other's.
+ */
+#ifndef _TEST_DIRECTORY_HPP_
+#define _TEST_DIRECTORY_HPP_ 1
+
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace raster_stats {
+
+    /*! A new directory for the files one test writes. It is removed,
+     *  with everything in it, when the test is done with it.
+     */
+    struct test_directory {
+        std::string path;
+        test_directory() {
+            std::string name=(std::filesystem::temp_directory_path()/
+                              "raster_test_XXXXXX").string();
+            std::vector<char> buffer(name.begin(),name.end());
+            buffer.push_back(0);
+            if (0==::mkdtemp(&buffer[0])) {
+                throw std::runtime_error("Could not make a test directory.");
+            }
+            path=&buffer[0];
+        }
+        ~test_directory() {
+            std::error_code ignored;
+            std::filesystem::remove_all(path,ignored);
+        }
+        test_directory(const test_directory&) = delete;
+        test_directory& operator=(const test_directory&) = delete;
+
+        std::string file(const std::string& name) const {
+            return path+"/"+name;
+        }
+    };
+}
+
+#endif // _TEST_DIRECTORY_HPP_
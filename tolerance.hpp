@@ -0,0 +1,108 @@
+/*! tolerance.hpp
+ *  Connectivity for continuous rasters, such as elevation or NDVI,
+ *  where neighbors join when their values are close rather than equal.
+ *  Clusters are the connected pieces of the "close" relation, so two
+ *  pixels in one cluster may differ by more than the tolerance.
+ */
+#ifndef _TOLERANCE_HPP_
+#define _TOLERANCE_HPP_ 1
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+
+namespace raster_stats {
+
+    /*! Row kernels write mask[k]=1 where a[k] and b[k] should join.
+     *  The engines call them on a row and the row above, and on a row
+     *  and itself shifted by one, then union wherever the mask is set.
+     */
+    template<class T>
+    struct tolerance_kernel
+    {
+        T tolerance_;
+        explicit tolerance_kernel(T tolerance) : tolerance_(tolerance) {}
+
+        bool operator()(T a, T b) const {
+            return (a>b ? a-b : b-a)<tolerance_;
+        }
+
+        //! No branches, so the compiler can vectorise the loop.
+        void operator()(const T* a, const T* b, size_t n,
+                        unsigned char* mask) const {
+            for (size_t k=0; k<n; k++) {
+                const T difference=(a[k]>b[k]) ? a[k]-b[k] : b[k]-a[k];
+                mask[k]=difference<tolerance_;
+            }
+        }
+    };
+
+
+
+    /*! Joins values that fall in the same bin. edges are the sorted
+     *  boundaries between bins, such as quantiles, so n edges make
+     *  n+1 bins and a value equal to an edge goes in the upper bin.
+     *  NaN gets a bin of its own, so missing data clusters apart.
+     */
+    template<class T>
+    struct bin_kernel
+    {
+        std::vector<T> edges_;
+        explicit bin_kernel(const std::vector<T>& edges) : edges_(edges) {
+            if (!std::is_sorted(edges_.begin(),edges_.end())) {
+                throw std::runtime_error("Bin edges must be sorted.");
+            }
+        }
+
+        size_t bin(T v) const {
+            if (v!=v) {
+                return edges_.size()+1;
+            }
+            return std::upper_bound(edges_.begin(),edges_.end(),v)-
+                edges_.begin();
+        }
+
+        bool operator()(T a, T b) const { return bin(a)==bin(b); }
+
+        void operator()(const T* a, const T* b, size_t n,
+                        unsigned char* mask) const {
+            for (size_t k=0; k<n; k++) {
+                mask[k]=bin(a[k])==bin(b[k]);
+            }
+        }
+    };
+
+
+
+    /*! A compare policy like AreEqual, for union_find_st and
+     *  disjoint_set_cluster, that asks a kernel whether two vertices'
+     *  values join.
+     */
+    template<class Vertex,class Property,class KERNEL>
+    struct AreSimilar
+    {
+        const Property& p_;
+        KERNEL kernel_;
+        AreSimilar(const Property& p, const KERNEL& kernel)
+            : p_(p), kernel_(kernel) {}
+        AreSimilar(const AreSimilar& b) : p_(b.p_), kernel_(b.kernel_) {}
+        bool operator()(const Vertex& a, const Vertex& b) const {
+            return kernel_(get(p_,a),get(p_,b));
+        }
+        template<class V>
+        bool operator()(const V& a, const V& b) const {
+            return kernel_(get(p_,widen(a)),get(p_,widen(b)));
+        }
+    private:
+        template<class V>
+        static Vertex widen(const V& v) {
+            Vertex k;
+            std::copy(v.begin(),v.end(),k.begin());
+            return k;
+        }
+    };
+}
+
+#endif // _TOLERANCE_HPP_
@@ -0,0 +1,60 @@
+/*! vertex_index.hpp
+ *  Chooses the integer type that numbers the pixels of a raster.
+ *  Disjoint-set maps hold two of these per pixel, so a 32-bit index
+ *  halves their size for any raster under four billion pixels.
+ */
+#ifndef _VERTEX_INDEX_HPP_
+#define _VERTEX_INDEX_HPP_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+
+namespace raster_stats {
+
+    /*! True if INDEX can number every pixel of a size1 x size2 raster
+     *  and still hold size1*size2 itself, which loops use as an end.
+     */
+    template<class INDEX>
+    bool index_fits(size_t size1, size_t size2)
+    {
+        return size2==0 ||
+            size1<=size_t(std::numeric_limits<INDEX>::max())/size2;
+    }
+
+
+
+    //! Throws if INDEX is too small for the raster.
+    template<class INDEX>
+    void check_index(size_t size1, size_t size2)
+    {
+        if (!index_fits<INDEX>(size1,size2)) {
+            throw std::runtime_error("Raster has too many pixels "
+                                     "for the vertex index type.");
+        }
+    }
+
+
+
+    /*! Calls engine with a uint32_t if that fits the raster, or with
+     *  a size_t otherwise. The engine is a generic lambda, or any
+     *  functor, that reads the index type from its argument:
+     *
+     *    dispatch_index(m, n, [&](auto index) {
+     *        return run<decltype(index)>(raster);
+     *    });
+     */
+    template<class F>
+    auto dispatch_index(size_t size1, size_t size2, F engine)
+        -> decltype(engine(size_t()))
+    {
+        if (index_fits<uint32_t>(size1,size2)) {
+            return engine(uint32_t());
+        }
+        return engine(size_t());
+    }
+}
+
+#endif // _VERTEX_INDEX_HPP_